@@ -18,4 +18,26 @@
 #define P7 21
 #define P8 47
 
+// Optional IRIG-B12x (AM) output: PDM from I2S0, an RC low-pass on the pin
+// leaves the 1 kHz carrier. Not fitted on the standard board; build with
+// -DIRIG_AM_PIN=<gpio>. It carries the frames of IRIG_AM_CHANNEL, so B12x
+// follows that channel's B00x format.
+#ifdef IRIG_AM_PIN
+#ifndef IRIG_AM_CHANNEL
+#define IRIG_AM_CHANNEL 1
+#endif
+#endif
+
+// Optional DMA output backend (-DIRIG_OUTPUT_DMA): the LCD_CAM i80 bus
+// drives P1..P8 as one parallel port. The bus also needs a write strobe and
+// a data/command pin, both on pads nothing else uses.
+#ifdef IRIG_OUTPUT_DMA
+#ifndef IRIG_DMA_WR_PIN
+#define IRIG_DMA_WR_PIN 17
+#endif
+#ifndef IRIG_DMA_DC_PIN
+#define IRIG_DMA_DC_PIN 18
+#endif
+#endif
+
 #endif // PINS_H
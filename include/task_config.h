@@ -0,0 +1,38 @@
+#ifndef TASK_CONFIG_H
+#define TASK_CONFIG_H
+
+// Core and priority of every task, so the outputs keep their timing however
+// busy the network gets.
+//
+// The output core takes the output interrupts (timer, edge compare, LCD_CAM
+// and I2S DMA, all allocated on the core that installs them), the frame
+// encoding and rendering tasks and the reference task. The network core takes lwIP,
+// AsyncTCP, the W5500, the NTP client, the Arduino loop (display and web
+// pushes) and the ethernet monitor.
+//
+// The cores can be swapped or merged from build_flags. The Arduino loop and
+// AsyncTCP are placed by their own flags (ARDUINO_RUNNING_CORE,
+// CONFIG_ASYNC_TCP_RUNNING_CORE in platformio.ini), which have to match
+// TASK_CORE_NETWORK. The lwIP tcpip task is placed by the sdkconfig of the
+// prebuilt Arduino framework and cannot be moved from here.
+#ifndef TASK_CORE_OUTPUT
+#define TASK_CORE_OUTPUT 1
+#endif
+#ifndef TASK_CORE_NETWORK
+#define TASK_CORE_NETWORK 0
+#endif
+
+// Output core. Frame rendering runs a few ms ahead of its deadline and must
+// win against everything but the interrupts.
+#define TASK_OUTPUT_START_PRIORITY 10    // Installs the output interrupts, then ends
+#define TASK_OUTPUT_RENDER_PRIORITY 10   // edge_output, dma_output
+#define TASK_OUTPUT_ENCODE_PRIORITY 6    // output_encode, the next frame of every channel
+#define TASK_AM_OUTPUT_PRIORITY 5        // am_output, refills the I2S DMA queue
+#define TASK_IRIG_REFERENCE_PRIORITY 2   // Decodes the reference, steers the timebase
+
+// Network core. AsyncTCP runs at CONFIG_ASYNC_TCP_PRIORITY (platformio.ini),
+// above these, so web requests are served before the background work.
+#define TASK_NTP_PRIORITY 1              // NTP queries and encoding ahead
+#define TASK_ETH_MONITOR_PRIORITY 1
+
+#endif // TASK_CONFIG_H
@@ -1,9 +1,16 @@
+// Device only, the native tests build the rest of this library
+#ifdef ARDUINO
+
 #include "decoder.h"
 #include "Arduino.h"
+#include "driver/gpio.h"
 
 // Global decoder instance
 IRIGBDecoder* IRIGBDecoder::instance = nullptr;
 
+// Guards bits_res/frameOnTimeEdge between the edge ISR and get_frame()
+static portMUX_TYPE frameMux = portMUX_INITIALIZER_UNLOCKED;
+
 IRIGBDecoder::IRIGBDecoder(uint8_t inputPin) : inputPin(inputPin), bitIndex(0), lastEdgeTime(0), lastPinState(false), frameComplete(false) {
   // Initialize arrays manually to avoid volatile pointer issues
   for (int i = 0; i < 101; i++) {
@@ -13,10 +20,23 @@ IRIGBDecoder::IRIGBDecoder(uint8_t inputPin) : inputPin(inputPin), bitIndex(0),
   bits[100] = '\0'; // Null terminator
   bit_state = 0;
   push_state = 0;
+  onTimeEdge = 0;
+  frameOnTimeEdge = 0;
+  pulseHook = nullptr;
+  stats.pulses = 0;
+  stats.rejected = 0;
+  stats.frames = 0;
+  stats.frame_errors = 0;
+  stats.bit_errors = 0;
 }
 
-void IRIGBDecoder::begin() {
-  pinMode(inputPin, INPUT_PULLUP);
+void IRIGBDecoder::begin(bool loopback) {
+  if (loopback) {
+    // Keep driving the output, just enable the input buffer next to it
+    gpio_set_direction((gpio_num_t)inputPin, GPIO_MODE_INPUT_OUTPUT);
+  } else {
+    pinMode(inputPin, INPUT_PULLUP);
+  }
   instance = this;
 
   // Attach interrupt to pin for both rising and falling edges
@@ -42,7 +62,7 @@ void IRAM_ATTR IRIGBDecoder::interruptHandler() {
   }
 }
 
-void IRIGBDecoder::push(char x) {
+void IRIGBDecoder::push(char x, unsigned long riseTime) {
   switch(push_state) {
     case 0:
       if(x == 'M') {
@@ -56,28 +76,65 @@ void IRIGBDecoder::push(char x) {
         push_state = 2;
         bits[bitIndex] = 'M';
         bitIndex++;
+        onTimeEdge = riseTime;
       } else {
         push_state = 0;
         bitIndex = 0;
       }
       break;
-    case 2:
+    case 2: {
+      // Markers sit at index 0, 1 and every tenth index, nowhere else
+      bool markerExpected = (bitIndex % 10 == 0);
+      if((x == 'M') != markerExpected) {
+        frameError();
+        if(x == 'M') {
+          // Could be the first marker of the next reference pair
+          push_state = 1;
+          bits[0] = 'M';
+          bitIndex = 1;
+        }
+        break;
+      }
       bits[bitIndex] = x;
       bitIndex++;
       if(bitIndex >= 100) {
         push_state = 0;
+        portENTER_CRITICAL_ISR(&frameMux);
         for(int i = 0; i < bitIndex; i++) {
           bits_res[i] = bits[i];
         }
         bits_res[100] = '\0'; // Null terminator
+        frameOnTimeEdge = onTimeEdge;
         frameComplete = true;
+        portEXIT_CRITICAL_ISR(&frameMux);
+        stats.frames++;
         bitIndex = 0;
       }
       break;
+    }
   }
 }
 
+void IRIGBDecoder::frameError() {
+  stats.bit_errors++;
+  stats.frame_errors++;
+  push_state = 0;
+  bitIndex = 0;
+}
+
+IRIGBDecoderStats IRIGBDecoder::getStats() const {
+  IRIGBDecoderStats copy;
+  copy.pulses = stats.pulses;
+  copy.rejected = stats.rejected;
+  copy.frames = stats.frames;
+  copy.frame_errors = stats.frame_errors;
+  copy.bit_errors = stats.bit_errors;
+  return copy;
+}
+
 void IRIGBDecoder::handleInterrupt() {
+  // Timestamp first so the on-time edge carries as little ISR latency as possible
+  unsigned long now = micros();
   bool currentPinState = digitalRead(inputPin);
 //   noInterrupts();
 
@@ -85,19 +142,35 @@ void IRIGBDecoder::handleInterrupt() {
     case 0:
       if (currentPinState == HIGH) {
         bit_state = 1;
-        lastEdgeTime = micros();
+        lastEdgeTime = now;
       }
       break;
     case 1:
       if (currentPinState == LOW) {
         bit_state = 0;
-        unsigned long width = micros() - lastEdgeTime;
-        if(width > 1500 && width < 2500) {
-          push('0');
-        } else if(width > 4500 && width < 5500) {
-          push('1');
-        } else if(width > 7500 && width < 8500) {
-          push('M');
+        unsigned long width = now - lastEdgeTime;
+        stats.pulses++;
+        PulseSymbol symbol = classifier.classify(width);
+        if(pulseHook) {
+          pulseHook(lastEdgeTime, width, symbol);
+        }
+        switch(symbol) {
+          case PulseSymbol::ZERO:
+            push('0', lastEdgeTime);
+            break;
+          case PulseSymbol::ONE:
+            push('1', lastEdgeTime);
+            break;
+          case PulseSymbol::MARKER:
+            push('M', lastEdgeTime);
+            break;
+          default:
+            // Unclassifiable pulse, the frame in progress cannot be trusted
+            stats.rejected++;
+            if(push_state != 0) {
+              frameError();
+            }
+            break;
         }
       }
       break;
@@ -125,6 +198,49 @@ String IRIGBDecoder::get_data() {
   return String("");
 }
 
+// BCD digit from 'count' bits (LSB first) at consecutive frame indices;
+// clears 'valid' for the codes above 9
+static uint8_t bcd_digit(const char* frame, int start, int count, bool& valid) {
+  uint8_t value = 0;
+  for (int i = 0; i < count; i++) {
+    if (frame[start + i] == '1') {
+      value |= 1 << i;
+    }
+  }
+  if (value > 9) {
+    valid = false;
+  }
+  return value;
+}
+
+bool IRIGBDecoder::get_frame(IrigTime& time, uint32_t& on_time_us) {
+  if (!frameComplete) {
+    return false;
+  }
+  char frame[100];
+  portENTER_CRITICAL(&frameMux);
+  for (int i = 0; i < 100; i++) {
+    frame[i] = bits_res[i];
+  }
+  on_time_us = frameOnTimeEdge;
+  frameComplete = false;
+  portEXIT_CRITICAL(&frameMux);
+
+  // Same layout as irig_encode_frame
+  bool valid = true;
+  time.second = bcd_digit(frame, 2, 4, valid) + 10 * bcd_digit(frame, 7, 3, valid);
+  time.minute = bcd_digit(frame, 11, 4, valid) + 10 * bcd_digit(frame, 16, 3, valid);
+  time.hour = bcd_digit(frame, 21, 4, valid) + 10 * bcd_digit(frame, 26, 2, valid);
+  time.day = bcd_digit(frame, 31, 4, valid) + 10 * bcd_digit(frame, 36, 4, valid) + 100 * bcd_digit(frame, 41, 2, valid);
+  time.year = bcd_digit(frame, 51, 4, valid) + 10 * bcd_digit(frame, 56, 4, valid);
+
+  if (!valid || time.second > 59 || time.minute > 59 || time.hour > 23 || time.day < 1 || time.day > 366) {
+    stats.frame_errors++;
+    return false;
+  }
+  return true;
+}
+
 // Global functions for compatibility with main.cpp
 static IRIGBDecoder* decoder_instance = nullptr;
 
@@ -132,8 +248,10 @@ IRIGBDecoder* get_decoder() {
   return decoder_instance;
 }
 
-void init_decoder() {
+void init_decoder(bool loopback) {
   decoder_instance = new IRIGBDecoder(47); // P8 is pin 47
-  decoder_instance->begin();
-  Serial.println("IRIG-B Decoder initialized on pin 47");
-}
\ No newline at end of file
+  decoder_instance->begin(loopback);
+  Serial.printf("IRIG-B Decoder initialized on pin 47%s\n", loopback ? " (loopback)" : "");
+}
+
+#endif // ARDUINO
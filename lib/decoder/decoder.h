@@ -2,16 +2,34 @@
 #define DECODER_H
 
 #include <Arduino.h>
+#include "pulse_classifier.h"
+#include "irigb.h"
 
 // Removed IrigTime struct - no longer needed for raw bit output
 
+// Bit error statistics
+struct IRIGBDecoderStats {
+  uint32_t pulses;         // Pulses measured
+  uint32_t rejected;       // Pulses outside every width cluster
+  uint32_t frames;         // Complete frames with all markers in place
+  uint32_t frame_errors;   // Frames abandoned: a misplaced symbol, or a time that is no BCD time of day
+  uint32_t bit_errors;     // Misplaced symbols (marker where data was expected or vice versa)
+};
+
+// Called from the edge ISR for every measured pulse
+typedef void (*IRIGBPulseHook)(unsigned long rise_us, unsigned long width_us, PulseSymbol symbol);
+
 class IRIGBDecoder {
 public:
   // Constructor
   IRIGBDecoder(uint8_t inputPin);
 
-  // Initialize the decoder
-  void begin();
+  // Initialize the decoder. With loopback the pin stays an output and its
+  // own level is read back (input and output buffers both enabled).
+  void begin(bool loopback = false);
+
+  // Observe every pulse (used by the loopback self-monitor)
+  void setPulseHook(IRIGBPulseHook hook) { pulseHook = hook; }
 
   // Removed time decoding methods - now only raw bit output
 
@@ -24,24 +42,44 @@ public:
   // Get data as String and reset the flag
   String get_data();
 
+  // Decode the last complete frame and reset the flag. on_time_us is the
+  // micros() timestamp of the frame's on-time (Pr leading) edge.
+  bool get_frame(IrigTime& time, uint32_t& on_time_us);
+
   // Print current bits for debugging
   void printBits() const;
 
+  // Bit error statistics since begin()
+  IRIGBDecoderStats getStats() const;
+
+  // Adaptive pulse width classifier (cluster centers, thresholds, confidence)
+  const PulseClassifier& getClassifier() const { return classifier; }
+
+  // Re-estimate the pulse width thresholds when due; call from a task, the
+  // edge interrupt only counts the pulses
+  void updateClassifier() { classifier.update(); }
+
 private:
   uint8_t inputPin;
   volatile char bits[101]; // Store as 'M', '0', '1' + null terminator
   volatile char bits_res[101]; // Result buffer
   volatile uint8_t bitIndex;
   volatile unsigned long lastEdgeTime;
+  volatile unsigned long onTimeEdge;      // Rising edge of the Pr marker of the frame in progress
+  volatile unsigned long frameOnTimeEdge; // Same, for the frame in bits_res
   volatile bool lastPinState;
   volatile bool frameComplete;
   volatile byte bit_state;
   volatile byte push_state;
+  PulseClassifier classifier;
+  IRIGBPulseHook pulseHook;
+  volatile IRIGBDecoderStats stats;
 
   // Interrupt service routine
   static void IRAM_ATTR interruptHandler();
   void handleInterrupt();
-  void push(char x);
+  void push(char x, unsigned long riseTime);
+  void frameError();
 
   // Process completed frame
   void processFrame();
@@ -50,4 +88,8 @@ private:
   static IRIGBDecoder* instance;
 };
 
+// Decoder on the P8 pin
+void init_decoder(bool loopback = false);
+IRIGBDecoder* get_decoder();
+
 #endif // DECODER_H
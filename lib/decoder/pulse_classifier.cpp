@@ -0,0 +1,195 @@
+#include "pulse_classifier.h"
+
+// Nominal IRIG-B pulse widths, used until the input has been characterised
+static const uint32_t NOMINAL_CENTERS[3] = {2000, 5000, 8000};
+
+// Minimum distance between neighbouring clusters
+static const uint32_t MIN_CLUSTER_SPACING_US = 1000;
+
+// k-means iterations per re-estimation (converges in 2-3 for IRIG-B)
+static const uint8_t KMEANS_ITERATIONS = 8;
+
+PulseClassifier::PulseClassifier() {
+  reset();
+}
+
+void PulseClassifier::reset() {
+  for (int i = 0; i < NUM_BINS; i++) {
+    histogram[i] = 0;
+  }
+  active = 0;
+  pulses = 0;
+  pulses_at_update = 0;
+  rejected_count = 0;
+  confidence_pct = 0;
+  setNominal();
+}
+
+void PulseClassifier::setNominal() {
+  applyCenters(NOMINAL_CENTERS, false);
+}
+
+void PulseClassifier::applyCenters(const uint32_t* c, bool adapted) {
+  // Filled in the copy classify() is not using, then switched to
+  Limits& next = limits[active ^ 1];
+  for (int i = 0; i < 3; i++) {
+    next.centers[i] = c[i];
+  }
+  next.thresholds[0] = (c[0] + c[1]) / 2;
+  next.thresholds[1] = (c[1] + c[2]) / 2;
+
+  // Accept as far below the zero cluster / above the marker cluster as the
+  // neighbouring half-spacing, clamped to the physical limits
+  uint32_t below = next.thresholds[0] - c[0];
+  uint32_t above = c[2] - next.thresholds[1];
+  next.lower = (c[0] > below + MIN_WIDTH_US) ? c[0] - below : MIN_WIDTH_US;
+  next.upper = (c[2] + above < MAX_WIDTH_US) ? c[2] + above : MAX_WIDTH_US;
+  next.adapted = adapted;
+  active ^= 1;
+}
+
+PulseSymbol PulseClassifier::classify(uint32_t width_us) {
+  if (width_us < MIN_WIDTH_US || width_us > MAX_WIDTH_US) {
+    rejected_count = rejected_count + 1;
+    return PulseSymbol::INVALID;
+  }
+
+  uint8_t bin = width_us / BIN_WIDTH_US;
+  if (bin >= NUM_BINS) {
+    bin = NUM_BINS - 1;
+  }
+  if (histogram[bin] < 0xFFFF) {
+    histogram[bin] = histogram[bin] + 1;
+  }
+  pulses = pulses + 1;
+
+  const Limits& current = limits[active];
+  if (width_us < current.lower || width_us > current.upper) {
+    rejected_count = rejected_count + 1;
+    return PulseSymbol::INVALID;
+  }
+  if (width_us < current.thresholds[0]) {
+    return PulseSymbol::ZERO;
+  }
+  if (width_us < current.thresholds[1]) {
+    return PulseSymbol::ONE;
+  }
+  return PulseSymbol::MARKER;
+}
+
+bool PulseClassifier::update() {
+  uint32_t counted = pulses;
+  if (counted - pulses_at_update < WINDOW) {
+    return false;
+  }
+  pulses_at_update = counted;
+  recompute();
+  return true;
+}
+
+static uint8_t nearestCluster(uint32_t width, const uint32_t* c) {
+  uint8_t best = 0;
+  uint32_t best_dist = 0xFFFFFFFF;
+  for (uint8_t k = 0; k < 3; k++) {
+    uint32_t dist = width > c[k] ? width - c[k] : c[k] - width;
+    if (dist < best_dist) {
+      best_dist = dist;
+      best = k;
+    }
+  }
+  return best;
+}
+
+void PulseClassifier::recompute() {
+  // One copy for the whole estimate, the interrupt keeps counting into the live one
+  uint16_t histogram[NUM_BINS];
+  uint32_t total = 0;
+  for (int b = 0; b < NUM_BINS; b++) {
+    histogram[b] = this->histogram[b];
+    total += histogram[b];
+  }
+  if (total < WINDOW / 2) {
+    return;
+  }
+
+  // Seed the outer clusters from the 2nd/98th percentile: zeros make up about
+  // half and markers about a tenth of every frame, so both land inside their
+  // cluster however far the input is skewed
+  uint32_t low_rank = total / 50;
+  uint32_t high_rank = total - total / 50;
+  uint32_t c[3] = {0, 0, 0};
+  uint32_t cumulative = 0;
+  for (int b = 0; b < NUM_BINS; b++) {
+    uint32_t before = cumulative;
+    cumulative += histogram[b];
+    uint32_t width = b * BIN_WIDTH_US + BIN_WIDTH_US / 2;
+    if (before <= low_rank && cumulative > low_rank) c[0] = width;
+    if (before <= high_rank && cumulative > high_rank) c[2] = width;
+  }
+  c[1] = (c[0] + c[2]) / 2;
+
+  // Weighted 1-D k-means over the histogram
+  uint32_t weight[3] = {0, 0, 0};
+  for (uint8_t iter = 0; iter < KMEANS_ITERATIONS; iter++) {
+    uint64_t sum[3] = {0, 0, 0};
+    weight[0] = weight[1] = weight[2] = 0;
+    for (int b = 0; b < NUM_BINS; b++) {
+      if (histogram[b] == 0) continue;
+      uint32_t width = b * BIN_WIDTH_US + BIN_WIDTH_US / 2;
+      uint8_t k = nearestCluster(width, c);
+      sum[k] += (uint64_t)width * histogram[b];
+      weight[k] += histogram[b];
+    }
+    bool changed = false;
+    for (int k = 0; k < 3; k++) {
+      if (weight[k] == 0) continue;
+      uint32_t next = (uint32_t)(sum[k] / weight[k]);
+      if (next != c[k]) {
+        c[k] = next;
+        changed = true;
+      }
+    }
+    if (!changed) break;
+  }
+
+  // The three clusters must exist, be ordered and be roughly equally spaced
+  // (2/5/8 ms -> marker-zero spacing is twice the one-zero spacing). A constant
+  // skew from slow edges or level shifting keeps that ratio intact.
+  bool plausible = weight[0] > 0 && weight[1] > 0 && weight[2] > 0 &&
+                   c[1] > c[0] + MIN_CLUSTER_SPACING_US &&
+                   c[2] > c[1] + MIN_CLUSTER_SPACING_US;
+  uint8_t confidence = 0;
+  if (plausible) {
+    uint32_t ratio = (c[2] - c[0]) * 10 / (c[1] - c[0]);
+    plausible = ratio >= 16 && ratio <= 24;
+  }
+  if (plausible) {
+    uint32_t spacing_a = c[1] - c[0];
+    uint32_t spacing_b = c[2] - c[1];
+    uint32_t tolerance = (spacing_a < spacing_b ? spacing_a : spacing_b) / 4;
+    uint32_t in_cluster = 0;
+    for (int b = 0; b < NUM_BINS; b++) {
+      if (histogram[b] == 0) continue;
+      uint32_t width = b * BIN_WIDTH_US + BIN_WIDTH_US / 2;
+      uint32_t center_k = c[nearestCluster(width, c)];
+      uint32_t dist = width > center_k ? width - center_k : center_k - width;
+      if (dist <= tolerance) {
+        in_cluster += histogram[b];
+      }
+    }
+    confidence = (uint8_t)((uint64_t)in_cluster * 100 / total);
+  }
+  confidence_pct = confidence;
+
+  if (plausible && confidence >= LOCK_CONFIDENCE) {
+    applyCenters(c, true);
+  } else if (locked() && confidence < LOCK_CONFIDENCE / 2) {
+    // Input changed beyond recognition, start over from the nominal windows
+    setNominal();
+  }
+
+  // Age the histogram so it follows slow drifts of the input
+  for (int b = 0; b < NUM_BINS; b++) {
+    this->histogram[b] = this->histogram[b] >> 1;
+  }
+}
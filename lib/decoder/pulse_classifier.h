@@ -0,0 +1,88 @@
+#ifndef PULSE_CLASSIFIER_H
+#define PULSE_CLASSIFIER_H
+
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host
+// and fed synthetic pulse streams.
+
+enum class PulseSymbol : uint8_t {
+  ZERO = 0,     // ~2 ms pulse
+  ONE = 1,      // ~5 ms pulse
+  MARKER = 2,   // ~8 ms pulse
+  INVALID = 3   // Outside every cluster
+};
+
+// Adaptive IRIG-B pulse width classifier.
+// Keeps a decaying histogram of measured pulse widths, runs a 3-cluster
+// k-means over it every WINDOW pulses and derives the 0/1/marker decision
+// thresholds from the cluster centers. Until a plausible clustering has been
+// found the nominal 2/5/8 ms thresholds are used.
+//
+// classify() runs in the edge interrupt and only counts the pulse and
+// compares it against the current thresholds. The k-means runs from a task
+// through update(), which publishes new thresholds by switching between two
+// copies, so the interrupt always sees one consistent set. A pulse counted
+// while the task ages its bin may be lost, which the estimate never notices.
+class PulseClassifier {
+public:
+  static const uint16_t BIN_WIDTH_US = 100;
+  static const uint8_t NUM_BINS = 120;          // 0..12 ms
+  static const uint16_t WINDOW = 200;           // Pulses between re-estimations (~2 frames)
+  static const uint32_t MIN_WIDTH_US = 500;     // Shorter pulses are glitches
+  static const uint32_t MAX_WIDTH_US = 11500;   // Longer pulses are a stuck line
+  static const uint8_t LOCK_CONFIDENCE = 60;    // Percent
+
+  PulseClassifier();
+
+  // Forget everything and go back to the nominal thresholds
+  void reset();
+
+  // Classify one measured high time and add it to the histogram (interrupt)
+  PulseSymbol classify(uint32_t width_us);
+
+  // From a task: re-estimate once WINDOW pulses came in since the last
+  // time, returns true when it did
+  bool update();
+
+  // Re-estimate the clusters from the histogram now (task)
+  void recompute();
+
+  // Cluster center (0 = zero, 1 = one, 2 = marker) in microseconds
+  uint32_t center(uint8_t cluster) const { return cluster < 3 ? limits[active].centers[cluster] : 0; }
+
+  // Decision threshold (0 = zero/one, 1 = one/marker) in microseconds
+  uint32_t threshold(uint8_t index) const { return index < 2 ? limits[active].thresholds[index] : 0; }
+
+  // Share of recent pulses that sit close to a cluster center, 0-100
+  uint8_t confidence() const { return confidence_pct; }
+
+  // True once the adaptive thresholds are in use
+  bool locked() const { return limits[active].adapted; }
+
+  // Pulses rejected as out of range since reset
+  uint32_t rejected() const { return rejected_count; }
+
+private:
+  // What classify() decides with, published as a whole
+  struct Limits {
+    uint32_t centers[3];
+    uint32_t thresholds[2];
+    uint32_t lower;
+    uint32_t upper;
+    bool adapted;
+  };
+
+  volatile uint16_t histogram[NUM_BINS];
+  Limits limits[2];
+  volatile uint8_t active;             // Copy in use by classify()
+  volatile uint32_t pulses;            // Counted by classify()
+  uint32_t pulses_at_update;           // Owned by the task
+  volatile uint32_t rejected_count;
+  uint8_t confidence_pct;
+
+  void setNominal();
+  void applyCenters(const uint32_t* c, bool adapted);
+};
+
+#endif // PULSE_CLASSIFIER_H
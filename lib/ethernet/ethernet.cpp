@@ -14,6 +14,9 @@
 #include <ETH.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include "settings_schema.h"
+#include "change_bus.h"
+#include "task_config.h"
 
 // Ethernet handle
 static esp_eth_handle_t eth_handle = NULL;
@@ -129,6 +132,9 @@ bool eth_init() {
 
     // Configure MAC and PHY
     eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    // The W5500 receive task stays on the core installing it, the network
+    // core (task_config.h), with the INT pin interrupt and lwIP
+    mac_config.flags |= ETH_MAC_FLAG_PIN_TO_CORE;
     eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
     phy_config.reset_gpio_num = -1;  // We already did hardware reset
 
@@ -221,27 +227,28 @@ bool eth_static(IPAddress ip, IPAddress mask, IPAddress gateway, IPAddress dns)
 
 bool eth_configure_network(Settings* settings) {
     Serial.println("Configuring network using settings...");
+    SettingsSnapshot config = settings->get();
 
-    if (settings->network.dhcp) {
+    if (config->network.dhcp) {
         Serial.println("Using DHCP configuration");
         return eth_dhcp();
     } else {
         Serial.println("Using static IP configuration");
         IPAddress ip, mask, gateway, dns;
 
-        if (!ip.fromString(settings->network.ip)) {
+        if (!ip.fromString(config->network.ip)) {
             Serial.println("[ETH] Invalid IP address format");
             return false;
         }
-        if (!mask.fromString(settings->network.subnet)) {
+        if (!mask.fromString(config->network.subnet)) {
             Serial.println("[ETH] Invalid subnet mask format");
             return false;
         }
-        if (!gateway.fromString(settings->network.gateway)) {
+        if (!gateway.fromString(config->network.gateway)) {
             Serial.println("[ETH] Invalid gateway address format");
             return false;
         }
-        if (!dns.fromString(settings->network.dns)) {
+        if (!dns.fromString(config->network.dns)) {
             Serial.println("[ETH] Invalid DNS server address format");
             return false;
         }
@@ -251,54 +258,51 @@ bool eth_configure_network(Settings* settings) {
 }
 
 // Helper function to check if network settings have changed
-static bool eth_network_settings_changed(Settings* settings) {
-    return (_current_network_config.dhcp != settings->network.dhcp ||
-            _current_network_config.ip != settings->network.ip ||
-            _current_network_config.subnet != settings->network.subnet ||
-            _current_network_config.gateway != settings->network.gateway ||
-            _current_network_config.dns != settings->network.dns);
+static bool eth_network_settings_changed(const SettingsData& config) {
+    return (_current_network_config.dhcp != config.network.dhcp ||
+            _current_network_config.ip != config.network.ip ||
+            _current_network_config.subnet != config.network.subnet ||
+            _current_network_config.gateway != config.network.gateway ||
+            _current_network_config.dns != config.network.dns);
 }
 
 // Helper function to update current network config tracking
-static void eth_update_current_config(Settings* settings) {
-    _current_network_config.dhcp = settings->network.dhcp;
-    _current_network_config.ip = settings->network.ip;
-    _current_network_config.subnet = settings->network.subnet;
-    _current_network_config.gateway = settings->network.gateway;
-    _current_network_config.dns = settings->network.dns;
+static void eth_update_current_config(const SettingsData& config) {
+    _current_network_config.dhcp = config.network.dhcp;
+    _current_network_config.ip = config.network.ip;
+    _current_network_config.subnet = config.network.subnet;
+    _current_network_config.gateway = config.network.gateway;
+    _current_network_config.dns = config.network.dns;
 }
 
 // Ethernet monitoring task function
 static void eth_monitor_task(void *parameter) {
     Settings* settings = (Settings*)parameter;
-    TickType_t last_wake_time = xTaskGetTickCount();
 
     Serial.println("Ethernet monitoring task started");
     bool reload_settings = false;
+    int subscriber = settings_changes.subscribe("eth_monitor", settings_fields_mask(SETTINGS_CHANGE_NETWORK));
     
     while (_eth_monitor_running) {
-        // Check for network configuration changes via flag
-        if (settings->getNetworkChangesFlag() || reload_settings) {
-            Serial.println("Network changes flag detected, reloading settings...");
+        // Wakes as soon as network settings change, otherwise once a second
+        // to service the module reset request
+        ChangeMask changed = settings_changes.wait(subscriber, 1000);
+        if (changed || reload_settings) {
+            Serial.println("Network settings changed, checking settings...");
             reload_settings = false;
             
-            if (settings->load()) {
-                if (eth_network_settings_changed(settings)) {
-                    Serial.println("Network configuration changed, reconfiguring...");
-                    eth_update_current_config(settings);
-
-                    if (!eth_configure_network(settings)) {
-                        Serial.println("Failed to reconfigure network with new settings");
-                    }
-                } else {
-                    Serial.println("Network changes flag was set but no actual changes detected");
+            // The published snapshot already holds the new values, no flash read
+            SettingsSnapshot config = settings->get();
+            if (eth_network_settings_changed(*config)) {
+                Serial.println("Network configuration changed, reconfiguring...");
+                eth_update_current_config(*config);
+
+                if (!eth_configure_network(settings)) {
+                    Serial.println("Failed to reconfigure network with new settings");
                 }
             } else {
-                Serial.println("Failed to reload settings");
+                Serial.println("Network settings unchanged from the running configuration");
             }
-
-            settings->setNetworkChangesFlag(false);
-            Serial.println("Network changes flag cleared");
         }
         
         if (eth_reinit_flag) {
@@ -319,9 +323,6 @@ static void eth_monitor_task(void *parameter) {
             
             Serial.println("======Restart Ethernet Module END========");
         }
-
-        // Wait for next iteration (100ms)
-        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(100));
     }
 
     Serial.println("Ethernet monitoring task stopped");
@@ -416,16 +417,17 @@ bool eth_start_monitoring(Settings* settings) {
         return true;
     }
 
-    eth_update_current_config(settings);
+    eth_update_current_config(*settings->get());
     _eth_monitor_running = true;
 
-    BaseType_t result = xTaskCreate(
+    BaseType_t result = xTaskCreatePinnedToCore(
         eth_monitor_task,
         "eth_monitor",
         8192,
         settings,
-        1,
-        &_eth_monitor_task_handle
+        TASK_ETH_MONITOR_PRIORITY,
+        &_eth_monitor_task_handle,
+        TASK_CORE_NETWORK
     );
 
     if (result == pdPASS) {
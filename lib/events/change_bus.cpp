@@ -0,0 +1,102 @@
+#include "change_bus.h"
+
+ChangeBus settings_changes;
+
+#ifdef ARDUINO
+
+// Guards the subscriber table of every bus; held only for a few loads and stores
+static portMUX_TYPE _bus_mux = portMUX_INITIALIZER_UNLOCKED;
+
+ChangeBus::ChangeBus() : count(0) {
+}
+
+int ChangeBus::subscribe(const char* name, ChangeMask interest) {
+  int id = -1;
+  portENTER_CRITICAL(&_bus_mux);
+  if (count < CHANGE_BUS_MAX_SUBSCRIBERS) {
+    id = count;
+    subscribers[id].name = name;
+    subscribers[id].interest = interest;
+    subscribers[id].pending = 0;
+    subscribers[id].task = xTaskGetCurrentTaskHandle();
+    count++;
+  }
+  portEXIT_CRITICAL(&_bus_mux);
+  return id;
+}
+
+void ChangeBus::publish(ChangeMask changed) {
+  for (int i = 0; i < CHANGE_BUS_MAX_SUBSCRIBERS; i++) {
+    portENTER_CRITICAL(&_bus_mux);
+    bool notify = i < count && (subscribers[i].interest & changed);
+    if (notify) {
+      subscribers[i].pending |= subscribers[i].interest & changed;
+    }
+    TaskHandle_t task = notify ? subscribers[i].task : nullptr;
+    portEXIT_CRITICAL(&_bus_mux);
+    if (task) {
+      xTaskNotifyGive(task);
+    }
+  }
+}
+
+ChangeMask ChangeBus::wait(int id, uint32_t timeout_ms) {
+  if (id < 0 || id >= count) {
+    delay(timeout_ms);
+    return 0;
+  }
+  // Changes are recorded before the notification, so a notification taken
+  // by another bus's wait never hides them
+  portENTER_CRITICAL(&_bus_mux);
+  ChangeMask changes = subscribers[id].pending;
+  portEXIT_CRITICAL(&_bus_mux);
+  if (!changes) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+  }
+  portENTER_CRITICAL(&_bus_mux);
+  changes = subscribers[id].pending;
+  subscribers[id].pending = 0;
+  portEXIT_CRITICAL(&_bus_mux);
+  return changes;
+}
+
+#else
+
+#include <chrono>
+
+ChangeBus::ChangeBus() : count(0) {
+}
+
+int ChangeBus::subscribe(const char* name, ChangeMask interest) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (count >= CHANGE_BUS_MAX_SUBSCRIBERS) {
+    return -1;
+  }
+  subscribers[count].name = name;
+  subscribers[count].interest = interest;
+  subscribers[count].pending = 0;
+  return count++;
+}
+
+void ChangeBus::publish(ChangeMask changed) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (int i = 0; i < count; i++) {
+      subscribers[i].pending |= subscribers[i].interest & changed;
+    }
+  }
+  signal.notify_all();
+}
+
+ChangeMask ChangeBus::wait(int id, uint32_t timeout_ms) {
+  std::unique_lock<std::mutex> guard(lock);
+  if (id < 0 || id >= count) {
+    return 0;
+  }
+  signal.wait_for(guard, std::chrono::milliseconds(timeout_ms), [&] { return subscribers[id].pending != 0; });
+  ChangeMask changes = subscribers[id].pending;
+  subscribers[id].pending = 0;
+  return changes;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CHANGE_BUS_H
+#define CHANGE_BUS_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+// Settings change notifications. The web server publishes which settings
+// fields changed (bit n = SETTINGS_FIELDS[n]) after a save; every subscriber
+// whose interest mask overlaps is woken at once and receives exactly those
+// bits. Changes that arrive while a subscriber is busy are merged, never
+// lost, and publishing never blocks.
+//
+// On the device a subscriber is woken through the task notification of the
+// task that subscribed. The SecondBus wakes tasks the same way, so a task
+// subscribed to both blocks on one and picks up the other with a zero
+// timeout. On the host (no Arduino) a mutex and condition variable stand
+// in, so the delivery logic can be exercised in host tests.
+
+typedef uint64_t ChangeMask;
+
+#define CHANGE_BUS_MAX_SUBSCRIBERS 8
+
+class ChangeBus {
+public:
+  ChangeBus();
+
+  // Register the calling task for the fields in 'interest'. Returns the
+  // subscriber id, or -1 when CHANGE_BUS_MAX_SUBSCRIBERS are already
+  // registered.
+  int subscribe(const char* name, ChangeMask interest);
+
+  // Notify the subscribers interested in any of 'changed'
+  void publish(ChangeMask changed);
+
+  // Block up to timeout_ms for changes; returns the fields changed since the
+  // last call (only those in the subscriber's interest), 0 on timeout or
+  // when the task was woken for something else
+  ChangeMask wait(int id, uint32_t timeout_ms);
+
+private:
+  struct Subscriber {
+    const char* name;
+    ChangeMask interest;
+    ChangeMask pending;
+#ifdef ARDUINO
+    TaskHandle_t task;    // Notified on every publish
+#endif
+  };
+
+  Subscriber subscribers[CHANGE_BUS_MAX_SUBSCRIBERS];
+  int count;
+
+#ifndef ARDUINO
+  std::mutex lock;
+  std::condition_variable signal;
+#endif
+};
+
+// The bus for Settings changes
+extern ChangeBus settings_changes;
+
+#endif // CHANGE_BUS_H
@@ -0,0 +1,59 @@
+// Device only, the native tests build the rest of this library
+#ifdef ARDUINO
+
+#include "second_bus.h"
+
+SecondBus second_events;
+
+// Guards the subscriber table, also taken by the output interrupt
+static portMUX_TYPE _second_mux = portMUX_INITIALIZER_UNLOCKED;
+
+SecondBus::SecondBus() : count(0) {
+}
+
+int SecondBus::subscribe(const char* name) {
+  int id = -1;
+  portENTER_CRITICAL(&_second_mux);
+  if (count < SECOND_BUS_MAX_SUBSCRIBERS) {
+    id = count;
+    subscribers[id].name = name;
+    subscribers[id].task = xTaskGetCurrentTaskHandle();
+    subscribers[id].pending = 0;
+    count++;
+  }
+  portEXIT_CRITICAL(&_second_mux);
+  return id;
+}
+
+void IRAM_ATTR SecondBus::publishFromISR(BaseType_t* woken) {
+  portENTER_CRITICAL_ISR(&_second_mux);
+  int subscribed = count;
+  for (int i = 0; i < subscribed; i++) {
+    subscribers[i].pending++;
+  }
+  portEXIT_CRITICAL_ISR(&_second_mux);
+  for (int i = 0; i < subscribed; i++) {
+    vTaskNotifyGiveFromISR(subscribers[i].task, woken);
+  }
+}
+
+uint32_t SecondBus::wait(int id, uint32_t timeout_ms) {
+  if (id < 0 || id >= count) {
+    delay(timeout_ms);
+    return 0;
+  }
+  // As in ChangeBus::wait, the count is raised before the notification
+  portENTER_CRITICAL(&_second_mux);
+  uint32_t boundaries = subscribers[id].pending;
+  portEXIT_CRITICAL(&_second_mux);
+  if (!boundaries) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+  }
+  portENTER_CRITICAL(&_second_mux);
+  boundaries = subscribers[id].pending;
+  subscribers[id].pending = 0;
+  portEXIT_CRITICAL(&_second_mux);
+  return boundaries;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,48 @@
+#ifndef SECOND_BUS_H
+#define SECOND_BUS_H
+
+#include <Arduino.h>
+
+// Second boundaries of the outputs. The output interrupt publishes every
+// frame start, so the display, the web pushes and the encode-ahead of the
+// next frame run right when a second begins instead of polling for it.
+//
+// A subscriber is woken through the task notification of the task that
+// subscribed, like the settings ChangeBus: a task subscribed to both blocks
+// here and checks for settings changes with a zero timeout afterwards.
+
+#define SECOND_BUS_MAX_SUBSCRIBERS 8
+
+class SecondBus {
+public:
+  SecondBus();
+
+  // Register the calling task. Returns the subscriber id, or -1 when
+  // SECOND_BUS_MAX_SUBSCRIBERS are already registered.
+  int subscribe(const char* name);
+
+  // From the output interrupt when a frame starts, after the timebase has
+  // counted it; 'woken' is set when a subscriber should run at the end of
+  // the interrupt
+  void IRAM_ATTR publishFromISR(BaseType_t* woken);
+
+  // Block up to timeout_ms for a second boundary. Returns the boundaries
+  // since the last call, 0 on timeout or when the task was woken for
+  // something else (a settings change).
+  uint32_t wait(int id, uint32_t timeout_ms);
+
+private:
+  struct Subscriber {
+    const char* name;
+    TaskHandle_t task;
+    uint32_t pending;
+  };
+
+  Subscriber subscribers[SECOND_BUS_MAX_SUBSCRIBERS];
+  volatile int count;
+};
+
+// The bus for output frame starts
+extern SecondBus second_events;
+
+#endif // SECOND_BUS_H
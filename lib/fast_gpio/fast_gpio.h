@@ -0,0 +1,27 @@
+#ifndef FAST_GPIO_H
+#define FAST_GPIO_H
+
+#include <Arduino.h>
+#include <soc/gpio_struct.h>
+
+// Output pin writes for the interrupt handlers. digitalWrite() runs from
+// flash, which stalls while the flash cache is off for an NVS write; these
+// write the set/clear registers directly and are always inlined, so the
+// handlers keep running. The pin is set up with pinMode() beforehand.
+__attribute__((always_inline)) inline void fast_gpio_write(uint8_t pin, bool level) {
+  if (pin < 32) {
+    if (level) {
+      GPIO.out_w1ts = 1UL << pin;
+    } else {
+      GPIO.out_w1tc = 1UL << pin;
+    }
+  } else {
+    if (level) {
+      GPIO.out1_w1ts.val = 1UL << (pin - 32);
+    } else {
+      GPIO.out1_w1tc.val = 1UL << (pin - 32);
+    }
+  }
+}
+
+#endif // FAST_GPIO_H
@@ -0,0 +1,56 @@
+#include "irig_am.h"
+#include <math.h>
+#include <string.h>
+
+IrigAmSynth::IrigAmSynth(uint32_t sample_rate, int16_t amplitude) : frame_samples(0), rendered(0) {
+  uint32_t samples = sample_rate / IRIG_AM_CARRIER_HZ;
+  if (samples < 4) samples = 4;
+  if (samples > IRIG_AM_MAX_SAMPLES_PER_CYCLE) samples = IRIG_AM_MAX_SAMPLES_PER_CYCLE;
+  cycle_samples = samples;
+  this->sample_rate = samples * IRIG_AM_CARRIER_HZ;
+
+  // One carrier cycle from its positive going zero crossing
+  for (uint16_t i = 0; i < cycle_samples; i++) {
+    double carrier = sin(2.0 * M_PI * i / cycle_samples);
+    mark[i] = (int16_t)lround(amplitude * carrier);
+    space[i] = (int16_t)lround(amplitude * carrier * IRIG_AM_SPACE_NUMERATOR / IRIG_AM_SPACE_DENOMINATOR);
+  }
+  memset(mark_cycles, 0, sizeof(mark_cycles));
+}
+
+void IrigAmSynth::beginFrame(const bool* bits, int32_t adjust) {
+  // Same element widths as the DC level shift outputs
+  for (int i = 0; i < IRIG_FRAME_BITS; i++) {
+    bool marker = (i % 10 == 0) || (i == 1);
+    mark_cycles[i] = marker ? 8 : (bits[i] ? 5 : 2);
+  }
+  int32_t samples = (int32_t)nominalFrameSamples() + adjust;
+  frame_samples = samples > 0 ? samples : 0;
+  rendered = 0;
+}
+
+size_t IrigAmSynth::render(int16_t* out, size_t count) {
+  const uint32_t nominal = nominalFrameSamples();
+  size_t written = 0;
+  while (written < count && rendered < frame_samples) {
+    size_t n;
+    if (rendered >= nominal) {
+      // Appended samples: the carrier waits at its zero crossing
+      n = frame_samples - rendered;
+      if (n > count - written) n = count - written;
+      memset(out + written, 0, n * sizeof(int16_t));
+    } else {
+      uint32_t cycle = rendered / cycle_samples;
+      uint16_t phase = rendered % cycle_samples;
+      const int16_t* table = cycle % IRIG_AM_CYCLES_PER_ELEMENT < mark_cycles[cycle / IRIG_AM_CYCLES_PER_ELEMENT] ? mark : space;
+      // Rest of this cycle, cut short by the block or a shortened frame
+      n = cycle_samples - phase;
+      if (n > count - written) n = count - written;
+      if (n > frame_samples - rendered) n = frame_samples - rendered;
+      memcpy(out + written, table + phase, n * sizeof(int16_t));
+    }
+    written += n;
+    rendered += n;
+  }
+  return written;
+}
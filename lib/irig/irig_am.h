@@ -0,0 +1,58 @@
+#ifndef IRIG_AM_H
+#define IRIG_AM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "irig_encoder.h"
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// IRIG-B12x sample synthesis. A frame from irig_encode_frame is sent on a
+// 1 kHz carrier: every element is 10 carrier cycles starting on a positive
+// going zero crossing, at mark amplitude for the pulse width (2, 5 or 8 ms)
+// and at 3/10 of it for the rest. Rendering copies whole cycles out of two
+// precomputed tables, so blocks of any size can be produced for DMA.
+
+#define IRIG_AM_CARRIER_HZ 1000
+#define IRIG_AM_CYCLES_PER_ELEMENT 10
+#define IRIG_AM_MAX_SAMPLES_PER_CYCLE 96   // 96 kHz sample rate
+
+// Mark to space amplitude ratio 10:3
+#define IRIG_AM_SPACE_NUMERATOR 3
+#define IRIG_AM_SPACE_DENOMINATOR 10
+
+class IrigAmSynth {
+public:
+  // 'sample_rate' a multiple of 1 kHz up to 96 kHz, 'amplitude' the mark peak
+  IrigAmSynth(uint32_t sample_rate, int16_t amplitude);
+
+  // Start a frame of bits[IRIG_FRAME_BITS]. 'adjust' samples of silence are
+  // appended (positive) or samples dropped (negative) at the end of the frame
+  // to keep it in step with the second.
+  void beginFrame(const bool* bits, int32_t adjust);
+
+  // Write up to 'count' samples of the frame, returns how many; 0 once it is complete
+  size_t render(int16_t* out, size_t count);
+
+  // Samples of the frame rendered so far
+  uint32_t position() const { return rendered; }
+
+  uint32_t sampleRate() const { return sample_rate; }
+  uint16_t samplesPerCycle() const { return cycle_samples; }
+
+  // Samples in a frame without adjustment
+  uint32_t nominalFrameSamples() const {
+    return (uint32_t)cycle_samples * IRIG_AM_CYCLES_PER_ELEMENT * IRIG_FRAME_BITS;
+  }
+
+private:
+  uint32_t sample_rate;
+  uint16_t cycle_samples;
+  int16_t mark[IRIG_AM_MAX_SAMPLES_PER_CYCLE];
+  int16_t space[IRIG_AM_MAX_SAMPLES_PER_CYCLE];
+  uint8_t mark_cycles[IRIG_FRAME_BITS];   // Carrier cycles at mark amplitude per element
+  uint32_t frame_samples;
+  uint32_t rendered;
+};
+
+#endif // IRIG_AM_H
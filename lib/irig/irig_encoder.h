@@ -0,0 +1,198 @@
+#ifndef IRIG_ENCODER_H
+#define IRIG_ENCODER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "irig_format.h"
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// IRIG-B time structure
+struct IrigTime {
+  uint8_t second;   // 0-59
+  uint8_t minute;   // 0-59
+  uint8_t hour;     // 0-23
+  uint16_t day;     // 1-366
+  uint16_t year;    // 2 or 4 digits, the frame carries year % 100
+};
+
+enum class TimeQuality : uint8_t {
+    LOCKED_TO_UTC = 0,     // Clock is locked to a UTC traceable source
+    WITHIN_1_NS = 1,       // Time is within < 1 ns of UTC
+    WITHIN_10_NS = 2,      // Time is within < 10 ns of UTC
+    WITHIN_100_NS = 3,     // Time is within < 100 ns of UTC
+    WITHIN_1_US = 4,       // Time is within < 1 μs of UTC
+    WITHIN_10_US = 5,      // Time is within < 10 μs of UTC
+    WITHIN_100_US = 6,     // Time is within < 100 μs of UTC
+    WITHIN_1_MS = 7,       // Time is within < 1 ms of UTC
+    WITHIN_10_MS = 8,      // Time is within < 10 ms of UTC
+    WITHIN_100_MS = 9,     // Time is within < 100 ms of UTC
+    WITHIN_1_S = 10,       // Time is within < 1 s of UTC
+    WITHIN_10_S = 11,      // Time is within < 10 s of UTC
+    FAULT = 15             // Clock failure, time is not reliable
+};
+
+enum class ContinuousTimeQuality : uint8_t {
+    NOT_USED = 0,          // Indicates code from previous version of standard
+    ERROR_LT_100_NS = 1,   // Estimated maximum time error < 100 ns
+    ERROR_LT_1_US = 2,     // Estimated maximum time error < 1 μs
+    ERROR_LT_10_US = 3,    // Estimated maximum time error < 10 μs
+    ERROR_LT_100_US = 4,   // Estimated maximum time error < 100 μs
+    ERROR_LT_1_MS = 5,     // Estimated maximum time error < 1 ms
+    ERROR_LT_10_MS = 6,    // Estimated maximum time error < 10 ms
+    ERROR_GT_10_MS = 7     // Estimated maximum time error > 10 ms or unknown
+};
+
+
+// Which coded expressions a format carries and what its control function
+// field holds. Everything is a compile-time constant, so every format gets
+// its own encoder with the unused fields folded away.
+enum class IrigExtension : uint8_t {
+  NONE,        // Control function field sent as zeros
+  IEEE_1344,   // Leap second, DST, time offset, time quality and parity
+  C37_118      // IEEE 1344 plus continuous time quality
+};
+
+// Only the extensions give the control functions a meaning; without one
+// the field is all zeros, which is also what a format without it sends.
+// Formats that differ only in carrying the field (B000/B003, B001/B002,
+// B004/B007, B005/B006) therefore share a policy and an encoder.
+template <bool Year, bool Sbs, IrigExtension Extension = IrigExtension::NONE>
+struct IrigFormatPolicy {
+  static const bool bcd_year = Year;
+  static const bool sbs = Sbs;
+  static const IrigExtension extension = Extension;
+
+  static_assert(Extension == IrigExtension::NONE || Year,
+                "The IEEE 1344 extensions follow the year in the control function field");
+};
+
+typedef IrigFormatPolicy<false, true> IrigB000;
+typedef IrigFormatPolicy<false, false> IrigB001;
+typedef IrigFormatPolicy<false, false> IrigB002;
+typedef IrigFormatPolicy<false, true> IrigB003;
+typedef IrigFormatPolicy<true, true> IrigB004;
+typedef IrigFormatPolicy<true, false> IrigB005;
+typedef IrigFormatPolicy<true, false> IrigB006;
+typedef IrigFormatPolicy<true, true> IrigB007;
+typedef IrigFormatPolicy<true, true, IrigExtension::IEEE_1344> IrigIeee1344;
+typedef IrigFormatPolicy<true, true, IrigExtension::C37_118> IrigC37118;
+
+// Frame element n of IRIG 200 is bits[n + 1]; bits[0] is the P0 marker that
+// ends the previous frame and bits[1] the reference marker.
+#define IRIG_FRAME_BITS 100
+
+// 'count' bits of 'value', least significant first
+inline void irig_put_bits(bool* bits, int first, uint32_t value, int count) {
+  for (int i = 0; i < count; i++) {
+    bits[first + i] = (value >> i) & 1;
+  }
+}
+
+// Step a time of day to the next second, carrying into the day of year and
+// the year (kept in the 2 or 4 digit form it has). Cheap enough for an
+// interrupt, unlike a round trip through seconds since an epoch, and always
+// inlined so it runs from wherever the caller does (IRAM).
+__attribute__((always_inline)) inline void irig_time_next_second(IrigTime& time) {
+  if (++time.second < 60) return;
+  time.second = 0;
+  if (++time.minute < 60) return;
+  time.minute = 0;
+  if (++time.hour < 24) return;
+  time.hour = 0;
+  uint16_t year = time.year < 100 ? 2000 + time.year : time.year;
+  bool leap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+  if (++time.day <= (leap ? 366 : 365)) return;
+  time.day = 1;
+  time.year = time.year < 100 ? (time.year + 1) % 100 : time.year + 1;
+}
+
+// Encode one frame of 'Format' into bits[IRIG_FRAME_BITS]. Returns false,
+// with only the markers set, for a time of day out of range.
+template <typename Format>
+bool irig_encode_frame(const IrigTime& time, int offset_hours, TimeQuality tq, ContinuousTimeQuality ctq, bool* bits) {
+  for (int i = 0; i < IRIG_FRAME_BITS; i++) {
+    bits[i] = false;
+  }
+
+  // Position identifiers and reference marker
+  for (int i = 0; i < 10; i++) {
+    bits[i * 10] = true;
+  }
+  bits[1] = true;
+
+  uint32_t straight_binary_second = time.hour * 3600UL + time.minute * 60UL + time.second;
+  if (straight_binary_second > 86399) {
+    return false;
+  }
+
+  // BCD time of year: seconds, minutes, hours, day of year
+  irig_put_bits(bits, 2, time.second % 10, 4);
+  irig_put_bits(bits, 7, time.second / 10, 3);
+  irig_put_bits(bits, 11, time.minute % 10, 4);
+  irig_put_bits(bits, 16, time.minute / 10, 3);
+  irig_put_bits(bits, 21, time.hour % 10, 4);
+  irig_put_bits(bits, 26, time.hour / 10, 2);
+  irig_put_bits(bits, 31, time.day % 10, 4);
+  irig_put_bits(bits, 36, (time.day / 10) % 10, 4);
+  irig_put_bits(bits, 41, time.day / 100, 2);
+
+  if (Format::bcd_year) {
+    uint8_t year = time.year % 100;
+    irig_put_bits(bits, 51, year % 10, 4);
+    irig_put_bits(bits, 56, year / 10, 4);
+  }
+
+  if (Format::extension != IrigExtension::NONE) {
+    // Leap second pending, leap second, DST pending and DST (61-64) stay 0
+    irig_put_bits(bits, 65, offset_hours < 0, 1);
+    irig_put_bits(bits, 66, abs(offset_hours), 4);
+    // No half hour offset (71)
+    irig_put_bits(bits, 72, static_cast<uint8_t>(tq), 4);
+    if (Format::extension == IrigExtension::C37_118) {
+      irig_put_bits(bits, 77, static_cast<uint8_t>(ctq), 3);
+    }
+
+    // Even parity over the data elements up to the time quality: the ones
+    // in 2-76 add up to an even count
+    int count = 0;
+    for (int i = 2; i <= 75; i++) {
+      if (i % 10 != 0) {
+        count += bits[i];
+      }
+    }
+    bits[76] = count % 2;
+  }
+
+  if (Format::sbs) {
+    irig_put_bits(bits, 81, straight_binary_second, 9);
+    irig_put_bits(bits, 91, straight_binary_second >> 9, 8);
+  }
+  return true;
+}
+
+typedef bool (*IrigFrameEncoder)(const IrigTime& time, int offset_hours, TimeQuality tq,
+                                 ContinuousTimeQuality ctq, bool* bits);
+
+// Encoder of a format chosen at run time; unknown values get the default
+inline IrigFrameEncoder irig_frame_encoder(IrigFormat format) {
+  static const IrigFrameEncoder ENCODERS[IRIG_FORMAT_COUNT] = {
+    irig_encode_frame<IrigB000>, irig_encode_frame<IrigB001>,
+    irig_encode_frame<IrigB002>, irig_encode_frame<IrigB003>,
+    irig_encode_frame<IrigB004>, irig_encode_frame<IrigB005>,
+    irig_encode_frame<IrigB006>, irig_encode_frame<IrigB007>,
+    irig_encode_frame<IrigIeee1344>, irig_encode_frame<IrigC37118>
+  };
+  uint8_t index = static_cast<uint8_t>(format);
+  return ENCODERS[index < IRIG_FORMAT_COUNT ? index : static_cast<uint8_t>(IRIG_FORMAT_DEFAULT)];
+}
+
+inline const char* irig_format_name(IrigFormat format) {
+  static const char* const NAMES[IRIG_FORMAT_COUNT] = {
+    "B000", "B001", "B002", "B003", "B004", "B005", "B006", "B007", "IEEE 1344", "C37.118"
+  };
+  uint8_t index = static_cast<uint8_t>(format);
+  return index < IRIG_FORMAT_COUNT ? NAMES[index] : "?";
+}
+
+#endif // IRIG_ENCODER_H
@@ -0,0 +1,36 @@
+#ifndef IRIG_FORMAT_H
+#define IRIG_FORMAT_H
+
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// IRIG-B outputs on the board (P1..P8)
+#define IRIG_CHANNELS 8
+
+// Largest per-channel advance for cable delay compensation, well inside the
+// 2 ms between the edges of an element
+#define IRIG_ADVANCE_MAX_US 1000
+
+// IRIG-B DC level shift formats (IRIG 200). The last digit selects which
+// coded expressions the frame carries; the others are sent as zeros. The
+// IEEE variants are B004 with the control functions filled in.
+enum class IrigFormat : uint8_t {
+  B000 = 0,   // BCD_TOY, CF, SBS
+  B001 = 1,   // BCD_TOY, CF
+  B002 = 2,   // BCD_TOY
+  B003 = 3,   // BCD_TOY, SBS
+  B004 = 4,   // BCD_TOY, BCD_YEAR, CF, SBS
+  B005 = 5,   // BCD_TOY, BCD_YEAR, CF
+  B006 = 6,   // BCD_TOY, BCD_YEAR
+  B007 = 7,   // BCD_TOY, BCD_YEAR, SBS
+  IEEE_1344 = 8,
+  C37_118 = 9   // IEEE 1344 plus continuous time quality
+};
+
+#define IRIG_FORMAT_COUNT 10
+
+// The layout produced before the format was selectable per channel
+#define IRIG_FORMAT_DEFAULT IrigFormat::C37_118
+
+#endif // IRIG_FORMAT_H
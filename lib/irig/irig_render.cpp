@@ -0,0 +1,88 @@
+#include "irig_render.h"
+
+static_assert(IRIG_CHANNELS <= 8, "A sample holds one bit per channel");
+static_assert(IRIG_ADVANCE_MAX_US < 2000, "Edges of a channel keep their order within an element");
+
+static uint16_t clampAdvance(uint16_t advance_us) {
+  return advance_us > IRIG_ADVANCE_MAX_US ? IRIG_ADVANCE_MAX_US : advance_us;
+}
+
+void irig_render_frame(const bool* const* frames, uint8_t invert, const uint16_t* advance_us, uint8_t repeat,
+                       uint8_t* out) {
+  // Where each channel is in its frame at the first sample
+  int32_t start_us[IRIG_CHANNELS];
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    start_us[i] = (int32_t)clampAdvance(advance_us[i]) - IRIG_RENDER_LEAD_US;
+  }
+
+  uint32_t samples = (uint32_t)IRIG_FRAME_TICKS * repeat;
+  for (uint32_t n = 0; n < samples; n++) {
+    int32_t time_us = (int32_t)(n * 1000 / repeat);
+    uint8_t levels = 0;
+    for (int i = 0; i < IRIG_CHANNELS; i++) {
+      int32_t at_us = time_us + start_us[i];
+      // Before its frame start a channel is still at the idle level the last frame ended on
+      if (!frames[i] || at_us < 0) {
+        continue;
+      }
+      int32_t tick = at_us / 1000;
+      if (irig_element_level(frames[i], tick / IRIG_TICKS_PER_ELEMENT, tick % IRIG_TICKS_PER_ELEMENT)) {
+        levels |= 1 << i;
+      }
+    }
+    out[n] = levels ^ invert;
+  }
+}
+
+size_t irig_render_edges(const bool* const* frames, uint8_t invert, const uint16_t* advance_us, IrigEdge* out) {
+  // Channels in the order their edges come within each step, most advanced first
+  uint8_t order[IRIG_CHANNELS];
+  uint16_t advance[IRIG_CHANNELS];
+  int channels = 0;
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    if (!frames[i]) {
+      continue;
+    }
+    int j = channels++;
+    for (; j > 0 && advance[j - 1] < clampAdvance(advance_us[i]); j--) {
+      order[j] = order[j - 1];
+      advance[j] = advance[j - 1];
+    }
+    order[j] = i;
+    advance[j] = clampAdvance(advance_us[i]);
+  }
+
+  // Rising edge, then the ends of zero, one and marker pulses
+  static const int EDGE_TICKS[] = {0, 2, 5, 8};
+  uint8_t levels = invert;
+  out[0].offset_us = 0;
+  out[0].levels = levels;
+  size_t count = 1;
+  for (int element = 0; element < IRIG_FRAME_BITS; element++) {
+    for (int tick : EDGE_TICKS) {
+      // Channels with the same advance change together
+      for (int j = 0; j < channels;) {
+        uint16_t group = advance[j];
+        uint8_t next = levels;
+        for (; j < channels && advance[j] == group; j++) {
+          uint8_t bit = 1 << order[j];
+          bool high = irig_element_level(frames[order[j]], element, tick) != ((invert & bit) != 0);
+          next = high ? (next | bit) : (next & ~bit);
+        }
+        if (next == levels) {
+          continue;
+        }
+        uint32_t offset = (element * IRIG_TICKS_PER_ELEMENT + tick) * 1000UL + IRIG_RENDER_LEAD_US - group;
+        if (out[count - 1].offset_us == offset) {
+          out[count - 1].levels = next;
+        } else {
+          out[count].offset_us = offset;
+          out[count].levels = next;
+          count++;
+        }
+        levels = next;
+      }
+    }
+  }
+  return count;
+}
@@ -0,0 +1,59 @@
+#ifndef IRIG_RENDER_H
+#define IRIG_RENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "irig_encoder.h"
+#include "irig_format.h"
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// DC level shift waveform of all channels as a sample stream, for output
+// backends that send whole frames to the pins instead of toggling them from
+// the timer interrupt. Sample n holds the level of channel i in bit i. With
+// no advance, the levels from the frame start on are exactly what
+// IRIGB::update writes on its calls of the frame.
+//
+// Each channel can be advanced by up to IRIG_ADVANCE_MAX_US to make up for
+// its cable delay. A rendered frame therefore begins IRIG_RENDER_LEAD_US
+// before the frame start, so the most advanced channel still has its first
+// edge inside it. The last pulse of a frame ends several ms before the next
+// one begins, so the frames never overlap.
+
+#define IRIG_TICKS_PER_ELEMENT 10
+#define IRIG_FRAME_TICKS (IRIG_FRAME_BITS * IRIG_TICKS_PER_ELEMENT)
+#define IRIG_RENDER_LEAD_US IRIG_ADVANCE_MAX_US
+
+// Level 'tick' ms into element 'element' of an active high output
+inline bool irig_element_level(const bool* bits, int element, int tick) {
+  bool marker = (element % 10 == 0) || (element == 1);
+  int high = marker ? 8 : (bits[element] ? 5 : 2);
+  return tick < high;
+}
+
+// Render one frame of IRIG_CHANNELS outputs into IRIG_FRAME_TICKS * repeat
+// bytes, 'repeat' samples per ms. frames[i] is the frame of channel i, or
+// nullptr for a channel at its idle level; bit i of 'invert' swaps the
+// levels of channel i and advance_us[i] sends it early, in steps of one
+// sample.
+void irig_render_frame(const bool* const* frames, uint8_t invert, const uint16_t* advance_us, uint8_t repeat,
+                       uint8_t* out);
+
+// The same waveform as a list of level changes, for backends that schedule
+// every edge on a timer compare. Levels only change 0, 2, 5 and 8 ms into
+// an element, less each channel's advance, so a frame has at most four
+// edges per element and channel.
+struct IrigEdge {
+  uint32_t offset_us : 24;   // From the start of the rendered frame
+  uint32_t levels : 8;       // Of all channels from here on, bit per channel
+};
+
+#define IRIG_FRAME_EDGES_MAX (1 + IRIG_FRAME_BITS * 4 * IRIG_CHANNELS)
+
+// Render the level changes of one frame (arguments as irig_render_frame)
+// into 'out', which holds IRIG_FRAME_EDGES_MAX. The first edge is always at
+// the start of the rendered frame, even when no level changes there.
+// Returns the count.
+size_t irig_render_edges(const bool* const* frames, uint8_t invert, const uint16_t* advance_us, IrigEdge* out);
+
+#endif // IRIG_RENDER_H
@@ -11,53 +11,56 @@ IRIGB::IRIGB(uint8_t outputPin) : outputPin(outputPin)
   for (int i = 0; i < 100; i++)
   {
     bits[i] = false;
+    bits_0[i] = false;
+    bits_1[i] = false;
+    bits_2[i] = false;
   }
 }
 
 void IRIGB::begin()
 {
   pinMode(outputPin, OUTPUT);
-  digitalWrite(outputPin, LOW);
+  idle();
   enabled_flag = true;
 }
 
 
-bool IRIGB::update()
+bool IRAM_ATTR IRIGB::update()
 {
   bool isMarker = (bit_counter % 10 == 0) || (bit_counter == 1);
-  bool val = use_buffer_0? bits_0[bit_counter]:bits_1[bit_counter];
+  bool val = slots[use_buffer_0 ? 0 : 1][bit_counter];
   if (isMarker)
   {
     if (bit_counter_marker <= 7)
     {
-      digitalWrite(outputPin, HIGH);
+      fast_gpio_write(outputPin, !inverted);
     }
 
     else
     {
-      digitalWrite(outputPin, LOW);
+      fast_gpio_write(outputPin, inverted);
     }
   }
   else if (val)
   {
     if (bit_counter_marker <= 4)
     {
-      digitalWrite(outputPin, HIGH);
+      fast_gpio_write(outputPin, !inverted);
     }
     else
     {
-      digitalWrite(outputPin, LOW);
+      fast_gpio_write(outputPin, inverted);
     }
   }
   else
   {
     if (bit_counter_marker <= 1)
     {
-      digitalWrite(outputPin, HIGH);
+      fast_gpio_write(outputPin, !inverted);
     }
     else
     {
-      digitalWrite(outputPin, LOW);
+      fast_gpio_write(outputPin, inverted);
     }
   }
   bit_counter_marker++;
@@ -68,7 +71,7 @@ bool IRIGB::update()
     if (bit_counter >= 100)
     {
       bit_counter = 0;
-      use_buffer_0=!use_buffer_0;
+      endFrame();
       return true;
     }
   }
@@ -76,6 +79,26 @@ bool IRIGB::update()
 }
 
 
+void IRAM_ATTR IRIGB::endFrame()
+{
+  frames++;
+  if (!next_ready)
+  {
+    underruns++;
+  }
+  next_ready = false;
+  use_buffer_0 = !use_buffer_0;
+}
+
+void IRAM_ATTR IRIGB::resume()
+{
+  // Frame boundary: the counters are at the start of a frame already
+  if (next_ready)
+  {
+    next_ready = false;
+    use_buffer_0 = !use_buffer_0;
+  }
+}
 
 void IRIGB::updateTimeFromEpoch(unsigned long epochTime)
 {
@@ -96,165 +119,66 @@ void IRIGB::convertUnixTimeToIrigTime(unsigned long unixTime, IrigTime &irigTime
   irigTime.year = timeinfo->tm_year % 100; // Get last two digits of year
 }
 
-IrigTime IRIGB::getCurrentTime() const
+static uint16_t days_in_year(uint16_t year)
 {
-  return currentTime;
+  bool leap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+  return leap ? 366 : 365;
 }
 
-void IRIGB::setCurrentTime(const IrigTime &time)
+uint32_t irig_time_to_seconds(const IrigTime &time)
 {
-  currentTime = time;
+  uint16_t year = 2000 + time.year % 100;
+  uint32_t days = 0;
+  for (uint16_t y = 2000; y < year; y++)
+  {
+    days += days_in_year(y);
+  }
+  days += time.day - 1;
+  return days * 86400UL + time.hour * 3600UL + time.minute * 60UL + time.second;
 }
 
-void IRIGB::encodeTimeIntoBits(const IrigTime &time, int timeOffsetHours)
+void irig_time_from_seconds(uint32_t seconds, IrigTime &time)
 {
-  if(use_buffer_0) this->encodeTimeIntoBits(time,this->bits_1, timeOffsetHours);
-  else this->encodeTimeIntoBits(time,this->bits_0, timeOffsetHours);
-
-  //for(int a=0;a<100;a++) bits[a]=use_buffer_0?bits_1[a]:bits_0[a];
+  uint32_t days = seconds / 86400UL;
+  uint32_t rest = seconds % 86400UL;
+  time.hour = rest / 3600;
+  time.minute = (rest / 60) % 60;
+  time.second = rest % 60;
+
+  uint16_t year = 2000;
+  while (days >= days_in_year(year))
+  {
+    days -= days_in_year(year);
+    year++;
+  }
+  time.day = days + 1;
+  time.year = year;
 }
 
-void IRIGB::encodeTimeIntoBits(const IrigTime &time, bool *bits, int timeOffsetHours)
+IrigTime IRIGB::getCurrentTime() const
 {
-  this->encodeTimeIntoBits(time,bits,timeOffsetHours,TimeQuality::WITHIN_1_US,ContinuousTimeQuality::NOT_USED );
+  return currentTime;
 }
 
-
-void IRIGB::encodeTimeIntoBits(const IrigTime &time, bool *bits, int timeOffsetHours, TimeQuality tq, ContinuousTimeQuality ctq)
+void IRIGB::setCurrentTime(const IrigTime &time)
 {
+  currentTime = time;
+}
 
-  // Serial.printf("ENCODE %i\n",outputPin);
-  // Initialize bits
-  for (int i = 0; i < 100; i++) {
-    bits[i] = false;
-  }
-
-  // Calculate Straight Binary Seconds
-  uint32_t straight_binary_second = time.hour * 3600 + time.minute * 60 + time.second;
-  if (straight_binary_second > 86399) {
-    Serial.println("Error: Invalid straight binary seconds");
-    return;
-  }
-
-  // Position reference markers
-  for (int i = 0; i < 10; i++) {
-    bits[i * 10] = true; // PR markers
-  }
-  bits[0] = true; // First PR marker
-  bits[1] = true; // Second PR marker for frame start
-
-  // Encode seconds (BCD) - Bits 2-9
-  bits[2] = (time.second % 10) & 0x01;
-  bits[3] = ((time.second % 10) & 0x02) >> 1;
-  bits[4] = ((time.second % 10) & 0x04) >> 2;
-  bits[5] = ((time.second % 10) & 0x08) >> 3;
-  bits[6] = 0; // Unused
-  bits[7] = (time.second / 10) & 0x01;
-  bits[8] = ((time.second / 10) & 0x02) >> 1;
-  bits[9] = ((time.second / 10) & 0x04) >> 2;
-
-  // Encode minutes (BCD) - Bits 11-19
-  bits[11] = (time.minute % 10) & 0x01;
-  bits[12] = ((time.minute % 10) & 0x02) >> 1;
-  bits[13] = ((time.minute % 10) & 0x04) >> 2;
-  bits[14] = ((time.minute % 10) & 0x08) >> 3;
-  bits[15] = 0; // Unused
-  bits[16] = (time.minute / 10) & 0x01;
-  bits[17] = ((time.minute / 10) & 0x02) >> 1;
-  bits[18] = ((time.minute / 10) & 0x04) >> 2;
-  bits[19] = 0; // Unused
-
-  // Encode hours (BCD) - Bits 21-29
-  bits[21] = (time.hour % 10) & 0x01;
-  bits[22] = ((time.hour % 10) & 0x02) >> 1;
-  bits[23] = ((time.hour % 10) & 0x04) >> 2;
-  bits[24] = ((time.hour % 10) & 0x08) >> 3;
-  bits[25] = 0; // Unused
-  bits[26] = (time.hour / 10) & 0x01;
-  bits[27] = ((time.hour / 10) & 0x02) >> 1;
-  bits[28] = 0; // Unused
-  bits[29] = 0; // Unused
-
-  // Encode day of year (BCD) - Bits 31-39, 41-42
-  bits[31] = (time.day % 10) & 0x01;
-  bits[32] = ((time.day % 10) & 0x02) >> 1;
-  bits[33] = ((time.day % 10) & 0x04) >> 2;
-  bits[34] = ((time.day % 10) & 0x08) >> 3;
-  bits[35] = 0; // Unused
-  bits[36] = ((time.day / 10) % 10) & 0x01;
-  bits[37] = (((time.day / 10) % 10) & 0x02) >> 1;
-  bits[38] = (((time.day / 10) % 10) & 0x04) >> 2;
-  bits[39] = (((time.day / 10) % 10) & 0x08) >> 3;
-  bits[41] = (time.day / 100) & 0x01;
-  bits[42] = ((time.day / 100) & 0x02) >> 1;
-
-  // Encode year (BCD) - Bits 51-58
-  
-  bits[51] = (time.year % 10) & 0x01;
-  bits[52] = ((time.year % 10) & 0x02) >> 1;
-  bits[53] = ((time.year % 10) & 0x04) >> 2;
-  bits[54] = ((time.year % 10) & 0x08) >> 3;
-  bits[55] = 0; // Unused
-  bits[56] = (time.year / 10) & 0x01;
-  bits[57] = ((time.year / 10) & 0x02) >> 1;
-  bits[58] = ((time.year / 10) & 0x04) >> 2;
-
-  // Control bits (IEEE C37.118.1 extensions) - Bits 61-64
-  bits[61] = 0; // Leap Second Pending (LSP)
-  bits[62] = 0; // Leap Second (LS)
-  bits[63] = 0; // Daylight Saving Pending (DSP)
-  bits[64] = 0; // Daylight Savings Time (DST)
-
-  // Encode Time Offset for WIB - Bits 65-69
-  bool isNegative = timeOffsetHours < 0;
-  uint8_t offsetHours = static_cast<uint8_t>(abs(timeOffsetHours));
-  bits[65] = isNegative ? 1 : 0;   // Sign bit (0 for WIB)
-  bits[66] = (offsetHours & 0x01); // BCD for 7
-  bits[67] = (offsetHours & 0x02) >> 1;
-  bits[68] = (offsetHours & 0x04) >> 2;
-  bits[69] = (offsetHours & 0x08) >> 3;
-  bits[71] = 0; // No 0.5-hour offset
-
-  // Encode Time Quality (TQ) - Bits 72-75
-  uint8_t tqValue = static_cast<uint8_t>(tq);
-  bits[72] = (tqValue & 0x01);
-  bits[73] = (tqValue & 0x02) >> 1;
-  bits[74] = (tqValue & 0x04) >> 2;
-  bits[75] = (tqValue & 0x08) >> 3;
-
-  // Encode Continuous Time Quality (CTQ) - Bits 77-79
-  uint8_t ctqValue = static_cast<uint8_t>(ctq);
-  bits[77] = (ctqValue & 0x01);
-  bits[78] = (ctqValue & 0x02) >> 1;
-  bits[79] = (ctqValue & 0x04) >> 2;
-
-  // Parity check - Bit 76 (even parity over bits 2-75)
-  int count = 0;
-  for (int i = 2; i <= 75; i++) {
-    if (i % 10 != 0) {
-      count += bits[i];
-    }
+void IRIGB::encodeTimeIntoBits(const IrigTime &time, int timeOffsetHours, IrigFormat format)
+{
+  // Counted rather than logged, the encoder task must not wait on the serial port
+  if (!irig_frame_encoder(format)(time, timeOffsetHours, TimeQuality::WITHIN_1_US, ContinuousTimeQuality::NOT_USED, spare))
+  {
+    encode_errors++;
   }
-  bits[76] = (count % 2) ? 0 : 1;
-
-  // Encode Straight Binary Seconds (SBS) - Bits 81-89, 91-98
-  bits[81] = straight_binary_second & 0x01;
-  bits[82] = (straight_binary_second & 0x02) >> 1;
-  bits[83] = (straight_binary_second & 0x04) >> 2;
-  bits[84] = (straight_binary_second & 0x08) >> 3;
-  bits[85] = (straight_binary_second & 0x10) >> 4;
-  bits[86] = (straight_binary_second & 0x20) >> 5;
-  bits[87] = (straight_binary_second & 0x40) >> 6;
-  bits[88] = (straight_binary_second & 0x80) >> 7;
-  bits[89] = (straight_binary_second & 0x100) >> 8;
-  bits[91] = (straight_binary_second & 0x200) >> 9;
-  bits[92] = (straight_binary_second & 0x400) >> 10;
-  bits[93] = (straight_binary_second & 0x800) >> 11;
-  bits[94] = (straight_binary_second & 0x1000) >> 12;
-  bits[95] = (straight_binary_second & 0x2000) >> 13;
-  bits[96] = (straight_binary_second & 0x4000) >> 14;
-  bits[97] = (straight_binary_second & 0x8000) >> 15;
-  bits[98] = (straight_binary_second & 0x10000) >> 16;
-  bits[99] = 0; // Unused
+}
 
-}
\ No newline at end of file
+void IRIGB::commitBits()
+{
+  uint8_t next = use_buffer_0 ? 1 : 0;
+  bool *encoded = spare;
+  spare = slots[next];
+  slots[next] = encoded;
+  next_ready = true;
+}
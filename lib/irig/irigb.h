@@ -2,43 +2,14 @@
 #define IRIGB_H
 
 #include <Arduino.h>
+#include "fast_gpio.h"
+#include "irig_encoder.h"
 
-// IRIG-B time structure
-struct IrigTime {
-  uint8_t second;   // 0-59
-  uint8_t minute;   // 0-59
-  uint8_t hour;     // 0-23
-  uint16_t day;     // 1-366
-  uint16_t year;      // 0-99
-};
-
+// Seconds since 2000-01-01 00:00:00 (year may be given as 2 or 4 digits)
+uint32_t irig_time_to_seconds(const IrigTime& time);
 
-enum class TimeQuality : uint8_t {
-    LOCKED_TO_UTC = 0,     // Clock is locked to a UTC traceable source
-    WITHIN_1_NS = 1,       // Time is within < 1 ns of UTC
-    WITHIN_10_NS = 2,      // Time is within < 10 ns of UTC
-    WITHIN_100_NS = 3,     // Time is within < 100 ns of UTC
-    WITHIN_1_US = 4,       // Time is within < 1 μs of UTC
-    WITHIN_10_US = 5,      // Time is within < 10 μs of UTC
-    WITHIN_100_US = 6,     // Time is within < 100 μs of UTC
-    WITHIN_1_MS = 7,       // Time is within < 1 ms of UTC
-    WITHIN_10_MS = 8,      // Time is within < 10 ms of UTC
-    WITHIN_100_MS = 9,     // Time is within < 100 ms of UTC
-    WITHIN_1_S = 10,       // Time is within < 1 s of UTC
-    WITHIN_10_S = 11,      // Time is within < 10 s of UTC
-    FAULT = 15             // Clock failure, time is not reliable
-};
-
-enum class ContinuousTimeQuality : uint8_t {
-    NOT_USED = 0,          // Indicates code from previous version of standard
-    ERROR_LT_100_NS = 1,   // Estimated maximum time error < 100 ns
-    ERROR_LT_1_US = 2,     // Estimated maximum time error < 1 μs
-    ERROR_LT_10_US = 3,    // Estimated maximum time error < 10 μs
-    ERROR_LT_100_US = 4,   // Estimated maximum time error < 100 μs
-    ERROR_LT_1_MS = 5,     // Estimated maximum time error < 1 ms
-    ERROR_LT_10_MS = 6,    // Estimated maximum time error < 10 ms
-    ERROR_GT_10_MS = 7     // Estimated maximum time error > 10 ms or unknown
-};
+// Inverse of irig_time_to_seconds, the year is filled in with 4 digits
+void irig_time_from_seconds(uint32_t seconds, IrigTime& time);
 
 class IRIGB {
 public:
@@ -51,10 +22,29 @@ public:
   // // Initialize WiFi and NTP
   // void beginWiFi(const char* ssid, const char* password);
 
-  // Update and output a frame
+  // Update and output a frame. Runs from IRAM with direct pin writes, so
+  // the output timer keeps going while the flash cache is off.
   bool update();
   void enable(){enabled_flag  = true;}
+  // Frames output, and frames that repeated a stale buffer because no new
+  // time was encoded during the previous frame
+  uint32_t framesEmitted() const {return frames;}
+  uint32_t underrunCount() const {return underruns;}
   void disable(){enabled_flag = false;}
+  // Pulses low on a high idle level instead of high on a low one
+  void setInverted(bool invert){inverted = invert;}
+  // Drive the idle level, for an output that stops at a frame boundary
+  void idle(){fast_gpio_write(outputPin, inverted);}
+  // Restart a stopped output at a frame boundary with the frame encoded since
+  void resume();
+  // For backends that output whole frames: the bookkeeping update() does at
+  // the end of a frame, and the frame to output now
+  void endFrame();
+  const bool* frame() const {return slots[buffer()];}
+  // Buffer being output, 0 or 1; commitBits() replaces the other
+  uint8_t buffer() const {return use_buffer_0 ? 0 : 1;}
+  // Frames encodeTimeIntoBits() could not encode, sent as markers only
+  uint32_t encodeErrors() const {return encode_errors;}
   
   
   // Get current time
@@ -77,19 +67,30 @@ public:
   unsigned long lastFrameTime;
   bool ntpTimeValid;
   bool enable_output = true;
+  bool inverted = false;
   IrigTime requestSetTime;
   bool requestSetTimeFlag;
   uint8_t bit_counter=0;
   bool bits[100];
   bool bits_0[100];
   bool bits_1[100];
+  bool bits_2[100];
+  bool* slots[2] = {bits_0, bits_1};  // Output and next frame, by buffer()
+  bool* spare = bits_2;               // Written by encodeTimeIntoBits()
   bool use_buffer_0=true;
+  volatile bool next_ready=false;  // Inactive buffer encoded since the last swap
+  volatile uint32_t frames=0;
+  volatile uint32_t underruns=0;
+  uint32_t encode_errors=0;
   uint8_t state=0;
   uint8_t bit_counter_marker=0;
    
-  void encodeTimeIntoBits(const IrigTime& time, int timeOffsetHours);
-  void encodeTimeIntoBits(const IrigTime& time, bool* bits, int timeOffsetHours);
-  void encodeTimeIntoBits(const IrigTime &time,bool* bits, int timeOffsetHours, TimeQuality tq, ContinuousTimeQuality ctq);
+  // Encode the frame that follows the one being output into the spare
+  // buffer, which the timer never reads, so it runs without a lock
+  void encodeTimeIntoBits(const IrigTime& time, int timeOffsetHours, IrigFormat format = IRIG_FORMAT_DEFAULT);
+  // Make the spare buffer the next frame: a pointer swap, done under the
+  // output engine's lock so it never meets a frame start halfway
+  void commitBits();
   private:
 };
 
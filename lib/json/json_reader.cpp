@@ -0,0 +1,369 @@
+#include "json_reader.h"
+#include <string.h>
+
+JsonReader::JsonReader(const char* data, size_t length)
+    : data(data), length(data ? length : 0), pos(0), depth(0), array_bits(0), state(EXPECT_VALUE),
+      error_message(nullptr), error_offset(0) {
+}
+
+void JsonReader::skipWhitespace() {
+  while (pos < length) {
+    char c = data[pos];
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+      return;
+    }
+    pos++;
+  }
+}
+
+bool JsonReader::fail(const char* message, JsonToken& token) {
+  if (!error_message) {
+    error_message = message;
+    error_offset = pos;
+  }
+  state = DONE;
+  token.type = JsonTokenType::ERROR;
+  token.start = data + pos;
+  token.length = 0;
+  return false;
+}
+
+bool JsonReader::emit(JsonTokenType type, size_t start, size_t len, JsonToken& token) {
+  token.type = type;
+  token.escaped = false;
+  token.integer = false;
+  token.start = data + start;
+  token.length = len;
+  return true;
+}
+
+bool JsonReader::open(bool array, JsonToken& token) {
+  if (depth >= MAX_DEPTH) {
+    return fail("Nesting too deep", token);
+  }
+  if (array) {
+    array_bits |= 1 << depth;
+  } else {
+    array_bits &= ~(1 << depth);
+  }
+  depth++;
+  state = array ? VALUE_OR_END : KEY_OR_END;
+  pos++;
+  return emit(array ? JsonTokenType::BEGIN_ARRAY : JsonTokenType::BEGIN_OBJECT, pos - 1, 1, token);
+}
+
+bool JsonReader::close(JsonToken& token) {
+  bool array = array_bits & (1 << (depth - 1));
+  depth--;
+  state = AFTER_VALUE;
+  pos++;
+  return emit(array ? JsonTokenType::END_ARRAY : JsonTokenType::END_OBJECT, pos - 1, 1, token);
+}
+
+bool JsonReader::next(JsonToken& token) {
+  if (state == DONE) {
+    if (error_message) {
+      return fail(error_message, token);
+    }
+    emit(JsonTokenType::END, pos, 0, token);
+    return false;
+  }
+
+  skipWhitespace();
+  if (state == AFTER_VALUE) {
+    if (depth == 0) {
+      if (pos < length) {
+        return fail("Unexpected data after document", token);
+      }
+      state = DONE;
+      emit(JsonTokenType::END, pos, 0, token);
+      return false;
+    }
+    bool array = array_bits & (1 << (depth - 1));
+    char c = pos < length ? data[pos] : 0;
+    if (c == (array ? ']' : '}')) {
+      return close(token);
+    }
+    if (c != ',') {
+      return fail(array ? "Expected ',' or ']'" : "Expected ',' or '}'", token);
+    }
+    pos++;
+    skipWhitespace();
+    state = array ? EXPECT_VALUE : EXPECT_KEY;
+  }
+
+  if (pos >= length) {
+    return fail("Unexpected end of input", token);
+  }
+  char c = data[pos];
+
+  if (state == KEY_OR_END || state == VALUE_OR_END) {
+    if (c == (state == KEY_OR_END ? '}' : ']')) {
+      return close(token);
+    }
+    state = state == KEY_OR_END ? EXPECT_KEY : EXPECT_VALUE;
+  }
+
+  if (state == EXPECT_KEY) {
+    if (c != '"') {
+      return fail("Expected member name", token);
+    }
+    if (!scanString(token)) {
+      return false;
+    }
+    token.type = JsonTokenType::KEY;
+    skipWhitespace();
+    if (pos >= length || data[pos] != ':') {
+      return fail("Expected ':'", token);
+    }
+    pos++;
+    state = EXPECT_VALUE;
+    return true;
+  }
+
+  return scanValue(token);
+}
+
+bool JsonReader::scanValue(JsonToken& token) {
+  char c = data[pos];
+  switch (c) {
+    case '{':
+      return open(false, token);
+    case '[':
+      return open(true, token);
+    case '"':
+      if (!scanString(token)) {
+        return false;
+      }
+      state = AFTER_VALUE;
+      return true;
+    case 't':
+      return scanLiteral("true", JsonTokenType::TRUE_VALUE, token);
+    case 'f':
+      return scanLiteral("false", JsonTokenType::FALSE_VALUE, token);
+    case 'n':
+      return scanLiteral("null", JsonTokenType::NULL_VALUE, token);
+    default:
+      if (c == '-' || (c >= '0' && c <= '9')) {
+        return scanNumber(token);
+      }
+      return fail("Unexpected character", token);
+  }
+}
+
+static bool isHex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool JsonReader::scanString(JsonToken& token) {
+  size_t start = ++pos;
+  bool escaped = false;
+  while (pos < length) {
+    unsigned char c = data[pos];
+    if (c == '"') {
+      emit(JsonTokenType::STRING, start, pos - start, token);
+      token.escaped = escaped;
+      pos++;
+      return true;
+    }
+    if (c < 0x20) {
+      return fail("Control character in string", token);
+    }
+    if (c == '\\') {
+      escaped = true;
+      pos++;
+      if (pos >= length) {
+        break;
+      }
+      c = data[pos];
+      if (c == 'u') {
+        for (int i = 1; i <= 4; i++) {
+          if (pos + i >= length || !isHex(data[pos + i])) {
+            return fail("Invalid \\u escape", token);
+          }
+        }
+        pos += 4;
+      } else if (!strchr("\"\\/bfnrt", c)) {
+        return fail("Invalid escape", token);
+      }
+    }
+    pos++;
+  }
+  return fail("Unterminated string", token);
+}
+
+bool JsonReader::scanNumber(JsonToken& token) {
+  size_t start = pos;
+  bool integer = true;
+  if (data[pos] == '-') {
+    pos++;
+  }
+  if (pos >= length || data[pos] < '0' || data[pos] > '9') {
+    return fail("Invalid number", token);
+  }
+  if (data[pos] == '0') {
+    pos++;
+  } else {
+    while (pos < length && data[pos] >= '0' && data[pos] <= '9') pos++;
+  }
+  if (pos < length && data[pos] == '.') {
+    integer = false;
+    pos++;
+    if (pos >= length || data[pos] < '0' || data[pos] > '9') {
+      return fail("Invalid number", token);
+    }
+    while (pos < length && data[pos] >= '0' && data[pos] <= '9') pos++;
+  }
+  if (pos < length && (data[pos] == 'e' || data[pos] == 'E')) {
+    integer = false;
+    pos++;
+    if (pos < length && (data[pos] == '+' || data[pos] == '-')) pos++;
+    if (pos >= length || data[pos] < '0' || data[pos] > '9') {
+      return fail("Invalid number", token);
+    }
+    while (pos < length && data[pos] >= '0' && data[pos] <= '9') pos++;
+  }
+  emit(JsonTokenType::NUMBER, start, pos - start, token);
+  token.integer = integer;
+  state = AFTER_VALUE;
+  return true;
+}
+
+bool JsonReader::scanLiteral(const char* literal, JsonTokenType type, JsonToken& token) {
+  size_t len = strlen(literal);
+  if (length - pos < len || memcmp(data + pos, literal, len) != 0) {
+    return fail("Unexpected character", token);
+  }
+  pos += len;
+  state = AFTER_VALUE;
+  return emit(type, pos - len, len, token);
+}
+
+bool JsonReader::skip(const JsonToken& first) {
+  if (first.type != JsonTokenType::BEGIN_OBJECT && first.type != JsonTokenType::BEGIN_ARRAY) {
+    return !failed();
+  }
+  uint8_t target = depth - 1;
+  JsonToken token;
+  while (depth > target) {
+    if (!next(token)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool JsonReader::equals(const JsonToken& token, const char* s) {
+  size_t len = strlen(s);
+  if (!token.escaped) {
+    return token.length == len && memcmp(token.start, s, len) == 0;
+  }
+  // Escapes only ever shorten the text
+  if (token.length < len) {
+    return false;
+  }
+  char buffer[64];
+  if (len >= sizeof(buffer)) {
+    return false;
+  }
+  return copyString(token, buffer, sizeof(buffer)) == len && memcmp(buffer, s, len) == 0;
+}
+
+bool JsonReader::toInt32(const JsonToken& token, int32_t& out) {
+  if (token.type != JsonTokenType::NUMBER || !token.integer) {
+    return false;
+  }
+  const char* p = token.start;
+  const char* end = token.start + token.length;
+  bool negative = *p == '-';
+  if (negative) {
+    p++;
+  }
+  uint32_t limit = negative ? 2147483648u : 2147483647u;
+  uint32_t value = 0;
+  for (; p < end; p++) {
+    uint32_t digit = *p - '0';
+    if (value > (limit - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+  out = negative ? (int32_t)(0u - value) : (int32_t)value;
+  return true;
+}
+
+static uint32_t hexValue(const char* p) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = p[i];
+    v <<= 4;
+    if (c >= '0' && c <= '9') v |= c - '0';
+    else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+    else v |= c - 'A' + 10;
+  }
+  return v;
+}
+
+size_t JsonReader::copyString(const JsonToken& token, char* out, size_t capacity) {
+  size_t n = 0;
+  const char* p = token.start;
+  const char* end = token.start + token.length;
+  // Append one byte, counting past the end of 'out' so callers learn the full length
+  auto put = [&](char c) {
+    if (n + 1 < capacity) {
+      out[n] = c;
+    }
+    n++;
+  };
+  while (p < end) {
+    char c = *p++;
+    if (c != '\\') {
+      put(c);
+      continue;
+    }
+    c = *p++;
+    switch (c) {
+      case 'b': put('\b'); break;
+      case 'f': put('\f'); break;
+      case 'n': put('\n'); break;
+      case 'r': put('\r'); break;
+      case 't': put('\t'); break;
+      case 'u': {
+        uint32_t cp = hexValue(p);
+        p += 4;
+        // Combine a surrogate pair, a lone surrogate becomes U+FFFD
+        if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+          uint32_t low = hexValue(p + 2);
+          if (low >= 0xDC00 && low <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            p += 6;
+          }
+        }
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+          cp = 0xFFFD;
+        }
+        if (cp < 0x80) {
+          put((char)cp);
+        } else if (cp < 0x800) {
+          put((char)(0xC0 | (cp >> 6)));
+          put((char)(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+          put((char)(0xE0 | (cp >> 12)));
+          put((char)(0x80 | ((cp >> 6) & 0x3F)));
+          put((char)(0x80 | (cp & 0x3F)));
+        } else {
+          put((char)(0xF0 | (cp >> 18)));
+          put((char)(0x80 | ((cp >> 12) & 0x3F)));
+          put((char)(0x80 | ((cp >> 6) & 0x3F)));
+          put((char)(0x80 | (cp & 0x3F)));
+        }
+        break;
+      }
+      default: put(c); break;   // '"', '\\', '/'
+    }
+  }
+  if (capacity > 0) {
+    out[n < capacity ? n : capacity - 1] = 0;
+  }
+  return n;
+}
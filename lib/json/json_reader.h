@@ -0,0 +1,98 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+enum class JsonTokenType : uint8_t {
+  BEGIN_OBJECT,
+  END_OBJECT,
+  BEGIN_ARRAY,
+  END_ARRAY,
+  KEY,          // Member name, the ':' is already consumed
+  STRING,
+  NUMBER,
+  TRUE_VALUE,
+  FALSE_VALUE,
+  NULL_VALUE,
+  END,          // Document complete
+  ERROR
+};
+
+// A token refers into the input, nothing is copied. For KEY and STRING the
+// span excludes the quotes and is still escaped (see JsonReader::copyString).
+struct JsonToken {
+  JsonTokenType type;
+  bool escaped;      // String contains backslash escapes
+  bool integer;      // Number without fraction or exponent
+  const char* start;
+  size_t length;
+};
+
+// Pull tokenizer over a complete JSON document. Walks the input once and
+// validates the grammar as it goes; the first error stops it and records a
+// message and the byte offset it was found at.
+class JsonReader {
+public:
+  static const uint8_t MAX_DEPTH = 16;
+
+  JsonReader(const char* data, size_t length);
+
+  // Next token. Returns false at the end of the document (END) or on an
+  // error (ERROR, see error()/errorOffset()).
+  bool next(JsonToken& token);
+
+  // Skip the rest of a value whose first token was just returned, so nested
+  // objects/arrays of members the caller is not interested in are passed over
+  bool skip(const JsonToken& first);
+
+  bool failed() const { return error_message != nullptr; }
+  const char* error() const { return error_message; }
+  size_t errorOffset() const { return error_offset; }
+
+  // Byte offset of a token in the input
+  size_t offsetOf(const JsonToken& token) const { return token.start - data; }
+
+  // Compare a KEY/STRING token with a plain C string
+  static bool equals(const JsonToken& token, const char* s);
+
+  // Integer NUMBER token as int32_t; false for fractions and out of range values
+  static bool toInt32(const JsonToken& token, int32_t& out);
+
+  // Unescape a KEY/STRING token into 'out' (always null terminated when
+  // capacity > 0). Returns the unescaped length, which may exceed capacity - 1.
+  static size_t copyString(const JsonToken& token, char* out, size_t capacity);
+
+private:
+  enum State : uint8_t {
+    EXPECT_VALUE,
+    EXPECT_KEY,
+    KEY_OR_END,     // Just after '{'
+    VALUE_OR_END,   // Just after '['
+    AFTER_VALUE,
+    DONE
+  };
+
+  const char* data;
+  size_t length;
+  size_t pos;
+  uint8_t depth;
+  uint16_t array_bits;   // Bit per nesting level: container is an array
+  State state;
+  const char* error_message;
+  size_t error_offset;
+
+  void skipWhitespace();
+  bool fail(const char* message, JsonToken& token);
+  bool emit(JsonTokenType type, size_t start, size_t len, JsonToken& token);
+  bool open(bool array, JsonToken& token);
+  bool close(JsonToken& token);
+  bool scanValue(JsonToken& token);
+  bool scanString(JsonToken& token);
+  bool scanNumber(JsonToken& token);
+  bool scanLiteral(const char* literal, JsonTokenType type, JsonToken& token);
+};
+
+#endif // JSON_READER_H
@@ -0,0 +1,133 @@
+#include "json_writer.h"
+
+JsonWriter::JsonWriter(char* buffer, size_t capacity)
+    : buffer(buffer), capacity(buffer ? capacity : 0), written(0), depth(0), has_members(0), after_key(false) {
+}
+
+void JsonWriter::put(char c) {
+  if (written < capacity) {
+    buffer[written] = c;
+  }
+  written++;
+}
+
+void JsonWriter::putRaw(const char* s) {
+  while (*s) {
+    put(*s++);
+  }
+}
+
+void JsonWriter::separator() {
+  if (after_key) {
+    // Value directly follows its key
+    after_key = false;
+    return;
+  }
+  if (depth == 0) {
+    return;
+  }
+  uint16_t bit = 1 << (depth - 1);
+  if (has_members & bit) {
+    put(',');
+  }
+  has_members |= bit;
+}
+
+void JsonWriter::open(char c) {
+  separator();
+  put(c);
+  if (depth < MAX_DEPTH) {
+    depth++;
+    has_members &= ~(1 << (depth - 1));
+  }
+}
+
+void JsonWriter::close(char c) {
+  if (depth > 0) {
+    depth--;
+  }
+  put(c);
+}
+
+void JsonWriter::beginObject() { open('{'); }
+void JsonWriter::endObject() { close('}'); }
+void JsonWriter::beginArray() { open('['); }
+void JsonWriter::endArray() { close(']'); }
+
+void JsonWriter::key(const char* name) {
+  value(name);
+  put(':');
+  after_key = true;
+}
+
+void JsonWriter::value(bool v) {
+  separator();
+  putRaw(v ? "true" : "false");
+}
+
+void JsonWriter::putUnsigned(unsigned long v) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + (v % 10);
+    v /= 10;
+  } while (v);
+  while (n) {
+    put(digits[--n]);
+  }
+}
+
+void JsonWriter::value(int v) { value((long)v); }
+void JsonWriter::value(unsigned int v) { value((unsigned long)v); }
+
+void JsonWriter::value(long v) {
+  separator();
+  if (v < 0) {
+    put('-');
+    putUnsigned(0UL - (unsigned long)v);
+  } else {
+    putUnsigned((unsigned long)v);
+  }
+}
+
+void JsonWriter::value(unsigned long v) {
+  separator();
+  putUnsigned(v);
+}
+
+void JsonWriter::value(const char* v) {
+  separator();
+  if (!v) {
+    putRaw("null");
+    return;
+  }
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  put('"');
+  for (const char* p = v; *p; p++) {
+    char c = *p;
+    switch (c) {
+      case '"': putRaw("\\\""); break;
+      case '\\': putRaw("\\\\"); break;
+      case '\n': putRaw("\\n"); break;
+      case '\r': putRaw("\\r"); break;
+      case '\t': putRaw("\\t"); break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          putRaw("\\u00");
+          put(HEX_DIGITS[(c >> 4) & 0x0F]);
+          put(HEX_DIGITS[c & 0x0F]);
+        } else {
+          put(c);
+        }
+        break;
+    }
+  }
+  put('"');
+}
+
+const char* JsonWriter::c_str() {
+  if (written < capacity) {
+    buffer[written] = '\0';
+  }
+  return buffer;
+}
@@ -0,0 +1,67 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// Streaming JSON serializer writing straight into a caller-provided buffer.
+// Never allocates. Commas between members are inserted automatically.
+// With a null buffer nothing is written and length() reports the size the
+// output would need, so a message buffer of exactly the right size can be
+// allocated before serializing for real.
+class JsonWriter {
+public:
+  static const uint8_t MAX_DEPTH = 16;
+
+  JsonWriter(char* buffer, size_t capacity);
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  // Member name inside an object
+  void key(const char* name);
+
+  void value(bool v);
+  void value(int v);
+  void value(unsigned int v);
+  void value(long v);
+  void value(unsigned long v);
+  void value(const char* v);   // Escaped, null becomes JSON null
+
+  // key(name) + value(v)
+  template <typename T>
+  void field(const char* name, T v) {
+    key(name);
+    value(v);
+  }
+
+  // Bytes produced (or needed, when the buffer was too small or null)
+  size_t length() const { return written; }
+
+  // True when the output did not fit into the buffer
+  bool overflow() const { return written > capacity; }
+
+  // Null terminate the output if there is room left; returns the buffer
+  const char* c_str();
+
+private:
+  char* buffer;
+  size_t capacity;
+  size_t written;
+  uint8_t depth;
+  uint16_t has_members;   // Bit per nesting level: a member was already written
+  bool after_key;
+
+  void put(char c);
+  void putRaw(const char* s);
+  void separator();
+  void open(char c);
+  void close(char c);
+  void putUnsigned(unsigned long v);
+};
+
+#endif // JSON_WRITER_H
@@ -0,0 +1,84 @@
+#include "loopback.h"
+#include <math.h>
+
+// Nominal high time of zero / one / marker elements
+static const int32_t NOMINAL_WIDTH_US[3] = {2000, 5000, 8000};
+
+void LoopbackMonitor::Accumulator::reset() {
+  count = 0;
+  sum = 0;
+  sum_sq = 0;
+  min = INT32_MAX;
+  max = INT32_MIN;
+}
+
+void LoopbackMonitor::Accumulator::add(int32_t value) {
+  count++;
+  sum += value;
+  sum_sq += (int64_t)value * value;
+  if (value < min) min = value;
+  if (value > max) max = value;
+}
+
+LoopbackSeries LoopbackMonitor::Accumulator::summary() const {
+  LoopbackSeries series = {0, 0, 0, 0, 0};
+  if (count == 0) {
+    return series;
+  }
+  series.count = count;
+  series.mean_us = (int32_t)(sum / (int64_t)count);
+  series.min_us = min;
+  series.max_us = max;
+  double mean = (double)sum / count;
+  double variance = (double)sum_sq / count - mean * mean;
+  series.jitter_us = variance > 0 ? (uint32_t)(sqrt(variance) + 0.5) : 0;
+  return series;
+}
+
+LoopbackMonitor::LoopbackMonitor() {
+  worst_on_time = 0;
+  resetWindow();
+}
+
+void LoopbackMonitor::resetWindow() {
+  on_time.reset();
+  edges.reset();
+  for (int i = 0; i < 3; i++) {
+    width[i].reset();
+  }
+  bad_pulses = 0;
+}
+
+void LoopbackMonitor::addPulse(int32_t rise_from_frame_start_us, uint32_t width_us, uint8_t element) {
+  if (element > 2) {
+    bad_pulses++;
+    return;
+  }
+
+  // Nearest element slot (floor division so edges just before a frame start
+  // land on the last slot of the previous frame)
+  int32_t shifted = rise_from_frame_start_us + (int32_t)ELEMENT_US / 2;
+  int32_t slot = shifted >= 0 ? shifted / (int32_t)ELEMENT_US : -((-shifted + (int32_t)ELEMENT_US - 1) / (int32_t)ELEMENT_US);
+  int32_t phase_error = rise_from_frame_start_us - slot * (int32_t)ELEMENT_US;
+
+  edges.add(phase_error);
+  if (slot == 1) {
+    // Element 1 of the output frame is the Pr marker
+    on_time.add(phase_error);
+    int32_t magnitude = phase_error < 0 ? -phase_error : phase_error;
+    if (magnitude > worst_on_time) worst_on_time = magnitude;
+  }
+  width[element].add((int32_t)width_us - NOMINAL_WIDTH_US[element]);
+}
+
+LoopbackStats LoopbackMonitor::stats() const {
+  LoopbackStats result;
+  result.on_time = on_time.summary();
+  result.edges = edges.summary();
+  for (int i = 0; i < 3; i++) {
+    result.width[i] = width[i].summary();
+  }
+  result.bad_pulses = bad_pulses;
+  result.worst_on_time_us = worst_on_time;
+  return result;
+}
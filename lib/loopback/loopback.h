@@ -0,0 +1,65 @@
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// Summary of one measured quantity over the current window
+struct LoopbackSeries {
+  uint32_t count;
+  int32_t mean_us;
+  int32_t min_us;
+  int32_t max_us;
+  uint32_t jitter_us;   // Standard deviation
+};
+
+struct LoopbackStats {
+  LoopbackSeries on_time;     // On-time (Pr leading) edge vs. the ideal timer schedule
+  LoopbackSeries edges;       // Every element's leading edge vs. the ideal 10 ms grid
+  LoopbackSeries width[3];    // Pulse width error for 2 ms / 5 ms / 8 ms elements
+  uint32_t bad_pulses;        // Pulses that matched no element width
+  int32_t worst_on_time_us;   // Largest on-time error since start (absolute value)
+};
+
+// Accumulates phase and width errors of one of our own output channels read
+// back on the decoder input. Errors are measured against the ideal element
+// grid derived from the output timer, so they show ISR latency and output
+// path delays as they happen in the field.
+class LoopbackMonitor {
+public:
+  static const uint32_t ELEMENT_US = 10000;
+
+  LoopbackMonitor();
+
+  // Start a new statistics window (the lifetime worst case is kept)
+  void resetWindow();
+
+  // One pulse read back: leading edge and width relative to the ideal start
+  // of the frame it belongs to, and its element type (0 = zero, 1 = one, 2 = marker,
+  // anything else = unclassifiable)
+  void addPulse(int32_t rise_from_frame_start_us, uint32_t width_us, uint8_t element);
+
+  // Statistics of the current window
+  LoopbackStats stats() const;
+
+private:
+  struct Accumulator {
+    uint32_t count;
+    int64_t sum;
+    int64_t sum_sq;
+    int32_t min;
+    int32_t max;
+    void reset();
+    void add(int32_t value);
+    LoopbackSeries summary() const;
+  };
+
+  Accumulator on_time;
+  Accumulator edges;
+  Accumulator width[3];
+  uint32_t bad_pulses;
+  int32_t worst_on_time;
+};
+
+#endif // LOOPBACK_H
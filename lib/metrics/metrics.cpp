@@ -0,0 +1,172 @@
+#include "metrics.h"
+#include <string.h>
+
+const uint32_t LATENCY_BOUNDS_US[LATENCY_BUCKETS] = {2, 5, 10, 20, 50, 100, 200, 500};
+
+static const MetricFamily* registry[METRICS_MAX_FAMILIES];
+static size_t registry_count = 0;
+
+bool metrics_register(const MetricFamily* family) {
+  if (registry_count >= METRICS_MAX_FAMILIES) {
+    return false;
+  }
+  registry[registry_count++] = family;
+  return true;
+}
+
+MetricsWriter::MetricsWriter(char* buffer, size_t capacity)
+    : buffer(buffer), capacity(buffer ? capacity : 0), written(0) {
+}
+
+void MetricsWriter::put(char c) {
+  if (written < capacity) {
+    buffer[written] = c;
+  }
+  written++;
+}
+
+void MetricsWriter::putText(const char* s) {
+  while (*s) {
+    put(*s++);
+  }
+}
+
+void MetricsWriter::putEscaped(const char* s) {
+  for (; *s; s++) {
+    if (*s == '\\' || *s == '"') {
+      put('\\');
+      put(*s);
+    } else if (*s == '\n') {
+      put('\\');
+      put('n');
+    } else {
+      put(*s);
+    }
+  }
+}
+
+void MetricsWriter::putUnsigned(uint64_t v) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + (v % 10);
+    v /= 10;
+  } while (v > 0);
+  while (n > 0) {
+    put(digits[--n]);
+  }
+}
+
+void MetricsWriter::putSigned(int64_t v) {
+  if (v < 0) {
+    put('-');
+    putUnsigned((uint64_t)0 - (uint64_t)v);
+  } else {
+    putUnsigned((uint64_t)v);
+  }
+}
+
+void MetricsWriter::header(const char* name, const char* help, MetricType type) {
+  putText("# HELP ");
+  putText(name);
+  put(' ');
+  putText(help);
+  putText("\n# TYPE ");
+  putText(name);
+  putText(type == MetricType::COUNTER ? " counter\n" : type == MetricType::GAUGE ? " gauge\n" : " histogram\n");
+}
+
+void MetricsWriter::sample(const char* name, int64_t value) {
+  putText(name);
+  put(' ');
+  putSigned(value);
+  put('\n');
+}
+
+void MetricsWriter::sample(const char* name, const char* label, const char* label_value, int64_t value) {
+  putText(name);
+  put('{');
+  putText(label);
+  putText("=\"");
+  putEscaped(label_value);
+  putText("\"} ");
+  putSigned(value);
+  put('\n');
+}
+
+void MetricsWriter::sample(const char* name, const char* label, uint32_t label_value, int64_t value) {
+  putText(name);
+  put('{');
+  putText(label);
+  putText("=\"");
+  putUnsigned(label_value);
+  putText("\"} ");
+  putSigned(value);
+  put('\n');
+}
+
+void MetricsWriter::histogram(const char* name, const uint32_t* bounds, const uint32_t* counts, size_t n, uint64_t sum) {
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= n; i++) {
+    cumulative += counts[i];
+    putText(name);
+    putText("_bucket{le=\"");
+    if (i < n) {
+      putUnsigned(bounds[i]);
+    } else {
+      putText("+Inf");
+    }
+    putText("\"} ");
+    putUnsigned(cumulative);
+    put('\n');
+  }
+  putText(name);
+  putText("_sum ");
+  putUnsigned(sum);
+  put('\n');
+  putText(name);
+  putText("_count ");
+  putUnsigned(cumulative);
+  put('\n');
+}
+
+MetricsRenderer::MetricsRenderer() : staged(0), sent(0), family(0) {
+}
+
+void MetricsRenderer::reset() {
+  staged = 0;
+  sent = 0;
+  family = 0;
+}
+
+size_t MetricsRenderer::read(uint8_t* out, size_t max) {
+  size_t produced = 0;
+  while (produced < max) {
+    if (sent == staged) {
+      // Render the next family that fits; one that does not is left out
+      // rather than cut off in the middle of a line
+      staged = 0;
+      sent = 0;
+      while (staged == 0 && family < registry_count) {
+        const MetricFamily* f = registry[family++];
+        MetricsWriter writer(staging, sizeof(staging));
+        writer.header(f->name, f->help, f->type);
+        f->collect(writer, f->name);
+        if (!writer.overflow()) {
+          staged = writer.length();
+        }
+      }
+      if (staged == 0) {
+        break;
+      }
+    }
+    size_t n = staged - sent;
+    if (n > max - produced) {
+      n = max - produced;
+    }
+    memcpy(out + produced, staging + sent, n);
+    sent += n;
+    produced += n;
+  }
+  return produced;
+}
@@ -0,0 +1,130 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// Prometheus text exposition. Modules register metric families once; a
+// scrape walks the registry and renders each family into a small staging
+// buffer that is copied out chunk by chunk, so no response is ever held in
+// memory as a whole and nothing is allocated per sample.
+
+enum class MetricType : uint8_t {
+  COUNTER,
+  GAUGE,
+  HISTOGRAM
+};
+
+// Writes samples into a fixed buffer; output that does not fit is counted
+// but dropped (see overflow())
+class MetricsWriter {
+public:
+  MetricsWriter(char* buffer, size_t capacity);
+
+  // # HELP / # TYPE lines
+  void header(const char* name, const char* help, MetricType type);
+
+  // name value
+  void sample(const char* name, int64_t value);
+  // name{label="text"} value
+  void sample(const char* name, const char* label, const char* label_value, int64_t value);
+  // name{label="number"} value
+  void sample(const char* name, const char* label, uint32_t label_value, int64_t value);
+
+  // Cumulative histogram: name_bucket{le=...}, name_sum, name_count.
+  // counts[i] holds observations <= bounds[i], counts[n] the rest.
+  void histogram(const char* name, const uint32_t* bounds, const uint32_t* counts, size_t n, uint64_t sum);
+
+  size_t length() const { return written; }
+  bool overflow() const { return written > capacity; }
+
+private:
+  char* buffer;
+  size_t capacity;
+  size_t written;
+
+  void put(char c);
+  void putText(const char* s);
+  void putEscaped(const char* s);
+  void putUnsigned(uint64_t v);
+  void putSigned(int64_t v);
+};
+
+struct MetricFamily {
+  const char* name;
+  const char* help;
+  MetricType type;
+  // Emit the samples (the header is written by the renderer)
+  void (*collect)(MetricsWriter& out, const char* name);
+};
+
+// Latency histogram bucket bounds, microseconds
+#define LATENCY_BUCKETS 8
+extern const uint32_t LATENCY_BOUNDS_US[LATENCY_BUCKETS];
+
+// Histogram filled from an interrupt handler. record() is forced inline so it
+// becomes part of the (IRAM) caller, and compares against immediates so it
+// touches no flash-resident data.
+class LatencyHistogram {
+public:
+  LatencyHistogram() : sum_us(0), max_us(0) {
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) counts[i] = 0;
+  }
+
+  __attribute__((always_inline)) inline void record(uint32_t us) {
+    uint8_t bucket = us <= 2 ? 0 : us <= 5 ? 1 : us <= 10 ? 2 : us <= 20 ? 3 :
+                     us <= 50 ? 4 : us <= 100 ? 5 : us <= 200 ? 6 : us <= 500 ? 7 : 8;
+    counts[bucket] = counts[bucket] + 1;
+    sum_us = sum_us + us;
+    if (us > max_us) max_us = us;
+  }
+
+  // Copy of the counts (LATENCY_BUCKETS + 1 entries, last is +Inf)
+  void snapshot(uint32_t* out, uint64_t& sum, uint32_t& max) const {
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) out[i] = counts[i];
+    // Two word loads on a 32-bit core; read again if an interrupt on the
+    // other core carried between them
+    do {
+      sum = sum_us;
+    } while (sum != sum_us);
+    max = max_us;
+  }
+
+private:
+  volatile uint32_t counts[LATENCY_BUCKETS + 1];
+  // 64 bits: at 2000 interrupts a second 32 bits of microseconds wrap
+  // within days, and a counter that wraps breaks rate()
+  volatile uint64_t sum_us;
+  volatile uint32_t max_us;
+};
+
+// Most families that can be registered
+#define METRICS_MAX_FAMILIES 32
+
+// Largest rendering of a single family
+#define METRICS_FAMILY_BUFFER 768
+
+// Add a family to the registry; the descriptor must stay valid
+bool metrics_register(const MetricFamily* family);
+
+// Resumable rendering of the whole registry
+class MetricsRenderer {
+public:
+  MetricsRenderer();
+
+  // Start over from the first family, for the next scrape
+  void reset();
+
+  // Copy up to 'max' bytes of the exposition into 'out'; 0 when done
+  size_t read(uint8_t* out, size_t max);
+
+private:
+  char staging[METRICS_FAMILY_BUFFER];
+  size_t staged;
+  size_t sent;
+  size_t family;
+};
+
+#endif // METRICS_H
@@ -3,6 +3,7 @@
 #include <string.h>
 #include "settings.h"
 #include "ethernet.h"
+#include "metrics.h"
 
 // Global NTP variables
 WiFiUDP *ntpUDP;
@@ -15,11 +16,23 @@ long _timeOffset = 3600; // Will be set from settings
 unsigned long _updateInterval = 5000; // 10 seconds
 unsigned long _currentEpoc = 0;
 unsigned long _lastUpdate = 0;
+volatile bool _updateRequested = false; // Settings changed, query now
 unsigned long _currentMilliseconds = 0;
 byte _packetBuffer[NTP_PACKET_SIZE];
 extern Settings settings;
 int _ntp_counter=0;
 bool ntp_ok=false;
+int32_t _lastOffsetUs = 0;  // Server minus local time at the last update
+uint32_t _lastDelayUs = 0;  // Round trip without the server's processing time
+
+// Per server request counters, [0] primary and [1] secondary
+struct NTPServerStats {
+    uint32_t requests;
+    uint32_t successes;
+    uint32_t timeouts;
+};
+NTPServerStats _serverStats[2] = {};
+static const char* SERVER_LABELS[2] = {"primary", "secondary"};
 
 int ntp_counter(){
     return _ntp_counter;
@@ -27,6 +40,32 @@ int ntp_counter(){
 void ntp_reset_counter(){
     _ntp_counter=0;
 }
+int32_t ntp_last_offset_us(){
+    return _lastOffsetUs;
+}
+uint32_t ntp_last_delay_us(){
+    return _lastDelayUs;
+}
+
+// Query one server and count the outcome
+static bool ntp_query(int server, unsigned int serverPort) {
+    _serverStats[server].requests++;
+    if (ntp_forceUpdate(serverPort)) {
+        _serverStats[server].successes++;
+        return true;
+    }
+    _serverStats[server].timeouts++;
+    return false;
+}
+
+// 64-bit NTP timestamp (seconds since 1900 . 2^-32 fraction) at packet offset
+static uint64_t ntpTimestamp(int offset) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | _packetBuffer[offset + i];
+    }
+    return value;
+}
 
 void sendNTPPacket(unsigned int serverPort) {
     // set all bytes in the buffer to 0
@@ -65,25 +104,38 @@ bool ntp_forceUpdate(unsigned int serverPort) {
     while(ntpUDP->parsePacket() != 0)
         ntpUDP->flush();
 
+    unsigned long sentMicros = micros();
     sendNTPPacket(serverPort);
 
     // Wait till data is there or timeout...
-    byte timeout = 0;
+    uint16_t timeout = 0;
     int cb = 0;
     do {
-        delay(10);
+        delay(1);
         cb = ntpUDP->parsePacket();
-        if (timeout > 100){
+        if (timeout > 1000){
             
             return false; // timeout after 1000 ms
         }
         timeout++;
     } while (cb == 0);
+    unsigned long receivedMicros = micros();
+    unsigned long receivedMillis = millis();
+
+    // Local time as it stood before this update, for the offset
+    bool hadTime = _lastUpdate != 0;
+    int64_t localMs = (int64_t)_currentEpoc * 1000 + _currentMilliseconds + (receivedMillis - _lastUpdate);
 
-    _lastUpdate = millis() - (10 * (timeout + 1)); // Account for delay in reading the time
+    _lastUpdate = receivedMillis - (timeout + 1); // Account for delay in reading the time
 
     ntpUDP->read(_packetBuffer, NTP_PACKET_SIZE);
 
+    // Delay: round trip minus the time between the server's receive (T2) and transmit (T3) stamps
+    uint64_t serverHold = ntpTimestamp(40) - ntpTimestamp(32);
+    uint32_t serverHoldUs = (uint32_t)((serverHold * 1000000ULL) >> 32);
+    uint32_t roundTripUs = receivedMicros - sentMicros;
+    _lastDelayUs = roundTripUs > serverHoldUs ? roundTripUs - serverHoldUs : 0;
+
     unsigned long highWord = word(_packetBuffer[40], _packetBuffer[41]);
     unsigned long lowWord = word(_packetBuffer[42], _packetBuffer[43]);
     // combine the four bytes (two words) into a long integer
@@ -99,6 +151,15 @@ bool ntp_forceUpdate(unsigned int serverPort) {
     _currentMilliseconds = (fracSeconds * 1000ULL) >> 32;
 
     _currentEpoc = secsSince1900 - SEVENZYYEARS;
+
+    // Offset: server time at reception (T3 + half the delay) against the local clock
+    if (hadTime) {
+        int64_t serverMs = (int64_t)_currentEpoc * 1000 + _currentMilliseconds + _lastDelayUs / 2000;
+        int64_t offsetUs = (serverMs - localMs) * 1000;
+        if (offsetUs > INT32_MAX) offsetUs = INT32_MAX;
+        if (offsetUs < INT32_MIN) offsetUs = INT32_MIN;
+        _lastOffsetUs = (int32_t)offsetUs;
+    }
     
     return true;  // return true after successful update
 }
@@ -109,26 +170,30 @@ bool ntp_update() {
         ntp_ok = false;
         return false;
     }
-    if ((millis() - _lastUpdate >= _updateInterval) || _lastUpdate == 0) {
+    if ((millis() - _lastUpdate >= _updateInterval) || _lastUpdate == 0 || _updateRequested) {
+        _updateRequested = false;
+        // One consistent set of values for the whole update, even if the
+        // web server publishes new settings meanwhile
+        SettingsSnapshot config = settings.get();
         
-        _timeOffset=settings.ntp.timeOffset;
-        _port=settings.ntp.port;
+        _timeOffset=config->ntp.timeOffset;
+        _port=config->ntp.port;
         if (!_udpSetup || _port != NTP_DEFAULT_LOCAL_PORT) ntp_begin(_port); // setup the UDP client if needed
 
         // Try primary NTP server first
-        _poolServerName=settings.ntp.server;
-        // Serial.printf("NTP: Trying primary server: %s:%d\n", _poolServerName.c_str(), settings.ntp.port);
-        if (ntp_forceUpdate(settings.ntp.port)) {
+        _poolServerName=config->ntp.server;
+        // Serial.printf("NTP: Trying primary server: %s:%d\n", _poolServerName.c_str(), config->ntp.port);
+        if (ntp_query(0, config->ntp.port)) {
             _ntp_counter++;
             ntp_ok=true;
             return true;
         }
 
         // If primary fails and secondary server is configured, try secondary
-        if (settings.ntp.server2.length() > 0 && settings.ntp.server2 != settings.ntp.server) {
-            _poolServerName=settings.ntp.server2;
-            // Serial.printf("NTP: Primary failed, trying secondary server: %s:%d\n", _poolServerName.c_str(), settings.ntp.port2);
-            if (ntp_forceUpdate(settings.ntp.port2)) {
+        if (config->ntp.server2[0] != 0 && strcmp(config->ntp.server2, config->ntp.server) != 0) {
+            _poolServerName=config->ntp.server2;
+            // Serial.printf("NTP: Primary failed, trying secondary server: %s:%d\n", _poolServerName.c_str(), config->ntp.port2);
+            if (ntp_query(1, config->ntp.port2)) {
                 _ntp_counter++;
                 // Serial.println("NTP: Secondary server successful");
                 ntp_ok=true;
@@ -144,15 +209,23 @@ bool ntp_update() {
     return false;   // return false if update does not occur
 }
 
+void ntp_request_update() {
+    _updateRequested = true;
+}
+
 bool ntp_isTimeSet() {
     return (_lastUpdate != 0); // returns true if the time has been set, else false
 }
 
 unsigned long ntp_getEpochTime() {
-    _timeOffset=settings.ntp.timeOffset;
-    return (_timeOffset *3600) + // User offset
+    _timeOffset=settings.get()->ntp.timeOffset;
+    return ntp_getEpochTimeAt(millis(), _timeOffset);
+}
+
+unsigned long ntp_getEpochTimeAt(unsigned long at_ms, int offset_hours) {
+    return (offset_hours *3600) + // User offset
            _currentEpoc + // Epoch returned by the NTP server
-           ((millis() - _lastUpdate) / 1000); // Time since last update
+           ((long)(at_ms - _lastUpdate) / 1000); // Time since last update
 }
 
 
@@ -177,8 +250,13 @@ String ntp_getCurrentServer() {
 }
 
 NTPTime ntp_get_time() {
+    _timeOffset=settings.get()->ntp.timeOffset;
+    return ntp_get_time_at(millis(), _timeOffset);
+}
+
+NTPTime ntp_get_time_at(unsigned long at_ms, int offset_hours) {
     NTPTime timeStruct = {0}; // Initialize to zero
-    unsigned long epochTime = ntp_getEpochTime();
+    unsigned long epochTime = ntp_getEpochTimeAt(at_ms, offset_hours);
     // Extract seconds, minutes, hours
     timeStruct.second = epochTime % 60;
     unsigned long remainingSeconds = epochTime / 60; // Minutes + hours + days
@@ -216,17 +294,52 @@ void init_ntp() {
     ntpUDP = new WiFiUDP();
 
     // Set NTP server, port, and time offset from settings
-    _poolServerName = settings.ntp.server;
-    _serverPort = settings.ntp.port;
-    _timeOffset = settings.ntp.timeOffset;
-
-    Serial.printf("NTP Primary Server: %s:%d\n", settings.ntp.server.c_str(), settings.ntp.port);
-    if (settings.ntp.server2.length() > 0) {
-        Serial.printf("NTP Secondary Server: %s:%d\n", settings.ntp.server2.c_str(), settings.ntp.port2);
+    SettingsSnapshot config = settings.get();
+    _poolServerName = config->ntp.server;
+    _serverPort = config->ntp.port;
+    _timeOffset = config->ntp.timeOffset;
+
+    Serial.printf("NTP Primary Server: %s:%d\n", config->ntp.server, config->ntp.port);
+    if (config->ntp.server2[0] != 0) {
+        Serial.printf("NTP Secondary Server: %s:%d\n", config->ntp.server2, config->ntp.port2);
     } else {
         Serial.println("NTP Secondary Server: Not configured");
     }
     Serial.printf("NTP Time Offset: %d hours\n", _timeOffset);
     ntp_begin();
     ntp_setUpdateInterval(60000);
-}
\ No newline at end of file
+}
+
+static void collect_requests(MetricsWriter& out, const char* name) {
+    for (int i = 0; i < 2; i++) out.sample(name, "server", SERVER_LABELS[i], _serverStats[i].requests);
+}
+
+static void collect_successes(MetricsWriter& out, const char* name) {
+    for (int i = 0; i < 2; i++) out.sample(name, "server", SERVER_LABELS[i], _serverStats[i].successes);
+}
+
+static void collect_timeouts(MetricsWriter& out, const char* name) {
+    for (int i = 0; i < 2; i++) out.sample(name, "server", SERVER_LABELS[i], _serverStats[i].timeouts);
+}
+
+static void collect_offset(MetricsWriter& out, const char* name) {
+    out.sample(name, _lastOffsetUs);
+}
+
+static void collect_delay(MetricsWriter& out, const char* name) {
+    out.sample(name, _lastDelayUs);
+}
+
+static const MetricFamily NTP_METRICS[] = {
+    {"irigb_ntp_requests_total", "NTP requests sent", MetricType::COUNTER, collect_requests},
+    {"irigb_ntp_successes_total", "NTP requests answered", MetricType::COUNTER, collect_successes},
+    {"irigb_ntp_timeouts_total", "NTP requests without an answer within 1 s", MetricType::COUNTER, collect_timeouts},
+    {"irigb_ntp_offset_microseconds", "Server minus local time at the last update", MetricType::GAUGE, collect_offset},
+    {"irigb_ntp_delay_microseconds", "Round trip delay of the last update", MetricType::GAUGE, collect_delay},
+};
+
+void ntp_register_metrics() {
+    for (size_t i = 0; i < sizeof(NTP_METRICS) / sizeof(NTP_METRICS[0]); i++) {
+        metrics_register(&NTP_METRICS[i]);
+    }
+}
@@ -21,16 +21,28 @@ struct NTPTime {
 void ntp_begin();
 void ntp_begin(unsigned int port);
 bool ntp_update();
+// Make the next ntp_update() query the servers regardless of the interval
+void ntp_request_update();
 bool ntp_forceUpdate(unsigned int serverPort);
 bool ntp_isTimeSet();
 unsigned long ntp_getEpochTime();
 NTPTime ntp_get_time();
+// The same at a millis() close to now, earlier or later, with the given
+// offset rather than the one in the settings
+unsigned long ntp_getEpochTimeAt(unsigned long at_ms, int offset_hours);
+NTPTime ntp_get_time_at(unsigned long at_ms, int offset_hours);
 String ntp_getCurrentServer();
 void ntp_setTimeOffset(int timeOffset);
 void ntp_setUpdateInterval(unsigned long updateInterval);
 void ntp_end();
 int ntp_counter();
 void ntp_reset_counter();
+// Server minus local time at the last update, in microseconds
+int32_t ntp_last_offset_us();
+// Network round trip of the last update, in microseconds
+uint32_t ntp_last_delay_us();
+// Add the NTP client counters to the /metrics registry
+void ntp_register_metrics();
 // Initialization function
 void init_ntp();
 
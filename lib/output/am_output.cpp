@@ -0,0 +1,130 @@
+#include "am_output.h"
+
+static portMUX_TYPE _am_mux = portMUX_INITIALIZER_UNLOCKED;
+
+AmOutput::AmOutput(uint8_t pin)
+    : pin(pin), synth(AM_SAMPLE_RATE, AM_AMPLITUDE), next_ready(false), block_offset(0), adjust(0), phase_error_us(0) {
+  // Markers only until the first encode()
+  IrigTime midnight = {0, 0, 0, 1, 0};
+  irig_frame_encoder(IRIG_FORMAT_DEFAULT)(midnight, 0, TimeQuality::FAULT, ContinuousTimeQuality::ERROR_GT_10_MS, current);
+  memcpy(next, current, sizeof(next));
+}
+
+void AmOutput::encode(const IrigTime& time, int offset_hours, IrigFormat format) {
+  bool bits[IRIG_FRAME_BITS];
+  irig_frame_encoder(format)(time, offset_hours, TimeQuality::WITHIN_1_US, ContinuousTimeQuality::NOT_USED, bits);
+  portENTER_CRITICAL_SAFE(&_am_mux);
+  memcpy(next, bits, sizeof(next));
+  next_ready = true;
+  portEXIT_CRITICAL_SAFE(&_am_mux);
+}
+
+// The I2S stream is device only, the native tests build the encoding above
+#ifdef ARDUINO
+
+#include "timebase.h"
+#include <driver/i2s.h>
+#include "task_config.h"
+
+bool AmOutput::begin() {
+  i2s_config_t config = {};
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_PDM);
+  config.sample_rate = synth.sampleRate();
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  config.dma_buf_count = AM_DMA_BUFFERS;
+  config.dma_buf_len = AM_DMA_SAMPLES;
+  config.tx_desc_auto_clear = true;   // Silence rather than a repeated block if the task stalls
+  if (i2s_driver_install(I2S_NUM_0, &config, 0, nullptr) != ESP_OK) {
+    Serial.println("AM output: I2S driver install failed");
+    return false;
+  }
+
+  // Only the PDM data line is needed, the RC filter ignores the clock
+  i2s_pin_config_t pins = {};
+  pins.mck_io_num = I2S_PIN_NO_CHANGE;
+  pins.bck_io_num = I2S_PIN_NO_CHANGE;
+  pins.ws_io_num = I2S_PIN_NO_CHANGE;
+  pins.data_out_num = pin;
+  pins.data_in_num = I2S_PIN_NO_CHANGE;
+  if (i2s_set_pin(I2S_NUM_0, &pins) != ESP_OK) {
+    Serial.println("AM output: I2S pin setup failed");
+    i2s_driver_uninstall(I2S_NUM_0);
+    return false;
+  }
+
+  if (xTaskCreatePinnedToCore(streamTask, "am_output", 4096, this, TASK_AM_OUTPUT_PRIORITY, nullptr,
+                              TASK_CORE_OUTPUT) != pdPASS) {
+    Serial.println("AM output: task creation failed");
+    i2s_driver_uninstall(I2S_NUM_0);
+    return false;
+  }
+  Serial.printf("AM output on GPIO %u, %u Hz PDM\n", pin, synth.sampleRate());
+  return true;
+}
+
+void AmOutput::streamTask(void* param) {
+  static_cast<AmOutput*>(param)->stream();
+}
+
+void AmOutput::fillBlock() {
+  block_offset = synth.position();
+  size_t filled = 0;
+  while (filled < AM_DMA_SAMPLES) {
+    size_t n = synth.render(block + filled, AM_DMA_SAMPLES - filled);
+    if (n > 0) {
+      filled += n;
+      continue;
+    }
+    // Frame complete: the next one takes the latest encoded time, or repeats
+    portENTER_CRITICAL(&_am_mux);
+    if (next_ready) {
+      memcpy(current, next, sizeof(current));
+      next_ready = false;
+    }
+    portEXIT_CRITICAL(&_am_mux);
+    synth.beginFrame(current, adjust);
+    adjust = 0;
+    if (filled == 0) {
+      block_offset = 0;
+    }
+  }
+}
+
+void AmOutput::stream() {
+  // Start rendering on a frame start, the measurement below does the rest
+  uint32_t first, frame, start_us;
+  timebase_last_frame(first, start_us);
+  do {
+    delay(1);
+    timebase_last_frame(frame, start_us);
+  } while (frame == first);
+  synth.beginFrame(current, 0);
+
+  const uint32_t queue_us = (uint64_t)(AM_DMA_BUFFERS - 1) * AM_DMA_SAMPLES * 1000000ULL / synth.sampleRate();
+  uint32_t blocks = 0;
+  for (;;) {
+    fillBlock();
+    size_t written;
+    i2s_write(I2S_NUM_0, block, sizeof(block), &written, portMAX_DELAY);
+
+    // Once the buffers are full every write waits for one to drain, so the
+    // block just queued plays after the other buffers
+    if (++blocks <= AM_DMA_BUFFERS) {
+      continue;
+    }
+    uint32_t play_us = micros() + queue_us;
+    timebase_last_frame(frame, start_us);
+    uint32_t due_us = start_us + (uint64_t)block_offset * 1000000ULL / synth.sampleRate();
+    int32_t error_us = (int32_t)(play_us - due_us);
+    // The block may belong to the frame after the last one started
+    while (error_us > 500000) error_us -= 1000000;
+    while (error_us < -500000) error_us += 1000000;
+    phase_error_us = error_us;
+    // Late blocks drop samples at the end of the frame, early ones add silence
+    adjust = -(int32_t)((int64_t)error_us * (int32_t)synth.sampleRate() / 1000000);
+  }
+}
+
+#endif // ARDUINO
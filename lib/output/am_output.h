@@ -0,0 +1,50 @@
+#ifndef AM_OUTPUT_H
+#define AM_OUTPUT_H
+
+#include <Arduino.h>
+#include "irig_am.h"
+#include "irig_encoder.h"
+
+// IRIG-B12x output. The ESP32-S3 has no DAC, so I2S0 runs as a PDM
+// transmitter and an RC low-pass after the pin leaves the analog carrier.
+// A task renders the samples with IrigAmSynth into the DMA buffers; the CPU
+// only touches whole 10 ms blocks. Each block is timed against the output
+// frame starts of the timebase and the difference is taken out at the end
+// of the next frame, so the carrier stays phase coherent with the second.
+
+#define AM_SAMPLE_RATE 48000
+#define AM_AMPLITUDE 30000
+#define AM_DMA_BUFFERS 4
+#define AM_DMA_SAMPLES 480   // One element per DMA buffer
+
+class AmOutput {
+public:
+  AmOutput(uint8_t pin);
+
+  // Install the I2S driver on 'pin' and start streaming
+  bool begin();
+
+  // Next frame, like IRIGB::encodeTimeIntoBits, from the encoder task of
+  // the output engine
+  void encode(const IrigTime& time, int offset_hours, IrigFormat format);
+
+  // Carrier lateness against the output frames at the last block, in us
+  int32_t phaseErrorUs() const { return phase_error_us; }
+
+private:
+  static void streamTask(void* param);
+  void stream();
+  void fillBlock();
+
+  uint8_t pin;
+  IrigAmSynth synth;
+  bool next[IRIG_FRAME_BITS];      // Latest encode(), guarded by a spinlock
+  bool current[IRIG_FRAME_BITS];   // Frame being rendered
+  volatile bool next_ready;
+  int16_t block[AM_DMA_SAMPLES];
+  uint32_t block_offset;           // Frame position of the first sample of 'block'
+  int32_t adjust;                  // Samples for the end of the frame being rendered
+  volatile int32_t phase_error_us;
+};
+
+#endif // AM_OUTPUT_H
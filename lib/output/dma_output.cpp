@@ -0,0 +1,134 @@
+// Device only, the native tests build the rest of this library
+#ifdef ARDUINO
+
+#include "dma_output.h"
+#include <esp_heap_caps.h>
+#include <soc/lcd_cam_struct.h>
+#include "task_config.h"
+
+// The i80 driver divides its 160 MHz source by 2 and the pixel clock by at
+// most 64, 1.25 MHz at the slowest. It is created for that and the source
+// divider is then raised from 2 to 250 for the 10 kHz sample rate.
+#define DMA_OUTPUT_DRIVER_PCLK_HZ 1250000
+#define DMA_OUTPUT_SOURCE_DIVIDER 250
+
+DmaOutput::DmaOutput(OutputEngine& engine, const uint8_t* pins, uint8_t wr_pin, uint8_t dc_pin)
+    : engine(engine), pins(pins), wr_pin(wr_pin), dc_pin(dc_pin), hook(nullptr), available(nullptr), io(nullptr),
+      task(nullptr), playing(0), frames(0), late_frames(0) {
+  for (uint8_t i = 0; i < DMA_OUTPUT_BUFFERS; i++) {
+    buffers[i] = nullptr;
+    running[i] = false;
+  }
+}
+
+bool DmaOutput::begin(OutputFrameHook hook, const volatile bool* available) {
+  this->hook = hook;
+  this->available = available;
+  for (uint8_t i = 0; i < DMA_OUTPUT_BUFFERS; i++) {
+    buffers[i] = (uint8_t*)heap_caps_malloc(DMA_OUTPUT_FRAME_BYTES, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!buffers[i]) {
+      Serial.println("DMA output: no memory for the frame buffers");
+      return false;
+    }
+  }
+
+  esp_lcd_i80_bus_config_t bus_config = {};
+  bus_config.dc_gpio_num = dc_pin;
+  bus_config.wr_gpio_num = wr_pin;
+  bus_config.clk_src = LCD_CLK_SRC_PLL160M;
+  for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+    bus_config.data_gpio_nums[i] = pins[i];
+  }
+  bus_config.bus_width = IRIG_CHANNELS;
+  bus_config.max_transfer_bytes = DMA_OUTPUT_FRAME_BYTES;
+  esp_lcd_i80_bus_handle_t bus = nullptr;
+  if (esp_lcd_new_i80_bus(&bus_config, &bus) != ESP_OK) {
+    Serial.println("DMA output: i80 bus setup failed");
+    return false;
+  }
+
+  esp_lcd_panel_io_i80_config_t io_config = {};
+  io_config.cs_gpio_num = -1;
+  io_config.pclk_hz = DMA_OUTPUT_DRIVER_PCLK_HZ;
+  io_config.trans_queue_depth = DMA_OUTPUT_BUFFERS;
+  io_config.on_color_trans_done = transferDone;
+  io_config.user_ctx = this;
+  io_config.lcd_cmd_bits = 8;
+  io_config.lcd_param_bits = 8;
+  if (esp_lcd_new_panel_io_i80(bus, &io_config, &io) != ESP_OK) {
+    Serial.println("DMA output: i80 panel IO setup failed");
+    esp_lcd_del_i80_bus(bus);
+    return false;
+  }
+  LCD_CAM.lcd_clock.lcd_clkm_div_num = DMA_OUTPUT_SOURCE_DIVIDER;
+  LCD_CAM.lcd_clock.lcd_clkm_div_a = 0;
+  LCD_CAM.lcd_clock.lcd_clkm_div_b = 0;
+
+  if (xTaskCreatePinnedToCore(renderTask, "dma_output", 4096, this, TASK_OUTPUT_RENDER_PRIORITY, &task,
+                              TASK_CORE_OUTPUT) != pdPASS) {
+    Serial.println("DMA output: task creation failed");
+    return false;
+  }
+
+  // Two idle frames to start with, the task keeps one queued behind the
+  // other. They are frames 0 and 1, the frame counter follows the timebase.
+  for (uint8_t i = 0; i < DMA_OUTPUT_BUFFERS; i++) {
+    running[i] = false;
+    engine.render(buffers[i], DMA_OUTPUT_REPEAT, false, i);
+    if (!queue(i)) {
+      Serial.println("DMA output: queueing the first frames failed");
+      return false;
+    }
+  }
+  Serial.printf("DMA output at %u Hz, WR on GPIO %u, DC on GPIO %u\n",
+                1000 * DMA_OUTPUT_REPEAT, wr_pin, dc_pin);
+  return true;
+}
+
+bool DmaOutput::queue(uint8_t index) {
+  // The command phase sends the last sample of the frame before, which is
+  // always at its idle levels, so the stream stays one sample per pixel clock
+  uint8_t previous = buffers[index ^ 1][DMA_OUTPUT_FRAME_BYTES - 1];
+  return esp_lcd_panel_io_tx_color(io, previous, buffers[index], DMA_OUTPUT_FRAME_BYTES - 1) == ESP_OK;
+}
+
+bool IRAM_ATTR DmaOutput::transferDone(esp_lcd_panel_io_handle_t io, void* user_ctx, void* event_data) {
+  DmaOutput* self = static_cast<DmaOutput*>(user_ctx);
+  // The next frame is on the bus already: its command byte, then the
+  // rendered frame which starts IRIG_RENDER_LEAD_US ahead of the frame
+  uint8_t next = self->playing ^ 1;
+  self->playing = next;
+  self->frames++;
+  self->hook(micros() + DMA_OUTPUT_SAMPLE_US + IRIG_RENDER_LEAD_US, self->running[next]);
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(self->task, &woken);
+  return woken == pdTRUE;
+}
+
+void DmaOutput::renderTask(void* param) {
+  static_cast<DmaOutput*>(param)->stream();
+}
+
+void DmaOutput::stream() {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uint32_t started = frames;
+    // The frame that just ended frees its buffer. Rendering the next one
+    // late in the frame picks up the last encoded time and configuration,
+    // like the timer path which swaps at the frame end.
+    uint8_t next = playing ^ 1;
+    vTaskDelay(pdMS_TO_TICKS(1000 - DMA_OUTPUT_LEAD_MS));
+    running[next] = *available;
+    engine.render(buffers[next], DMA_OUTPUT_REPEAT, running[next], started + 1);
+    if (!queue(next)) {
+      Serial.println("DMA output: queueing a frame failed");
+    }
+    // The bus ran dry and holds the idle levels until the frame queued now
+    if (frames != started) {
+      late_frames++;
+      Serial.printf("DMA output: frame %u queued late\n", (unsigned)started);
+    }
+  }
+}
+
+#endif // ARDUINO
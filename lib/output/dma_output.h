@@ -0,0 +1,56 @@
+#ifndef DMA_OUTPUT_H
+#define DMA_OUTPUT_H
+
+#include <Arduino.h>
+#include <esp_lcd_panel_io.h>
+#include "output.h"
+#include "irig_render.h"
+
+// IRIG-B outputs without the 2 kHz timer interrupt. The LCD_CAM i80 bus
+// drives P1..P8 as one 8 bit parallel port and its DMA streams whole frames
+// rendered by OutputEngine::render(), so every edge of every channel comes
+// from the pixel clock. A task renders the next frame shortly before the
+// current one ends; the CPU is not involved in between.
+
+#define DMA_OUTPUT_REPEAT 10       // Samples per 1 ms tick (10 kHz pixel clock)
+#define DMA_OUTPUT_SAMPLE_US (1000 / DMA_OUTPUT_REPEAT)
+#define DMA_OUTPUT_FRAME_BYTES (IRIG_FRAME_TICKS * DMA_OUTPUT_REPEAT)
+#define DMA_OUTPUT_BUFFERS 2
+#define DMA_OUTPUT_LEAD_MS 50      // Render the next frame this long before it starts
+
+class DmaOutput {
+public:
+  // pins[i] is the pin of channel i; the bus also needs a write strobe and a
+  // data/command pin, both on otherwise unused pads
+  DmaOutput(OutputEngine& engine, const uint8_t* pins, uint8_t wr_pin, uint8_t dc_pin);
+
+  // Set up the bus and start streaming idle frames. A frame renders the
+  // channels while *available is set, like the timer path does.
+  bool begin(OutputFrameHook hook, const volatile bool* available);
+
+  // Frames rendered after they should have started
+  uint32_t lateFrames() const { return late_frames; }
+
+private:
+  static bool IRAM_ATTR transferDone(esp_lcd_panel_io_handle_t io, void* user_ctx, void* event_data);
+  static void renderTask(void* param);
+  void stream();
+  bool queue(uint8_t index);
+
+  OutputEngine& engine;
+  const uint8_t* pins;
+  uint8_t wr_pin;
+  uint8_t dc_pin;
+  OutputFrameHook hook;
+  const volatile bool* available;
+
+  esp_lcd_panel_io_handle_t io;
+  TaskHandle_t task;
+  uint8_t* buffers[DMA_OUTPUT_BUFFERS];
+  volatile bool running[DMA_OUTPUT_BUFFERS];   // Frame in each buffer carries the channels
+  volatile uint8_t playing;        // Buffer on the pins
+  volatile uint32_t frames;        // Frame starts seen by transferDone
+  volatile uint32_t late_frames;
+};
+
+#endif // DMA_OUTPUT_H
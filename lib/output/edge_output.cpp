@@ -0,0 +1,145 @@
+// Device only, the native tests build the rest of this library
+#ifdef ARDUINO
+
+#include "edge_output.h"
+#include "task_config.h"
+
+EdgeOutput::EdgeOutput(OutputEngine& engine, const uint8_t* pins)
+    : engine(engine), pins(pins), hook(nullptr), available(nullptr), latency(nullptr), task(nullptr),
+      micros_offset(0), list(nullptr), count(0), next_edge(0), levels(0), frame_start(0), alarm_at(0),
+      frames(0), late_frames(0) {
+  for (uint8_t i = 0; i < 2; i++) {
+    edge_count[i] = 0;
+    frame_of[i] = 0;
+    running[i] = false;
+  }
+  idle_edge.offset_us = 0;
+  idle_edge.levels = 0;
+}
+
+bool EdgeOutput::begin(OutputFrameHook hook, const volatile bool* available, LatencyHistogram* latency) {
+  this->hook = hook;
+  this->available = available;
+  this->latency = latency;
+
+  // Idle frames to start with: frame n plays from buffer n & 1
+  for (uint32_t frame = 1; frame <= 2; frame++) {
+    uint8_t buffer = frame & 1;
+    running[buffer] = false;
+    edge_count[buffer] = engine.renderEdges(edges[buffer], false, frame);
+    frame_of[buffer] = frame;
+  }
+
+  if (xTaskCreatePinnedToCore(renderTask, "edge_output", 4096, this, TASK_OUTPUT_RENDER_PRIORITY, &task,
+                              TASK_CORE_OUTPUT) != pdPASS) {
+    Serial.println("Edge output: task creation failed");
+    return false;
+  }
+
+  // 1 MHz count up without reload: alarms are absolute times, so interrupt
+  // latency never accumulates into the edge times
+  timer_config_t config = {};
+  config.divider = 80;
+  config.counter_dir = TIMER_COUNT_UP;
+  config.counter_en = TIMER_PAUSE;
+  config.alarm_en = TIMER_ALARM_EN;
+  config.auto_reload = TIMER_AUTORELOAD_DIS;
+  config.intr_type = TIMER_INTR_LEVEL;
+  frame_start = EDGE_OUTPUT_START_US;
+  alarm_at = frame_start;
+  if (timer_init(EDGE_OUTPUT_TIMER_GROUP, EDGE_OUTPUT_TIMER, &config) != ESP_OK ||
+      timer_set_counter_value(EDGE_OUTPUT_TIMER_GROUP, EDGE_OUTPUT_TIMER, 0) != ESP_OK ||
+      timer_set_alarm_value(EDGE_OUTPUT_TIMER_GROUP, EDGE_OUTPUT_TIMER, alarm_at) != ESP_OK ||
+      timer_isr_callback_add(EDGE_OUTPUT_TIMER_GROUP, EDGE_OUTPUT_TIMER, onAlarm, this, ESP_INTR_FLAG_IRAM) != ESP_OK) {
+    Serial.println("Edge output: timer setup failed");
+    return false;
+  }
+  // Both count microseconds from the same crystal, so one offset maps the
+  // timer onto micros() for the timebase
+  micros_offset = micros();
+  timer_start(EDGE_OUTPUT_TIMER_GROUP, EDGE_OUTPUT_TIMER);
+  Serial.println("Edge output: timer compare per edge");
+  return true;
+}
+
+bool IRAM_ATTR EdgeOutput::onAlarm(void* param) {
+  return static_cast<EdgeOutput*>(param)->alarm();
+}
+
+void IRAM_ATTR EdgeOutput::writeLevels(uint8_t next) {
+  // Every pin at a frame start, so levels written outside (begin()) are
+  // never taken for the current ones
+  uint8_t changed = next_edge == 0 ? 0xFF : next ^ levels;
+  for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+    if (changed & (1 << i)) {
+      fast_gpio_write(pins[i], (next >> i) & 1);
+    }
+  }
+  levels = next;
+}
+
+bool IRAM_ATTR EdgeOutput::alarm() {
+  uint64_t now = timer_group_get_counter_value_in_isr(EDGE_OUTPUT_TIMER_GROUP, EDGE_OUTPUT_TIMER);
+  latency->record((uint32_t)(now - alarm_at));
+
+  bool frame_started = next_edge == 0;
+  bool frame_running = false;
+  if (frame_started) {
+    // The list rendered for this frame, or the idle levels if there is none
+    uint32_t frame = frames + 1;
+    uint8_t buffer = frame & 1;
+    if (frame_of[buffer] == frame) {
+      list = edges[buffer];
+      count = edge_count[buffer];
+      frame_running = running[buffer];
+    } else {
+      idle_edge.levels = levels;
+      list = &idle_edge;
+      count = 1;
+      late_frames++;
+    }
+    frames = frame;
+  }
+
+  writeLevels(list[next_edge].levels);
+
+  BaseType_t woken = pdFALSE;
+  if (frame_started) {
+    // The rendered frame leads the frame start, so the hook runs that early
+    hook(micros_offset + (uint32_t)frame_start + IRIG_RENDER_LEAD_US, frame_running);
+    vTaskNotifyGiveFromISR(task, &woken);
+  }
+
+  if (++next_edge >= count) {
+    next_edge = 0;
+    frame_start += EDGE_OUTPUT_FRAME_US;
+    alarm_at = frame_start;
+  } else {
+    alarm_at = frame_start + list[next_edge].offset_us;
+  }
+  timer_group_set_alarm_value_in_isr(EDGE_OUTPUT_TIMER_GROUP, EDGE_OUTPUT_TIMER, alarm_at);
+  return woken == pdTRUE;
+}
+
+void EdgeOutput::renderTask(void* param) {
+  static_cast<EdgeOutput*>(param)->stream();
+}
+
+void EdgeOutput::stream() {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    // Rendering late in the frame picks up the last encoded time and
+    // configuration, like the timer path which swaps at the frame end
+    uint32_t frame = frames + 1;
+    uint8_t buffer = frame & 1;
+    vTaskDelay(pdMS_TO_TICKS(EDGE_OUTPUT_FRAME_US / 1000 - EDGE_OUTPUT_LEAD_MS));
+    running[buffer] = *available;
+    edge_count[buffer] = engine.renderEdges(edges[buffer], running[buffer], frame);
+    frame_of[buffer] = frame;
+    if (frames >= frame) {
+      Serial.printf("Edge output: frame %u rendered late, sent idle\n", (unsigned)frame);
+    }
+  }
+}
+
+#endif // ARDUINO
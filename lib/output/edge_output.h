@@ -0,0 +1,70 @@
+#ifndef EDGE_OUTPUT_H
+#define EDGE_OUTPUT_H
+
+#include <Arduino.h>
+#include <driver/timer.h>
+#include "output.h"
+#include "metrics.h"
+#include "irig_render.h"
+
+// IRIG-B outputs with one interrupt per edge instead of a 2 kHz tick. A
+// free-running 1 MHz timer group counter is compared against the time of
+// the next edge from the frame's edge list (OutputEngine::renderEdges), so
+// each edge is placed to the microsecond and the CPU only runs when a level
+// changes, about 200 times a second. A task renders the list of the next
+// frame shortly before the current one ends.
+
+#define EDGE_OUTPUT_TIMER_GROUP TIMER_GROUP_1
+#define EDGE_OUTPUT_TIMER TIMER_0
+#define EDGE_OUTPUT_FRAME_US 1000000
+#define EDGE_OUTPUT_LEAD_MS 50     // Render the next frame this long before it starts
+#define EDGE_OUTPUT_START_US 10000 // From begin() to the first frame
+
+class EdgeOutput {
+public:
+  // pins[i] is the pin of channel i, in DRAM as the interrupt reads it
+  EdgeOutput(OutputEngine& engine, const uint8_t* pins);
+
+  // Set up the timer and start with idle frames. A frame renders the
+  // channels while *available is set, like the timer path does. The delay
+  // from each compare to the interrupt goes to 'latency'.
+  bool begin(OutputFrameHook hook, const volatile bool* available, LatencyHistogram* latency);
+
+  // Frames that were not rendered in time and went out idle
+  uint32_t lateFrames() const { return late_frames; }
+
+private:
+  static bool IRAM_ATTR onAlarm(void* param);
+  bool IRAM_ATTR alarm();
+  void IRAM_ATTR writeLevels(uint8_t next);
+  static void renderTask(void* param);
+  void stream();
+
+  OutputEngine& engine;
+  const uint8_t* pins;
+  OutputFrameHook hook;
+  const volatile bool* available;
+  LatencyHistogram* latency;
+  TaskHandle_t task;
+  uint32_t micros_offset;        // micros() minus the timer count
+
+  // Double buffered edge lists; the task fills one for frame 'frame_of'
+  // while the interrupt walks the other
+  IrigEdge edges[2][IRIG_FRAME_EDGES_MAX];
+  volatile uint16_t edge_count[2];
+  volatile uint32_t frame_of[2];
+  volatile bool running[2];
+  IrigEdge idle_edge;            // Stands in for a list that was not ready
+
+  // Owned by the interrupt
+  const IrigEdge* list;
+  uint16_t count;
+  uint16_t next_edge;
+  uint8_t levels;                // On the pins
+  uint64_t frame_start;          // Timer count of the start of the rendered frame
+  uint64_t alarm_at;
+  volatile uint32_t frames;      // Frame starts so far
+  volatile uint32_t late_frames;
+};
+
+#endif // EDGE_OUTPUT_H
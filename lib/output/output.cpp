@@ -0,0 +1,307 @@
+#include "output.h"
+#include "task_config.h"
+
+// Guards the staged configuration and the clock between configure()/encode()
+// and the timer
+static portMUX_TYPE _output_mux = portMUX_INITIALIZER_UNLOCKED;
+
+OutputEngine::OutputEngine(IRIGB* const* channels)
+    : channels(channels), reserved(0), staged_sequence(0), config_applied(0), config_applied_frame(0),
+      active_count(0), active_mask(0), idle_levels(0), rendering(false), rendered_running(false), clock_offset(0), clock_frame(0), clock_valid(false),
+      supplied_frame(0), encode_sequence(0), encode_pending(false), encoder(nullptr), holdover_frames(0), time_steps(0), am(nullptr), am_channel(0) {
+  // Nothing runs until the first configure()
+  memset(staged, 0, sizeof(staged));
+  memset(encoded, 0, sizeof(encoded));
+  memset(encoded_sequence, 0, sizeof(encoded_sequence));
+  memset(applied, 0, sizeof(applied));
+  memset(applied_sequence, 0, sizeof(applied_sequence));
+  memset(advance_us, 0, sizeof(advance_us));
+  memset(frames_started, 0, sizeof(frames_started));
+  memset(&clock_local, 0, sizeof(clock_local));
+  memset(&clock_utc, 0, sizeof(clock_utc));
+}
+
+bool OutputEngine::begin(uint8_t reserved) {
+  this->reserved = reserved;
+  for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+    if (!(reserved & (1 << i))) {
+      channels[i]->begin();
+    }
+  }
+  if (xTaskCreatePinnedToCore(encoderTask, "output_encode", 4096, this, TASK_OUTPUT_ENCODE_PRIORITY, &encoder,
+                              TASK_CORE_OUTPUT) != pdPASS) {
+    Serial.println("Output: encoder task creation failed");
+    encoder = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void OutputEngine::encoderTask(void* param) {
+  OutputEngine* engine = static_cast<OutputEngine*>(param);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    engine->encodeFrame();
+  }
+}
+
+uint32_t OutputEngine::configure(const ChannelConfig* config) {
+  portENTER_CRITICAL(&_output_mux);
+  memcpy(staged, config, sizeof(staged));
+  uint32_t sequence = ++staged_sequence;
+  portEXIT_CRITICAL(&_output_mux);
+  return sequence;
+}
+
+void OutputEngine::wakeEncoder() {
+  // Without the task (hosts) the caller encodes
+  if (encoder) {
+    xTaskNotifyGive(encoder);
+  } else {
+    encodeFrame();
+  }
+}
+
+void IRAM_ATTR OutputEngine::applyConfig(uint32_t frame, bool running) {
+  // A running frame takes the configuration its bits were encoded with, an
+  // idle one has no bits to match and takes the staged one at once
+  bool follow = running && clock_valid;
+  uint8_t count = 0;
+  uint8_t mask = 0;
+  uint8_t idle = 0;
+  uint32_t oldest = staged_sequence;
+  for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+    if (reserved & (1 << i)) {
+      continue;
+    }
+    IRIGB* channel = channels[i];
+    // A stopped channel restarts with the frame encoded since if that one
+    // has it enabled, and otherwise takes its configuration without a frame
+    // on the pins. Buffers left from before a change never undo it.
+    uint8_t buffer = channel->buffer();
+    if (follow && !applied[i].enabled && (int32_t)(encoded_sequence[i][buffer ^ 1] - applied_sequence[i]) > 0) {
+      if (encoded[i][buffer ^ 1].enabled) {
+        channel->resume();
+        buffer = channel->buffer();
+      } else {
+        buffer ^= 1;
+      }
+    }
+    const ChannelConfig& next = follow ? encoded[i][buffer] : staged[i];
+    uint32_t sequence = follow ? encoded_sequence[i][buffer] : staged_sequence;
+
+    if ((int32_t)(sequence - applied_sequence[i]) > 0) {
+      advance_us[i] = next.advance_us;
+      channel->setInverted(next.invert);
+      // Every channel ends a frame on its idle level, so switching it here
+      // never cuts a pulse. Rendered frames carry the idle levels themselves.
+      if (!rendering && ((applied[i].enabled && !next.enabled) || applied[i].invert != next.invert)) {
+        channel->idle();
+      }
+      if (!follow && next.enabled && !applied[i].enabled) {
+        channel->resume();
+      }
+      applied[i] = next;
+      applied_sequence[i] = sequence;
+    }
+    if (applied[i].invert) {
+      idle |= 1 << i;
+    }
+    if (applied[i].enabled) {
+      active[count++] = i;
+      mask |= 1 << i;
+    }
+    if ((int32_t)(applied_sequence[i] - oldest) < 0) {
+      oldest = applied_sequence[i];
+    }
+  }
+  active_count = count;
+  active_mask = mask;
+  idle_levels = idle;
+  if (oldest != config_applied) {
+    config_applied = oldest;
+    config_applied_frame = frame;
+  }
+}
+
+bool IRAM_ATTR OutputEngine::countFrame(uint32_t frame, bool running) {
+  portENTER_CRITICAL_ISR(&_output_mux);
+  applyConfig(frame, running);
+  // A channel that ends another frame before the next frame start has the
+  // buffer it would be encoded into out already
+  for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+    frames_started[i] = channels[i]->framesEmitted();
+  }
+  if (!clock_valid) {
+    portEXIT_CRITICAL_ISR(&_output_mux);
+    return false;
+  }
+  // Frame 'frame' is out now and the channels take the one after in their
+  // other buffer: count the clock on to it, encode() corrects it while the
+  // frame runs
+  if ((int32_t)(supplied_frame - frame) < 0) {
+    holdover_frames++;
+  }
+  bool stepped = false;
+  while ((int32_t)(clock_frame - (frame + 1)) < 0) {
+    irig_time_next_second(clock_local);
+    irig_time_next_second(clock_utc);
+    clock_frame++;
+    stepped = true;
+  }
+  if (stepped) {
+    encode_sequence++;
+  }
+  // Encoded unless encode() already had it encoded for this frame
+  encode_pending = clock_frame == frame + 1 && (stepped || encode_pending);
+  bool pending = encode_pending;
+  portEXIT_CRITICAL_ISR(&_output_mux);
+  return pending;
+}
+
+void IRAM_ATTR OutputEngine::frameStart(uint32_t frame, bool running, BaseType_t* woken) {
+  if (countFrame(frame, running) && encoder) {
+    vTaskNotifyGiveFromISR(encoder, woken);
+  }
+}
+
+void OutputEngine::encodeFrame() {
+  for (;;) {
+    portENTER_CRITICAL(&_output_mux);
+    if (!encode_pending) {
+      portEXIT_CRITICAL(&_output_mux);
+      return;
+    }
+    uint32_t sequence = encode_sequence;
+    IrigTime local = clock_local;
+    IrigTime utc = clock_utc;
+    int offset_hours = clock_offset;
+    ChannelConfig config[IRIG_CHANNELS];
+    memcpy(config, staged, sizeof(config));
+    uint32_t config_sequence = staged_sequence;
+    portEXIT_CRITICAL(&_output_mux);
+
+    // Into the spare buffers, which only this task writes and the timer
+    // never reads. Disabled channels are encoded too, so one that is
+    // enabled again starts with the current frame.
+    for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+      if (!(reserved & (1 << i))) {
+        channels[i]->encodeTimeIntoBits(config[i].utc ? utc : local, config[i].utc ? 0 : offset_hours,
+                                        (IrigFormat)config[i].format);
+      }
+    }
+
+    // Swapped in unless the clock changed meanwhile, then again from the
+    // new one. Past the end of the frame the frame start is due, it counts
+    // the clock on and has the frame after encoded.
+    portENTER_CRITICAL(&_output_mux);
+    bool ended = false;
+    for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+      if (!(reserved & (1 << i)) && channels[i]->framesEmitted() != frames_started[i]) {
+        ended = true;
+      }
+    }
+    bool current = sequence == encode_sequence && !ended;
+    if (current) {
+      for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+        if (!(reserved & (1 << i))) {
+          channels[i]->commitBits();
+          // The frame start takes this configuration over with the frame
+          uint8_t next = channels[i]->buffer() ^ 1;
+          encoded[i][next] = config[i];
+          encoded_sequence[i][next] = config_sequence;
+        }
+      }
+      encode_pending = false;
+    }
+    portEXIT_CRITICAL(&_output_mux);
+
+    if (ended) {
+      return;
+    }
+    if (current && am) {
+      const ChannelConfig& mirrored = config[am_channel];
+      am->encode(mirrored.utc ? utc : local, mirrored.utc ? 0 : offset_hours, (IrigFormat)mirrored.format);
+    }
+  }
+}
+
+void OutputEngine::nextFrame(bool running, const bool** frames, uint32_t frame) {
+  // The channels no longer drive their pins, the backend does
+  rendering = true;
+  // The end of the previous frame, then the start of this one
+  if (rendered_running) {
+    for (uint8_t i = 0; i < active_count; i++) {
+      channels[active[i]]->endFrame();
+    }
+  }
+  if (countFrame(frame, running)) {
+    wakeEncoder();
+  }
+
+  for (uint8_t i = 0; i < IRIG_CHANNELS; i++) {
+    frames[i] = nullptr;
+  }
+  if (running) {
+    for (uint8_t i = 0; i < active_count; i++) {
+      frames[active[i]] = channels[active[i]]->frame();
+    }
+  }
+  rendered_running = running;
+}
+
+void OutputEngine::render(uint8_t* out, uint8_t repeat, bool running, uint32_t frame) {
+  const bool* frames[IRIG_CHANNELS];
+  nextFrame(running, frames, frame);
+  irig_render_frame(frames, idle_levels, advance_us, repeat, out);
+}
+
+size_t OutputEngine::renderEdges(IrigEdge* out, bool running, uint32_t frame) {
+  const bool* frames[IRIG_CHANNELS];
+  nextFrame(running, frames, frame);
+  return irig_render_edges(frames, idle_levels, advance_us, out);
+}
+
+static bool same_time(const IrigTime& a, const IrigTime& b) {
+  return a.second == b.second && a.minute == b.minute && a.hour == b.hour && a.day == b.day &&
+         a.year % 100 == b.year % 100;
+}
+
+void OutputEngine::encode(const IrigTime& local, int offset_hours, uint32_t frame) {
+  IrigTime utc;
+  irig_time_from_seconds(irig_time_to_seconds(local) - offset_hours * 3600L, utc);
+  // Keep the year in the form it was given
+  if (local.year < 100) {
+    utc.year %= 100;
+  }
+  IrigTime next_local = local;
+
+  portENTER_CRITICAL(&_output_mux);
+  // A rendering backend may have started the frame already and counted on
+  // to the one after
+  while (clock_valid && (int32_t)(frame - clock_frame) < 0) {
+    irig_time_next_second(next_local);
+    irig_time_next_second(utc);
+    frame++;
+  }
+  bool changed = !clock_valid || frame != clock_frame || !same_time(next_local, clock_local) ||
+                 offset_hours != clock_offset;
+  if (clock_valid && frame == clock_frame && changed) {
+    time_steps++;
+  }
+  clock_local = next_local;
+  clock_utc = utc;
+  clock_offset = offset_hours;
+  clock_frame = frame;
+  clock_valid = true;
+  supplied_frame = frame;
+  // The time the frame start counted on to needs no second encoding
+  if (changed) {
+    encode_sequence++;
+    encode_pending = true;
+  }
+  portEXIT_CRITICAL(&_output_mux);
+  if (changed) {
+    wakeEncoder();
+  }
+}
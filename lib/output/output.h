@@ -0,0 +1,149 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <Arduino.h>
+#include "irigb.h"
+#include "irig_format.h"
+#include "settings.h"
+#include "am_output.h"
+#include "irig_render.h"
+
+// Called by a rendering backend from its interrupt when a frame starts on
+// the pins: the micros() of the frame start, 'running' when the frame
+// carries the channels rather than their idle levels
+typedef void (*OutputFrameHook)(uint32_t start_us, bool running);
+
+// Runs the IRIG-B channels from a table of ChannelConfig. The output timer
+// only walks the list of enabled channels, so a disabled channel costs
+// nothing per tick. A new table is staged by configure() and taken over at
+// a frame start of every channel, so no channel ever emits a partial or
+// mixed frame. The cable delay advance needs finer steps than the tick and
+// only applies to the rendering backends.
+//
+// The engine keeps the time of day itself: every frame start steps it by a
+// second and the following frame is encoded from it, so a stalled time task
+// never sends a stale second. Frames are numbered like the timebase counts them;
+// encode() corrects the count for a given frame.
+//
+// The timer path (frameStart(), tick()) runs from IRAM and keeps going
+// while the flash cache is off. A frame start only counts the clock on and
+// wakes the encoder task on the output core, which encodes the next frame
+// of every channel into spare buffers without the lock and then swaps them
+// in under it. encode() leaves its frame to the same task.
+class OutputEngine {
+public:
+  OutputEngine(IRIGB* const* channels);
+
+  // Start the channels that are not in 'reserved' (bit per channel, pins
+  // used for something else), idle until configure(), and the encoder task
+  bool begin(uint8_t reserved);
+
+  // Stage a configuration, returns its sequence number. Every channel takes
+  // it over at the start of the first frame encoded with it, so the format,
+  // inversion and enable of a frame always match its bits.
+  uint32_t configure(const ChannelConfig* config);
+
+  // Sequence number of the newest configuration every channel runs on, and
+  // the frame it took effect with
+  uint32_t configApplied() const { return config_applied; }
+  uint32_t configAppliedFrame() const { return config_applied_frame; }
+
+  // From the output timer: first tick of frame number 'frame', before tick(),
+  // 'running' when the frame is output. Wakes the encoder task for the next
+  // frame and sets *woken when it should run when the interrupt returns.
+  void frameStart(uint32_t frame, bool running, BaseType_t* woken);
+
+  // From the output timer: every tick while the outputs run
+  __attribute__((always_inline)) inline void tick() {
+    for (uint8_t i = 0; i < active_count; i++) {
+      channels[active[i]]->update();
+    }
+  }
+
+  // For backends that output whole frames: do what frameStart() and tick()
+  // do over one frame and render its samples (irig_render_frame), starting
+  // IRIG_RENDER_LEAD_US before the frame start. A frame that is not
+  // 'running' leaves every channel idle, like the timer path does while the
+  // outputs are off.
+  void render(uint8_t* out, uint8_t repeat, bool running, uint32_t frame);
+
+  // The same for backends that schedule edges (irig_render_edges), returns
+  // the edge count
+  size_t renderEdges(IrigEdge* out, bool running, uint32_t frame);
+
+  // Idle level of every channel, bit per channel
+  uint8_t idleLevels() const { return idle_levels; }
+
+  // Local time carried by frame number 'frame': sets the engine's count and
+  // has the encoder task encode the next frame of every channel from it.
+  // UTC channels get the offset taken off and a zero offset in the frame.
+  void encode(const IrigTime& local, int offset_hours, uint32_t frame);
+
+  // The encoder task's work: encode the frame the clock is on if a frame
+  // start or encode() left it, again while the clock changes meanwhile.
+  // Hosts without the task call it after frameStart().
+  void encodeFrame();
+
+  // Frames that started on the engine's own count because encode() supplied
+  // nothing for them, and encode() calls that moved the count
+  uint32_t holdoverFrames() const { return holdover_frames; }
+  uint32_t timeSteps() const { return time_steps; }
+
+  // Also send the frames of 'channel' on the AM output
+  void setAmOutput(AmOutput* output, uint8_t channel) {
+    am = output;
+    am_channel = channel;
+  }
+
+  // Channels in the output list, bit per channel
+  uint8_t activeMask() const { return active_mask; }
+
+private:
+  // Frame bookkeeping of render() and renderEdges(), the frame of every
+  // channel to output (nullptr when idle)
+  void nextFrame(bool running, const bool** frames, uint32_t frame);
+  void applyConfig(uint32_t frame, bool running);
+  bool countFrame(uint32_t frame, bool running);
+  void wakeEncoder();
+  static void encoderTask(void* param);
+
+  IRIGB* const* channels;
+  uint8_t reserved;
+
+  ChannelConfig staged[IRIG_CHANNELS];    // Latest configure(), also used by encode()
+  uint32_t staged_sequence;
+  // Configuration each buffer of a channel was last encoded with
+  ChannelConfig encoded[IRIG_CHANNELS][2];
+  uint32_t encoded_sequence[IRIG_CHANNELS][2];
+  ChannelConfig applied[IRIG_CHANNELS];   // Owned by the timer interrupt
+  uint32_t applied_sequence[IRIG_CHANNELS];
+  volatile uint32_t config_applied;
+  volatile uint32_t config_applied_frame;
+  uint8_t active[IRIG_CHANNELS];          // Enabled channel indices
+  volatile uint8_t active_count;
+  volatile uint8_t active_mask;
+  uint8_t idle_levels;
+  uint16_t advance_us[IRIG_CHANNELS];     // Of the applied configuration
+  bool rendering;                         // Frames go out through render()/renderEdges()
+  bool rendered_running;                  // The last render() was of a running frame
+
+  // Time of day of frame 'clock_frame', the next one to start, guarded by
+  // the spinlock
+  IrigTime clock_local;
+  IrigTime clock_utc;
+  int clock_offset;
+  uint32_t clock_frame;
+  volatile bool clock_valid;
+  uint32_t supplied_frame;                // Last frame encode() was given
+  uint32_t encode_sequence;               // Raised whenever the clock changes
+  uint32_t frames_started[IRIG_CHANNELS]; // framesEmitted() of each channel at the last frame start
+  volatile bool encode_pending;           // clock_frame is still to be encoded
+  TaskHandle_t encoder;
+  volatile uint32_t holdover_frames;
+  volatile uint32_t time_steps;
+
+  AmOutput* am;
+  uint8_t am_channel;
+};
+
+#endif // OUTPUT_H
@@ -0,0 +1,54 @@
+// Device only, the native tests build the rest of this library
+#ifdef ARDUINO
+
+#include "timer_output.h"
+#include "timebase.h"
+#include "fast_gpio.h"
+
+#define TIMER_OUTPUT_TICK_US 500
+
+TimerOutput::TimerOutput(OutputEngine& engine, uint8_t wclk_pin)
+    : engine(engine), wclk_pin(wclk_pin), available(nullptr), seconds(nullptr), latency(nullptr),
+      wclk_state(false), frame_tick(0), output_running(false) {
+}
+
+bool TimerOutput::begin(const volatile bool* available, SecondBus* seconds, LatencyHistogram* latency) {
+  this->available = available;
+  this->seconds = seconds;
+  this->latency = latency;
+  timebase_begin(TIMER_OUTPUT_TICK_US);
+  if (!timebase_start_timer(onTimer, this)) {
+    Serial.println("Timer output: timer failed to start");
+    return false;
+  }
+  return true;
+}
+
+bool IRAM_ATTR TimerOutput::onTimer(void* param) {
+  return static_cast<TimerOutput*>(param)->tick();
+}
+
+bool IRAM_ATTR TimerOutput::tick() {
+  // The timer auto-reloads on the alarm, so its count is the entry latency
+  if (latency) latency->record(timebase_timer_count());
+  timebase_tick();
+  BaseType_t woken = pdFALSE;
+  if (wclk_state) {
+    if (frame_tick == 0) {
+      uint32_t frame = timebase_frame_start();
+      output_running = available && *available;
+      engine.frameStart(frame, output_running, &woken);
+      if (seconds) seconds->publishFromISR(&woken);
+    }
+    if (output_running) engine.tick();
+    frame_tick++;
+    if (frame_tick >= 1000) {
+      frame_tick = 0;
+    }
+  }
+  if (output_running) fast_gpio_write(wclk_pin, !wclk_state);
+  wclk_state = !wclk_state;
+  return woken == pdTRUE;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,51 @@
+#ifndef TIMER_OUTPUT_H
+#define TIMER_OUTPUT_H
+
+#include <Arduino.h>
+#include "output.h"
+#include "metrics.h"
+#include "second_bus.h"
+
+// IRIG-B outputs from the 0.5 ms output timer of the timebase: every other
+// tick advances the channels by one 1 ms step (OutputEngine::tick) and the
+// ticks in between toggle WCLK. The only backend the timebase can steer, so
+// the IRIG reference mode always runs on it. The firmware and the device
+// tests run this same handler.
+//
+// The handler runs from IRAM through flash writes: everything it calls is in
+// IRAM and the pins are written directly (tools/check_iram.py checks the calls).
+
+class TimerOutput {
+public:
+  TimerOutput(OutputEngine& engine, uint8_t wclk_pin);
+
+  // Set up the timebase for the 0.5 ms tick and start the timer; call from
+  // a task on the output core, the interrupt is allocated on the calling
+  // core. A frame carries the channels while *available is set at its start
+  // and publishes a second boundary on 'seconds'. The timer count at the
+  // entry of every tick goes to 'latency'. Either may be null.
+  bool begin(const volatile bool* available, SecondBus* seconds, LatencyHistogram* latency);
+
+  // The frame on the pins carries the channels
+  bool running() const { return output_running; }
+
+private:
+  static bool IRAM_ATTR onTimer(void* param);
+  bool IRAM_ATTR tick();
+
+  OutputEngine& engine;
+  uint8_t wclk_pin;
+  const volatile bool* available;
+  SecondBus* seconds;
+  LatencyHistogram* latency;
+
+  // Owned by the interrupt
+  bool wclk_state;
+  // Position within the frame in 1 ms steps. Keeps running while the
+  // outputs are idle so the timebase always has a frame phase to discipline.
+  uint16_t frame_tick;
+  // Outputs only start or stop on a frame boundary so they never emit a partial frame
+  volatile bool output_running;
+};
+
+#endif // TIMER_OUTPUT_H
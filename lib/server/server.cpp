@@ -1,9 +1,68 @@
 #include "server.h"
 #include "ethernet.h"
+#include "json_writer.h"
+#include "change_bus.h"
+#include "settings_schema.h"
+#include "web_assets.h"
 #include <SPIFFS.h>
 #include <time.h>
 
-IRIGWebServer::IRIGWebServer() : server(nullptr), ws(nullptr), settings(nullptr), running(false), port(80) {
+// Largest /api/config body; the settings strings are bounded by the web UI
+#define CONFIG_JSON_MAX 1536
+
+// Run 'fill' twice: once against a null writer to measure the message, then
+// into a WebSocket message buffer of exactly that size. The buffer can be
+// queued to any number of clients without further copies.
+template <typename Fill>
+static AsyncWebSocketMessageBuffer* makeJsonMessage(WebSocketBroadcaster& broadcaster, Fill fill) {
+    JsonWriter measure(nullptr, 0);
+    fill(measure);
+    AsyncWebSocketMessageBuffer* buffer = broadcaster.makeBuffer(measure.length());
+    if (!buffer) {
+        return nullptr;
+    }
+    JsonWriter writer((char*)buffer->get(), measure.length());
+    fill(writer);
+    return buffer;
+}
+
+// Server whose WebSocket counters are exported on /metrics
+static IRIGWebServer* metrics_server = nullptr;
+
+static void collect_ws_clients(MetricsWriter& out, const char* name) {
+    out.sample(name, metrics_server->getBroadcastStats().clients);
+}
+
+static void collect_ws_sent(MetricsWriter& out, const char* name) {
+    out.sample(name, metrics_server->getBroadcastStats().sent);
+}
+
+static void collect_ws_dropped(MetricsWriter& out, const char* name) {
+    WsBroadcastStats stats = metrics_server->getBroadcastStats();
+    out.sample(name, "reason", "superseded", stats.superseded);
+    out.sample(name, "reason", "queue_full", stats.queue_full);
+    out.sample(name, "reason", "no_buffer", stats.no_buffer);
+}
+
+static void collect_ws_rejected(MetricsWriter& out, const char* name) {
+    out.sample(name, metrics_server->getBroadcastStats().rejected);
+}
+
+static void collect_ws_evicted(MetricsWriter& out, const char* name) {
+    out.sample(name, metrics_server->getBroadcastStats().evicted);
+}
+
+static const MetricFamily WS_METRICS[] = {
+    {"irigb_ws_clients", "Connected WebSocket clients", MetricType::GAUGE, collect_ws_clients},
+    {"irigb_ws_messages_sent_total", "WebSocket messages queued to a client", MetricType::COUNTER, collect_ws_sent},
+    {"irigb_ws_dropped_total", "WebSocket messages not delivered to a client", MetricType::COUNTER, collect_ws_dropped},
+    {"irigb_ws_rejected_total", "WebSocket connections refused above the client limit", MetricType::COUNTER, collect_ws_rejected},
+    {"irigb_ws_evicted_total", "WebSocket clients closed for inactivity", MetricType::COUNTER, collect_ws_evicted},
+};
+
+IRIGWebServer::IRIGWebServer() : server(nullptr), ws(nullptr), settings(nullptr), running(false), assets_ready(false), port(80), status_sequence(0), metrics_request(nullptr),
+    config_lock(nullptr), config_message(nullptr), config_revision(0), rx_buffer(nullptr), rx_length(0), rx_client(0), rx_overflow(false) {
+    config_version[0] = '\0';
 }
 
 IRIGWebServer::~IRIGWebServer() {
@@ -16,28 +75,36 @@ IRIGWebServer::~IRIGWebServer() {
         delete server;
         server = nullptr;
     }
+    free(rx_buffer);
+    rx_buffer = nullptr;
+    if (config_message) {
+        config_message->unlock();
+        config_message = nullptr;
+    }
 }
 
 bool IRIGWebServer::begin(Settings* settings) {
     this->settings = settings;
-    // Initialize SPIFFS/LittleFS first
-    if (!initFileSystem()) {
+#ifdef IRIGB_EMBED_ASSETS
+    // Assets are compiled into the firmware, the filesystem is never mounted
+    Serial.printf("Serving %u embedded web assets\n", (unsigned)WEB_ASSET_COUNT);
+    assets_ready = true;
+#else
+    // Mounted once for the lifetime of the server. Only an unusable
+    // filesystem is formatted; without one the API still runs and "/" gets
+    // the fallback page.
+    if (initFileSystem()) {
+        assets_ready = true;
+    } else {
         Serial.println("Failed to initialize filesystem, attempting to format and recover...");
-
-        // Try to format and reinitialize
-        if (!formatFileSystem()) {
-            Serial.println("Failed to format filesystem - server cannot start");
-            return false;
-        }
-
-        // Try initialization again after formatting
-        if (!initFileSystem()) {
-            Serial.println("Failed to initialize filesystem even after formatting");
-            return false;
+        if (formatFileSystem() && initFileSystem()) {
+            Serial.println("Filesystem recovered successfully");
+            assets_ready = true;
+        } else {
+            Serial.println("Filesystem unusable, serving the API without the web UI");
         }
-
-        Serial.println("Filesystem recovered successfully");
     }
+#endif
 
     // Create AsyncWebServer instance
     server = new AsyncWebServer(port);
@@ -46,6 +113,18 @@ bool IRIGWebServer::begin(Settings* settings) {
         return false;
     }
 
+    config_lock = xSemaphoreCreateMutex();
+    if (!config_lock) {
+        Serial.println("Failed to create config cache mutex");
+        return false;
+    }
+
+    rx_buffer = (char*)malloc(WS_RX_BUFFER_SIZE);
+    if (!rx_buffer) {
+        Serial.println("Failed to allocate WebSocket receive buffer");
+        return false;
+    }
+
     // Create WebSocket instance
     ws = new AsyncWebSocket("/ws");
     if (!ws) {
@@ -61,8 +140,24 @@ bool IRIGWebServer::begin(Settings* settings) {
     using std::placeholders::_5;
     using std::placeholders::_6;
     ws->onEvent(std::bind(&IRIGWebServer::onWebSocketEvent, this, _1, _2, _3, _4, _5, _6));
+    if (!broadcaster.begin(ws)) {
+        Serial.println("Failed to create WebSocket broadcaster");
+        return false;
+    }
     server->addHandler(ws);
 
+    // Serialize the loaded settings now rather than on the first request
+    xSemaphoreTake(config_lock, portMAX_DELAY);
+    refreshConfig();
+    xSemaphoreGive(config_lock);
+
+    if (!metrics_server) {
+        metrics_server = this;
+        for (size_t i = 0; i < sizeof(WS_METRICS) / sizeof(WS_METRICS[0]); i++) {
+            metrics_register(&WS_METRICS[i]);
+        }
+    }
+
     // Setup routes
     setupRoutes();
 
@@ -107,16 +202,24 @@ bool IRIGWebServer::initFileSystem() {
         File root = SPIFFS.open("/");
         if (root && root.isDirectory()) {
             Serial.println("SPIFFS initialized and verified successfully");
+            root.close();
 
-            // Check if index.html exists in SPIFFS
-            if (SPIFFS.exists("/index.html")) {
-                Serial.println("index.html found in SPIFFS");
-                root.close();
-                return true;
+            // A firmware update without a new filesystem image leaves the
+            // assets of the old one; they are served around, not formatted away
+            size_t missing = 0;
+            for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+                if (!SPIFFS.exists(WEB_ASSETS[i].file)) {
+                    Serial.printf("%s not found in SPIFFS\n", WEB_ASSETS[i].file);
+                    missing++;
+                }
+            }
+            if (missing == 0) {
+                Serial.printf("%u web assets found in SPIFFS\n", (unsigned)WEB_ASSET_COUNT);
             } else {
-                Serial.println("index.html not found in SPIFFS");
+                Serial.printf("%u of %u web assets missing, upload the filesystem image\n",
+                              (unsigned)missing, (unsigned)WEB_ASSET_COUNT);
             }
-            root.close();
+            return true;
         } else {
             Serial.println("SPIFFS initialization verification failed");
             SPIFFS.end(); // Clean up failed mount
@@ -160,12 +263,20 @@ void IRIGWebServer::setupRoutes() {
         return;
     }
 
-    // Serve static files from SPIFFS
-    if (SPIFFS.begin(false)) { // Check if SPIFFS is mounted (don't format)
-        if (SPIFFS.exists("/index.html")) {
-            server->serveStatic("/", SPIFFS, "/").setDefaultFile("index.html");
-            Serial.println("Serving static files from SPIFFS");
+    // Serve the gzipped assets, "/" is index.html
+    if (assets_ready) {
+        for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+            const WebAsset* asset = &WEB_ASSETS[i];
+            server->on(asset->path, HTTP_GET, [this, asset](AsyncWebServerRequest *request) {
+                serveAsset(request, *asset);
+            });
+            if (strcmp(asset->path, "/index.html") == 0) {
+                server->on("/", HTTP_GET, [this, asset](AsyncWebServerRequest *request) {
+                    serveAsset(request, *asset);
+                });
+            }
         }
+        Serial.println("Static file routes configured");
     }
 
     // API endpoints
@@ -177,11 +288,40 @@ void IRIGWebServer::setupRoutes() {
         handleSaveConfig(request);
     });
 
-    // Root route handler (fallback)
-    server->on("/", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        handleRoot(request);
+    // Prometheus scrape, rendered one family at a time into the TCP window
+    // by the one renderer; a second scrape while one is running is turned away
+    server->on("/metrics", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (metrics_request) {
+            AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Scrape in progress");
+            response->addHeader("Retry-After", "1");
+            request->send(response);
+            return;
+        }
+        metrics_request = request;
+        metrics_renderer.reset();
+        request->onDisconnect([this, request]() {
+            if (metrics_request == request) {
+                metrics_request = nullptr;
+            }
+        });
+        AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain; version=0.0.4",
+            [this](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                size_t n = metrics_renderer.read(buffer, maxLen);
+                if (n == 0) {
+                    metrics_request = nullptr;
+                }
+                return n;
+            });
+        request->send(response);
     });
 
+    // Root route handler (fallback)
+    if (!assets_ready) {
+        server->on("/", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            handleRoot(request);
+        });
+    }
+
     // 404 handler
     server->onNotFound([this](AsyncWebServerRequest *request) {
         handleNotFound(request);
@@ -190,15 +330,50 @@ void IRIGWebServer::setupRoutes() {
     Serial.println("Web server routes configured");
 }
 
-void IRIGWebServer::handleRoot(AsyncWebServerRequest *request) {
-    // Serve index.html from SPIFFS
-    if (SPIFFS.begin(false) && SPIFFS.exists("/index.html")) {
-        Serial.println("Serving index.html from SPIFFS");
-        request->send(SPIFFS, "/index.html", "text/html");
+void IRIGWebServer::serveAsset(AsyncWebServerRequest *request, const WebAsset& asset) {
+    // The browser already has this version: headers only
+    if (request->hasHeader("If-None-Match") &&
+        request->getHeader("If-None-Match")->value().indexOf(asset.etag) >= 0) {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", asset.etag);
+        response->addHeader("Cache-Control", asset.cache_control);
+        request->send(response);
         return;
     }
 
-    // If no HTML file found, send a simple response
+#ifdef IRIGB_EMBED_ASSETS
+    // Sent straight from the memory-mapped flash
+    AsyncWebServerResponse *response = request->beginResponse_P(200, asset.content_type, asset.data, asset.size);
+#else
+    if (!SPIFFS.exists(asset.file)) {
+        serveMissingAsset(request, asset);
+        return;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(SPIFFS, asset.file, asset.content_type);
+#endif
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", asset.cache_control);
+    request->send(response);
+}
+
+void IRIGWebServer::serveMissingAsset(AsyncWebServerRequest *request, const WebAsset& asset) {
+#ifndef IRIGB_EMBED_ASSETS
+    // Not the content the ETag stands for, so sent without validators
+    if (SPIFFS.exists(asset.path)) {
+        request->send(SPIFFS, asset.path, asset.content_type);
+        return;
+    }
+#endif
+    if (strcmp(asset.path, "/index.html") == 0) {
+        handleRoot(request);
+    } else {
+        handleNotFound(request);
+    }
+}
+
+void IRIGWebServer::handleRoot(AsyncWebServerRequest *request) {
+    // Only reached when the filesystem holds no web UI
     Serial.println("No index.html found, sending fallback page");
     String html = "<!DOCTYPE html><html><head><title>IRIG-B Server</title></head>";
     html += "<body><h1>IRIG-B Time Server</h1>";
@@ -220,38 +395,86 @@ void IRIGWebServer::handleNotFound(AsyncWebServerRequest *request) {
     request->send(404, "text/html", html);
 }
 
+bool IRIGWebServer::refreshConfig() {
+    // Revision first: the snapshot taken after it is at least that new
+    uint32_t revision = settings->revision();
+    if (config_message && config_revision == revision) {
+        return true;
+    }
+
+    char fields[CONFIG_JSON_MAX];
+    JsonWriter json(fields, sizeof(fields));
+    json.beginObject();
+    settings_write_json(json, *settings->get());
+    json.endObject();
+    if (json.overflow()) {
+        Serial.println("Configuration too large");
+        return false;
+    }
+
+    // FNV-1a over the settings JSON
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < json.length(); i++) {
+        hash = (hash ^ (uint8_t)fields[i]) * 16777619u;
+    }
+    char version[sizeof(config_version)];
+    snprintf(version, sizeof(version), "%08x", (unsigned)hash);
+    if (config_message && strcmp(version, config_version) == 0) {
+        // Saved or reloaded without a change, the message still holds
+        config_revision = revision;
+        return true;
+    }
+
+    // {"type":"config","version":"...", followed by the fields without their '{'
+    char prefix[48];
+    int prefix_length = snprintf(prefix, sizeof(prefix), "{\"type\":\"config\",\"version\":\"%s\",", version);
+    AsyncWebSocketMessageBuffer* message = broadcaster.makeBuffer(prefix_length + json.length() - 1);
+    if (!message) {
+        return false;
+    }
+    memcpy(message->get(), prefix, prefix_length);
+    memcpy(message->get() + prefix_length, fields + 1, json.length() - 1);
+
+    // Clients still sending the old message keep it alive until they are done
+    if (config_message) {
+        config_message->unlock();
+    }
+    config_message = message;
+    config_revision = revision;
+    memcpy(config_version, version, sizeof(config_version));
+    return true;
+}
+
 void IRIGWebServer::handleGetConfig(AsyncWebServerRequest *request) {
     if (!settings) {
         request->send(500, "application/json", "{\"error\":\"Settings not available\"}");
         return;
     }
 
-    // Create JSON response from settings - use reserve() to prevent reallocation
-    String json;
-    json.reserve(512); // Pre-allocate to reduce stack churn
-    json = "{";
-    json += "\"dhcp\":"; json += settings->network.dhcp ? "true" : "false"; json += ",";
-    json += "\"ip\":\""; json += settings->network.ip; json += "\",";
-    json += "\"subnet\":\""; json += settings->network.subnet; json += "\",";
-    json += "\"gateway\":\""; json += settings->network.gateway; json += "\",";
-    json += "\"dns\":\""; json += settings->network.dns; json += "\",";
-    json += "\"ntpServer\":\""; json += settings->ntp.server; json += "\",";
-    json += "\"ntpServer2\":\""; json += settings->ntp.server2; json += "\",";
-    json += "\"ntpPort\":"; json += String(settings->ntp.port); json += ",";
-    json += "\"ntpPort2\":"; json += String(settings->ntp.port2); json += ",";
-    json += "\"timeOffset\":"; json += String(settings->ntp.timeOffset); json += ",";
-    json += "\"enabled\":"; json += settings->enabled ? "true" : "false"; json += ",";
-    json += "\"channel_1_mode\":"; json += String(settings->channel_1_mode); json += ",";
-    json += "\"channel_2_mode\":"; json += String(settings->channel_2_mode); json += ",";
-    json += "\"channel_3_mode\":"; json += String(settings->channel_3_mode); json += ",";
-    json += "\"channel_4_mode\":"; json += String(settings->channel_4_mode); json += ",";
-    json += "\"channel_5_mode\":"; json += String(settings->channel_5_mode); json += ",";
-    json += "\"channel_6_mode\":"; json += String(settings->channel_6_mode); json += ",";
-    json += "\"channel_7_mode\":"; json += String(settings->channel_7_mode); json += ",";
-    json += "\"channel_8_mode\":"; json += String(settings->channel_8_mode);
-    json += "}";
-
-    request->send(200, "application/json", json);
+    xSemaphoreTake(config_lock, portMAX_DELAY);
+    if (!refreshConfig()) {
+        xSemaphoreGive(config_lock);
+        request->send(500, "application/json", "{\"error\":\"Configuration not available\"}");
+        return;
+    }
+
+    char etag[sizeof(config_version) + 2];
+    snprintf(etag, sizeof(etag), "\"%s\"", config_version);
+    AsyncWebServerResponse* response;
+    if (request->hasHeader("If-None-Match") &&
+        request->getHeader("If-None-Match")->value().indexOf(etag) >= 0) {
+        response = request->beginResponse(304);
+    } else {
+        // Copied, the cached message may be replaced while this one is sent
+        AsyncResponseStream* stream = request->beginResponseStream("application/json", config_message->length());
+        stream->write(config_message->get(), config_message->length());
+        response = stream;
+    }
+    xSemaphoreGive(config_lock);
+
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
 }
 
 void IRIGWebServer::handleSaveConfig(AsyncWebServerRequest *request) {
@@ -262,17 +485,23 @@ void IRIGWebServer::handleSaveConfig(AsyncWebServerRequest *request) {
 
     // Parse form data
     if (request->hasParam("dhcp", true)) {
-        settings->network.dhcp = request->getParam("dhcp", true)->value() == "true";
-        settings->network.ip = request->getParam("ip", true)->value();
-        settings->network.subnet = request->getParam("subnet", true)->value();
-        settings->network.gateway = request->getParam("gateway", true)->value();
-        settings->network.dns = request->getParam("dns", true)->value();
-        settings->ntp.server = request->getParam("ntpServer", true)->value();
-        settings->ntp.port = request->getParam("ntpPort", true)->value().toInt();
-        settings->enabled = request->getParam("enabled", true)->value() == "true";
-
-        // Set network changes flag to trigger reconfiguration
-        settings->setNetworkChangesFlag(true);
+        SettingsSnapshot previous = settings->get();
+        SettingsData data = *previous;
+        data.network.dhcp = request->getParam("dhcp", true)->value() == "true";
+        settings_copy_string(data.network.ip, sizeof(data.network.ip), request->getParam("ip", true)->value().c_str());
+        settings_copy_string(data.network.subnet, sizeof(data.network.subnet), request->getParam("subnet", true)->value().c_str());
+        settings_copy_string(data.network.gateway, sizeof(data.network.gateway), request->getParam("gateway", true)->value().c_str());
+        settings_copy_string(data.network.dns, sizeof(data.network.dns), request->getParam("dns", true)->value().c_str());
+        settings_copy_string(data.ntp.server, sizeof(data.ntp.server), request->getParam("ntpServer", true)->value().c_str());
+        data.ntp.port = request->getParam("ntpPort", true)->value().toInt();
+        data.enabled = request->getParam("enabled", true)->value() == "true";
+        // Subscribers pick the new values up from the published snapshot;
+        // resubmitting the same values wakes no one
+        ChangeMask changed = settings_diff(*previous, data);
+        if (changed) {
+            settings->publish(data);
+            settings_changes.publish(changed);
+        }
 
         if (settings->save()) {
             request->send(200, "application/json", "{\"success\":true,\"message\":\"Configuration saved\"}");
@@ -288,28 +517,29 @@ void IRIGWebServer::onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClien
     switch (type) {
         case WS_EVT_CONNECT:
             Serial.printf("WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
+            broadcaster.clientConnected(client);
             break;
         case WS_EVT_DISCONNECT:
             Serial.printf("WebSocket client #%u disconnected\n", client->id());
-            break;
-        case WS_EVT_DATA: {
-            // Handle incoming WebSocket data
-            AwsFrameInfo *info = (AwsFrameInfo*)arg;
-            if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
-                data[len] = 0; // Null terminate the string
-                String message = (char*)data;
-                handleWebSocketMessage(client, message);
+            broadcaster.clientDisconnected(client->id());
+            if (rx_client == client->id()) {
+                rx_client = 0; // Abandon its partial message
             }
             break;
-        }
+        case WS_EVT_DATA:
+            broadcaster.clientActive(client->id());
+            receiveWebSocketData(client, (AwsFrameInfo*)arg, data, len);
+            break;
         case WS_EVT_PONG:
+            broadcaster.clientActive(client->id());
+            break;
         case WS_EVT_ERROR:
             break;
     }
 }
 
 void IRIGWebServer::sendTimeUpdate(int hour, int minute, int second, int day) {
-    if (!ws || ws->count() == 0) return;
+    if (!ws || !broadcaster.hasClients(WsAudience::JSON_STATUS)) return;
 
     // Use provided time values, or get current time if not provided
     if (hour == -1 || minute == -1 || second == -1 || day == -1) {
@@ -325,226 +555,301 @@ void IRIGWebServer::sendTimeUpdate(int hour, int minute, int second, int day) {
             return;
         }
     }
-    String timeData = "{";
-    timeData += "\"type\":\"time\",";
-    timeData += "\"hour\":" + String(hour) + ",";
-    timeData += "\"minute\":" + String(minute) + ",";
-    timeData += "\"second\":" + String(second) + ",";
-    timeData += "\"day\":" + String(day);
-    timeData += "}";
-
-    ws->textAll(timeData);
+    AsyncWebSocketMessageBuffer* buffer = makeJsonMessage(broadcaster, [&](JsonWriter& json) {
+        json.beginObject();
+        json.field("type", "time");
+        json.field("hour", hour);
+        json.field("minute", minute);
+        json.field("second", second);
+        json.field("day", day);
+        json.endObject();
+    });
+    broadcaster.broadcast(buffer, WsDelivery::LATEST, WsAudience::JSON_STATUS);
 }
 
 void IRIGWebServer::update_led(bool enabled, bool ntp_sync) {
-    if (!ws || ws->count() == 0) return;
+    if (!ws || !broadcaster.hasClients(WsAudience::JSON_STATUS)) return;
     
     // Create JSON message for LED status update
-    String json = "{";
-    json += "\"type\":\"leds\",";
-    json += "\"enabled\":" + String(enabled ? "true" : "false") + ",";
-    json += "\"ntp_sync\":" + String(ntp_sync ? "true" : "false");
-    json += "}";
-    
+    AsyncWebSocketMessageBuffer* buffer = makeJsonMessage(broadcaster, [&](JsonWriter& json) {
+        json.beginObject();
+        json.field("type", "leds");
+        json.field("enabled", enabled);
+        json.field("ntp_sync", ntp_sync);
+        json.endObject();
+    });
+
     // Send to all connected WebSocket clients
-    ws->textAll(json);
-}
-
-void IRIGWebServer::handleWebSocketMessage(AsyncWebSocketClient *client, String message) {
-    Serial.println("WebSocket message received: " + message);
-
-    // Parse JSON message
-    if (message.startsWith("{")) {
-        // Simple JSON parsing for key commands
-        if (message.indexOf("\"action\":\"getConfig\"") >= 0) {
-            handleGetConfigWebSocket(client);
-        } else if (message.indexOf("\"action\":\"saveConfig\"") >= 0) {
-            handleSaveConfigWebSocket(client, message);
-        } else if (message.indexOf("\"action\":\"getTime\"") >= 0) {
-            // Send current time immediately
-            sendTimeUpdate();
-        }
-    }
+    broadcaster.broadcast(buffer, WsDelivery::LATEST, WsAudience::JSON_STATUS);
 }
 
-void IRIGWebServer::handleGetConfigWebSocket(AsyncWebSocketClient *client) {
-    if (!settings) {
-        Serial.println("Settings not available");
+static void writeSeries(JsonWriter& json, const char* name, const LoopbackSeries& series) {
+    json.key(name);
+    json.beginObject();
+    json.field("count", (unsigned long)series.count);
+    json.field("mean", (long)series.mean_us);
+    json.field("min", (long)series.min_us);
+    json.field("max", (long)series.max_us);
+    json.field("jitter", (unsigned long)series.jitter_us);
+    json.endObject();
+}
+
+void IRIGWebServer::sendLoopbackStats(const LoopbackStats& stats) {
+    if (!ws || !broadcaster.hasClients()) return;
+
+    AsyncWebSocketMessageBuffer* buffer = makeJsonMessage(broadcaster, [&](JsonWriter& json) {
+        json.beginObject();
+        json.field("type", "loopback");
+        writeSeries(json, "onTime", stats.on_time);
+        writeSeries(json, "edges", stats.edges);
+        writeSeries(json, "width0", stats.width[0]);
+        writeSeries(json, "width1", stats.width[1]);
+        writeSeries(json, "widthM", stats.width[2]);
+        json.field("badPulses", (unsigned long)stats.bad_pulses);
+        json.field("worstOnTime", (long)stats.worst_on_time_us);
+        json.endObject();
+    });
+    broadcaster.broadcast(buffer, WsDelivery::LATEST);
+}
+
+void IRIGWebServer::receiveWebSocketData(AsyncWebSocketClient *client, AwsFrameInfo *info, uint8_t *data, size_t len) {
+    if (info->message_opcode != WS_TEXT) {
         return;
     }
 
-    // Create JSON response from settings - use reserve() to prevent reallocation
-    String json;
-    json.reserve(512); // Pre-allocate to reduce stack churn
-    json = "{";
-    json += "\"type\":\"config\",";
-    json += "\"dhcp\":"; json += settings->network.dhcp ? "true" : "false"; json += ",";
-    json += "\"ip\":\""; json += settings->network.ip; json += "\",";
-    json += "\"subnet\":\""; json += settings->network.subnet; json += "\",";
-    json += "\"gateway\":\""; json += settings->network.gateway; json += "\",";
-    json += "\"dns\":\""; json += settings->network.dns; json += "\",";
-    json += "\"ntpServer\":\""; json += settings->ntp.server; json += "\",";
-    json += "\"ntpServer2\":\""; json += settings->ntp.server2; json += "\",";
-    json += "\"ntpPort\":"; json += String(settings->ntp.port); json += ",";
-    json += "\"ntpPort2\":"; json += String(settings->ntp.port2); json += ",";
-    json += "\"timeOffset\":"; json += String(settings->ntp.timeOffset); json += ",";
-    json += "\"enabled\":"; json += settings->enabled ? "true" : "false"; json += ",";
-    json += "\"channel_1_mode\":"; json += String(settings->channel_1_mode); json += ",";
-    json += "\"channel_2_mode\":"; json += String(settings->channel_2_mode); json += ",";
-    json += "\"channel_3_mode\":"; json += String(settings->channel_3_mode); json += ",";
-    json += "\"channel_4_mode\":"; json += String(settings->channel_4_mode); json += ",";
-    json += "\"channel_5_mode\":"; json += String(settings->channel_5_mode); json += ",";
-    json += "\"channel_6_mode\":"; json += String(settings->channel_6_mode); json += ",";
-    json += "\"channel_7_mode\":"; json += String(settings->channel_7_mode); json += ",";
-    json += "\"channel_8_mode\":"; json += String(settings->channel_8_mode);
-    json += "}";
-
-    client->text(json);
-}
-
-void IRIGWebServer::handleSaveConfigWebSocket(AsyncWebSocketClient *client, String jsonData) {
-    if (!settings) {
-        Serial.println("Settings not available");
+    // A message arrives as one or more frames (info->num), each of which can
+    // be split across several TCP segments (info->index)
+    bool first = info->num == 0 && info->index == 0;
+    if (first) {
+        if (rx_client != 0 && rx_client != client->id()) {
+            sendError(client, "Busy, retry", 0);
+            return;
+        }
+        rx_client = client->id();
+        rx_length = 0;
+        rx_overflow = false;
+    } else if (rx_client != client->id()) {
+        return; // Rest of a message that was refused or abandoned
+    }
+
+    if (rx_length + len > WS_RX_BUFFER_SIZE) {
+        rx_overflow = true;
+    } else {
+        memcpy(rx_buffer + rx_length, data, len);
+        rx_length += len;
+    }
+
+    bool last = info->final && info->index + len == info->len;
+    if (!last) {
+        return;
+    }
+    rx_client = 0;
+    if (rx_overflow) {
+        sendError(client, "Message too large", WS_RX_BUFFER_SIZE);
         return;
     }
+    handleWebSocketMessage(client, rx_buffer, rx_length);
+}
 
-    // Parse the JSON data and update settings
-    if (jsonData.indexOf("\"dhcp\"") >= 0) {
-        settings->network.dhcp = jsonData.indexOf("\"dhcp\":true") >= 0;
+void IRIGWebServer::sendError(AsyncWebSocketClient *client, const char *message, size_t offset) {
+    Serial.printf("WebSocket request rejected: %s (offset %u)\n", message, (unsigned)offset);
+    char buffer[160];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject();
+    json.field("type", "error");
+    json.field("message", message);
+    json.field("offset", (unsigned long)offset);
+    json.endObject();
+    if (!json.overflow()) {
+        client->text(buffer, json.length());
     }
+}
+
+void IRIGWebServer::sendStatus(TelemetryStatus& status) {
+    if (!ws || !broadcaster.hasClients(WsAudience::BINARY_STATUS)) return;
+
+    WsBroadcastStats stats = broadcaster.stats();
+    status.sequence = ++status_sequence;
+    status.ws_dropped = stats.superseded + stats.queue_full + stats.no_buffer;
 
-    if (jsonData.indexOf("\"enabled\"") >= 0) {
-        settings->enabled = jsonData.indexOf("\"enabled\":true") >= 0;
-        Serial.printf("Enabled setting updated to: %s\n", settings->enabled ? "true" : "false");
+    AsyncWebSocketMessageBuffer* buffer = broadcaster.makeBuffer(TELEMETRY_STATUS_SIZE);
+    if (buffer) {
+        telemetry_encode_status(status, buffer->get());
     }
+    broadcaster.broadcast(buffer, WsDelivery::LATEST, WsAudience::BINARY_STATUS);
+}
 
-    // Extract values using string parsing
-    String searchKeys[] = {"\"ip\"", "\"subnet\"", "\"gateway\"", "\"dns\"", "\"ntpServer\"", "\"ntpServer2\""};
-    String* targetFields[] = {&settings->network.ip, &settings->network.subnet, &settings->network.gateway, &settings->network.dns, &settings->ntp.server, &settings->ntp.server2};
+void IRIGWebServer::maintainClients() {
+    broadcaster.maintain();
+}
 
-    for (int i = 0; i < 6; i++) {
-        int startPos = jsonData.indexOf(searchKeys[i]);
-        if (startPos >= 0) {
-            startPos = jsonData.indexOf("\"", startPos + searchKeys[i].length());
-            if (startPos >= 0) {
-                startPos++; // Skip the opening quote
-                int endPos = jsonData.indexOf("\"", startPos);
-                if (endPos > startPos) {
-                    String value = jsonData.substring(startPos, endPos);
-                    *targetFields[i] = value;
-                }
+WsBroadcastStats IRIGWebServer::getBroadcastStats() {
+    return broadcaster.stats();
+}
+
+void IRIGWebServer::handleWebSocketMessage(AsyncWebSocketClient *client, const char *message, size_t len) {
+    Serial.printf("WebSocket message received: %.*s\n", (int)len, message);
+
+    // Single pass over the message: remember the action, validate and stage
+    // known settings, skip anything else
+    JsonReader reader(message, len);
+    JsonToken token;
+    JsonToken value;
+    JsonToken action = {};
+    JsonToken format = {};
+    JsonToken version = {};
+    bool has_action = false;
+    SettingsUpdate update;
+
+    if (!reader.next(token) || token.type != JsonTokenType::BEGIN_OBJECT) {
+        sendError(client, reader.failed() ? reader.error() : "Expected an object", reader.failed() ? reader.errorOffset() : 0);
+        return;
+    }
+    while (reader.next(token) && token.type == JsonTokenType::KEY) {
+        if (!reader.next(value)) {
+            break;
+        }
+        if (JsonReader::equals(token, "action")) {
+            if (value.type != JsonTokenType::STRING) {
+                sendError(client, "action: expected a string", reader.offsetOf(value));
+                return;
             }
+            action = value;
+            has_action = true;
+            continue;
         }
-    }
-
-    // Handle ntpPort
-    int portPos = jsonData.indexOf("\"ntpPort\"");
-    if (portPos >= 0) {
-        int colonPos = jsonData.indexOf(":", portPos);
-        if (colonPos >= 0) {
-            int commaPos = jsonData.indexOf(",", colonPos);
-            if (commaPos == -1) commaPos = jsonData.indexOf("}", colonPos);
-            if (commaPos > colonPos) {
-                String portStr = jsonData.substring(colonPos + 1, commaPos);
-                portStr.trim();
-                settings->ntp.port = portStr.toInt();
+        if (JsonReader::equals(token, "format")) {
+            if (value.type != JsonTokenType::STRING) {
+                sendError(client, "format: expected a string", reader.offsetOf(value));
+                return;
             }
+            format = value;
+            continue;
         }
-    }
-
-    // Handle ntpPort2
-    int port2Pos = jsonData.indexOf("\"ntpPort2\"");
-    if (port2Pos >= 0) {
-        int colonPos = jsonData.indexOf(":", port2Pos);
-        if (colonPos >= 0) {
-            int commaPos = jsonData.indexOf(",", colonPos);
-            if (commaPos == -1) commaPos = jsonData.indexOf("}", colonPos);
-            if (commaPos > colonPos) {
-                String portStr = jsonData.substring(colonPos + 1, commaPos);
-                portStr.trim();
-                settings->ntp.port2 = portStr.toInt();
+        if (JsonReader::equals(token, "version")) {
+            if (value.type != JsonTokenType::STRING) {
+                sendError(client, "version: expected a string", reader.offsetOf(value));
+                return;
             }
+            version = value;
+            continue;
+        }
+        bool known;
+        if (!update.stage(token, value, known)) {
+            sendError(client, update.error(), reader.offsetOf(value));
+            return;
         }
+        if (!known && !reader.skip(value)) {
+            break;
+        }
+    }
+    // The object has been closed, nothing may follow it
+    if (!reader.failed()) {
+        reader.next(token);
+    }
+    if (reader.failed()) {
+        sendError(client, reader.error(), reader.errorOffset());
+        return;
     }
 
-    // Handle time offset
-    int timeOffsetPos = jsonData.indexOf("\"timeOffset\"");
-    if (timeOffsetPos >= 0) {
-        int colonPos = jsonData.indexOf(":", timeOffsetPos);
-        if (colonPos >= 0) {
-            int commaPos = jsonData.indexOf(",", colonPos);
-            if (commaPos == -1) commaPos = jsonData.indexOf("}", colonPos);
-            if (commaPos > colonPos) {
-                String offsetStr = jsonData.substring(colonPos + 1, commaPos);
-                offsetStr.trim();
-                settings->ntp.timeOffset = offsetStr.toInt();
-                settings->setNTPChangesFlag(true);
-            }
-        }
+    if (!has_action) {
+        sendError(client, "Missing action", 0);
+    } else if (JsonReader::equals(action, "getConfig")) {
+        handleGetConfigWebSocket(client, version);
+    } else if (JsonReader::equals(action, "saveConfig")) {
+        handleSaveConfigWebSocket(client, update);
+    } else if (JsonReader::equals(action, "subscribe")) {
+        handleSubscribeWebSocket(client, format);
+    } else if (JsonReader::equals(action, "getTime")) {
+        // Send current time immediately
+        sendTimeUpdate();
+    } else {
+        sendError(client, "Unknown action", reader.offsetOf(action));
     }
+}
 
-    // Handle channel modes
-    for (int i = 1; i <= 8; i++) {
-        String channelKey = "\"channel_" + String(i) + "_mode\"";
-        int channelPos = jsonData.indexOf(channelKey);
-        if (channelPos >= 0) {
-            int colonPos = jsonData.indexOf(":", channelPos);
-            if (colonPos >= 0) {
-                int commaPos = jsonData.indexOf(",", colonPos);
-                if (commaPos == -1) commaPos = jsonData.indexOf("}", colonPos);
-                if (commaPos > colonPos) {
-                    String modeStr = jsonData.substring(colonPos + 1, commaPos);
-                    modeStr.trim();
-                    uint8_t mode = modeStr.toInt();
-                    Serial.printf("Channel %d mode: %s -> %d\n", i, modeStr.c_str(), mode);
-                    if (mode <= 8) { // Validate mode range (0-8)
-                        switch (i) {
-                            case 1: settings->channel_1_mode = mode; break;
-                            case 2: settings->channel_2_mode = mode; break;
-                            case 3: settings->channel_3_mode = mode; break;
-                            case 4: settings->channel_4_mode = mode; break;
-                            case 5: settings->channel_5_mode = mode; break;
-                            case 6: settings->channel_6_mode = mode; break;
-                            case 7: settings->channel_7_mode = mode; break;
-                            case 8: settings->channel_8_mode = mode; break;
-                        }
-                        Serial.printf("Set channel %d mode to %d\n", i, mode);
-                    } else {
-                        Serial.printf("Invalid mode %d for channel %d (must be 0-8)\n", mode, i);
-                    }
-                }
-            }
-        }
+void IRIGWebServer::handleSubscribeWebSocket(AsyncWebSocketClient *client, const JsonToken& format) {
+    // Status as binary frames, or back to the JSON "time"/"leds" messages
+    bool binary;
+    if (JsonReader::equals(format, TELEMETRY_STATUS_FORMAT)) {
+        binary = true;
+    } else if (JsonReader::equals(format, "json")) {
+        binary = false;
+    } else {
+        sendError(client, "Unsupported format", 0);
+        return;
+    }
+    broadcaster.setBinaryStatus(client->id(), binary);
+
+    char buffer[96];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject();
+    json.field("type", "subscribed");
+    json.field("format", binary ? TELEMETRY_STATUS_FORMAT : "json");
+    json.field("size", binary ? TELEMETRY_STATUS_SIZE : 0);
+    json.endObject();
+    client->text(buffer, json.length());
+}
+
+void IRIGWebServer::handleGetConfigWebSocket(AsyncWebSocketClient *client, const JsonToken& version) {
+    if (!settings) {
+        Serial.println("Settings not available");
+        return;
     }
 
-    // Set network changes flag to trigger reconfiguration if network settings were updated
-    bool networkSettingsChanged = (jsonData.indexOf("\"dhcp\"") >= 0 ||
-                                   jsonData.indexOf("\"ip\"") >= 0 ||
-                                   jsonData.indexOf("\"subnet\"") >= 0 ||
-                                   jsonData.indexOf("\"gateway\"") >= 0 ||
-                                   jsonData.indexOf("\"dns\"") >= 0);
-    if (networkSettingsChanged) {
-        settings->setNetworkChangesFlag(true);
+    xSemaphoreTake(config_lock, portMAX_DELAY);
+    if (!refreshConfig()) {
+        xSemaphoreGive(config_lock);
+        sendError(client, "Configuration not available", 0);
+        return;
+    }
+    // The client already has this configuration
+    if (version.type == JsonTokenType::STRING && JsonReader::equals(version, config_version)) {
+        char buffer[64];
+        JsonWriter json(buffer, sizeof(buffer));
+        json.beginObject();
+        json.field("type", "configUnchanged");
+        json.field("version", config_version);
+        json.endObject();
+        xSemaphoreGive(config_lock);
+        client->text(buffer, json.length());
+        return;
+    }
+    broadcaster.sendRetained(client, config_message);
+    xSemaphoreGive(config_lock);
+}
+
+void IRIGWebServer::handleSaveConfigWebSocket(AsyncWebSocketClient *client, const SettingsUpdate& update) {
+    if (!settings) {
+        Serial.println("Settings not available");
+        return;
     }
 
-    // Set NTP changes flag if NTP settings were updated
-    bool ntpSettingsChanged = (jsonData.indexOf("\"ntpServer\"") >= 0 ||
-                               jsonData.indexOf("\"ntpServer2\"") >= 0 ||
-                               jsonData.indexOf("\"ntpPort\"") >= 0 ||
-                               jsonData.indexOf("\"ntpPort2\"") >= 0 ||
-                               jsonData.indexOf("\"timeOffset\"") >= 0);
-    if (ntpSettingsChanged) {
-        settings->setNTPChangesFlag(true);
+    // Everything was validated while parsing, so this cannot half-apply.
+    // Readers on other tasks keep the old snapshot until the new one is published.
+    SettingsSnapshot previous = settings->get();
+    SettingsData data = *previous;
+    update.apply(data);
+    // Tell the network, NTP and output tasks exactly which fields changed,
+    // if any did
+    ChangeMask changed = settings_diff(*previous, data);
+    if (changed) {
+        settings->publish(data);
+        settings_changes.publish(changed);
     }
 
     // Save settings to Preferences
     if (settings->save()) {
+        xSemaphoreTake(config_lock, portMAX_DELAY);
+        refreshConfig();
+        xSemaphoreGive(config_lock);
+
         String response = "{\"type\":\"configSaved\",\"success\":true,\"message\":\"Configuration saved successfully\"}";
         client->text(response);
         Serial.println("Configuration saved via WebSocket");
         
         // Immediately update LEDs to reflect the new settings
-        update_led(settings->enabled, false); // ntp_sync will be updated in main loop
+        update_led(data.enabled, false); // ntp_sync will be updated in main loop
     } else {
         String response = "{\"type\":\"configSaved\",\"success\":false,\"message\":\"Failed to save configuration\"}";
         client->text(response);
@@ -7,6 +7,15 @@
 #include <Preferences.h>
 #include <AsyncWebSocket.h>
 #include "settings.h"
+#include "settings_schema.h"
+#include "loopback.h"
+#include "ws_broadcast.h"
+#include "telemetry.h"
+#include "metrics.h"
+
+struct WebAsset;
+// Largest WebSocket message accepted from a client, reassembled from fragments
+#define WS_RX_BUFFER_SIZE 2048
 
 class IRIGWebServer {
 public:
@@ -34,14 +43,52 @@ public:
     // Send LED status update via WebSocket (public for main.cpp access)
     void update_led(bool enabled, bool ntp_sync);
 
+    // Send output self-monitor statistics via WebSocket
+    void sendLoopbackStats(const LoopbackStats& stats);
+
+    // Send the binary status frame to its subscribers (sequence is assigned here)
+    void sendStatus(TelemetryStatus& status);
+
+    // Ping, evict and clean up WebSocket clients; call about once per second
+    void maintainClients();
+
+    // WebSocket fan-out counters
+    WsBroadcastStats getBroadcastStats();
+
 private:
     AsyncWebServer* server;
     AsyncWebSocket* ws;
+    WebSocketBroadcaster broadcaster;
     Settings* settings;
     bool running;
+    bool assets_ready;
     uint16_t port;
-
-    // Initialize SPIFFS/LittleFS
+    uint32_t status_sequence;
+
+    // /metrics renders through this one renderer; metrics_request is the
+    // scrape using it, nullptr when idle. Only touched on the async_tcp task.
+    MetricsRenderer metrics_renderer;
+    AsyncWebServerRequest* metrics_request;
+
+    // The "config" message, serialized once per settings revision and sent
+    // by reference to every client that asks. The version is a hash of the
+    // settings JSON, so it only changes when a value does and stays valid
+    // across reboots (it is also the HTTP ETag).
+    SemaphoreHandle_t config_lock;
+    AsyncWebSocketMessageBuffer* config_message;
+    uint32_t config_revision;
+    char config_version[9];
+
+    // Reassembly of fragmented WebSocket messages, reused for every message.
+    // Only one client can be mid-message at a time (all events arrive on the
+    // async_tcp task); rx_client is 0 when idle.
+    char* rx_buffer;
+    size_t rx_length;
+    uint32_t rx_client;
+    bool rx_overflow;
+
+    // Mount SPIFFS; false only when the filesystem itself is unusable, missing
+    // assets are reported and served around
     bool initFileSystem();
 
     // Format filesystem if corrupted
@@ -50,6 +97,17 @@ private:
     // Setup web routes
     void setupRoutes();
 
+    // Re-serialize the config message if the settings were loaded or saved
+    // since it was built; call with config_lock held
+    bool refreshConfig();
+
+    // Serve a gzipped asset, or 304 when the client's copy is current
+    void serveAsset(AsyncWebServerRequest *request, const WebAsset& asset);
+
+    // An asset whose .gz is not in SPIFFS (an older filesystem image): the
+    // uncompressed file if there is one, else the fallback page or a 404
+    void serveMissingAsset(AsyncWebServerRequest *request, const WebAsset& asset);
+
     // Handle root page
     void handleRoot(AsyncWebServerRequest *request);
 
@@ -63,10 +121,17 @@ private:
     // WebSocket event handler
     void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
 
+    // Collect the pieces of a (possibly fragmented) text message
+    void receiveWebSocketData(AsyncWebSocketClient *client, AwsFrameInfo *info, uint8_t *data, size_t len);
+
     // WebSocket message handlers
-    void handleWebSocketMessage(AsyncWebSocketClient *client, String message);
-    void handleGetConfigWebSocket(AsyncWebSocketClient *client);
-    void handleSaveConfigWebSocket(AsyncWebSocketClient *client, String jsonData);
+    void handleWebSocketMessage(AsyncWebSocketClient *client, const char *message, size_t len);
+    void handleGetConfigWebSocket(AsyncWebSocketClient *client, const JsonToken& version);
+    void handleSaveConfigWebSocket(AsyncWebSocketClient *client, const SettingsUpdate& update);
+    void handleSubscribeWebSocket(AsyncWebSocketClient *client, const JsonToken& format);
+
+    // Report a malformed or invalid request to the client
+    void sendError(AsyncWebSocketClient *client, const char *message, size_t offset);
 
 };
 
@@ -0,0 +1,258 @@
+#include "ws_broadcast.h"
+
+WebSocketBroadcaster::WebSocketBroadcaster() : ws(nullptr), lock(nullptr), binary_clients(0) {
+    memset(slots, 0, sizeof(slots));
+    memset(buffers, 0, sizeof(buffers));
+    memset(&counters, 0, sizeof(counters));
+}
+
+WebSocketBroadcaster::~WebSocketBroadcaster() {
+    for (int i = 0; i < WS_MAX_BUFFERS; i++) {
+        delete buffers[i];
+    }
+}
+
+bool WebSocketBroadcaster::begin(AsyncWebSocket* ws) {
+    this->ws = ws;
+    // Events arrive on the async_tcp task, broadcasts come from the main loop
+    lock = xSemaphoreCreateMutex();
+    return lock != nullptr;
+}
+
+WebSocketBroadcaster::ClientSlot* WebSocketBroadcaster::find(uint32_t id) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (slots[i].id == id) {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
+
+bool WebSocketBroadcaster::clientConnected(AsyncWebSocketClient* client) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ClientSlot* slot = find(0);
+    if (slot) {
+        slot->id = client->id();
+        slot->last_seen_ms = millis();
+        slot->last_ping_ms = slot->last_seen_ms;
+        slot->dropped = 0;
+        slot->binary_status = false;
+        counters.clients++;
+    } else {
+        counters.rejected++;
+    }
+    xSemaphoreGive(lock);
+
+    if (!slot) {
+        Serial.printf("WebSocket client #%u refused, %d clients connected\n", client->id(), WS_MAX_CLIENTS);
+        client->close(1013, "Too many clients"); // Try again later
+        return false;
+    }
+    return true;
+}
+
+void WebSocketBroadcaster::release(ClientSlot* slot) {
+    if (slot->binary_status) {
+        binary_clients--;
+    }
+    slot->id = 0;
+    counters.clients--;
+}
+
+void WebSocketBroadcaster::clientDisconnected(uint32_t id) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ClientSlot* slot = find(id);
+    if (slot) {
+        release(slot);
+    }
+    xSemaphoreGive(lock);
+}
+
+void WebSocketBroadcaster::setBinaryStatus(uint32_t id, bool binary) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ClientSlot* slot = find(id);
+    if (slot && slot->binary_status != binary) {
+        slot->binary_status = binary;
+        if (binary) {
+            binary_clients++;
+        } else {
+            binary_clients--;
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+void WebSocketBroadcaster::clientActive(uint32_t id) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ClientSlot* slot = find(id);
+    if (slot) {
+        slot->last_seen_ms = millis();
+    }
+    xSemaphoreGive(lock);
+}
+
+bool WebSocketBroadcaster::hasClients(WsAudience audience) {
+    // Both counts from the same moment, connections change on the async_tcp task
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool any;
+    switch (audience) {
+        case WsAudience::JSON_STATUS:
+            any = counters.clients > binary_clients;
+            break;
+        case WsAudience::BINARY_STATUS:
+            any = binary_clients > 0;
+            break;
+        default:
+            any = counters.clients > 0;
+            break;
+    }
+    xSemaphoreGive(lock);
+    return any;
+}
+
+void WebSocketBroadcaster::reclaimBuffers() {
+    for (int i = 0; i < WS_MAX_BUFFERS; i++) {
+        if (buffers[i] && buffers[i]->canDelete()) {
+            delete buffers[i];
+            buffers[i] = nullptr;
+        }
+    }
+}
+
+AsyncWebSocketMessageBuffer* WebSocketBroadcaster::makeBuffer(size_t len) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    reclaimBuffers();
+    AsyncWebSocketMessageBuffer* buffer = nullptr;
+    for (int i = 0; i < WS_MAX_BUFFERS; i++) {
+        if (!buffers[i]) {
+            buffer = new AsyncWebSocketMessageBuffer(len);
+            if (buffer && !buffer->get()) {
+                delete buffer;
+                buffer = nullptr;
+            }
+            if (buffer) {
+                // Held until broadcast()/send() has handed it to the clients
+                buffer->lock();
+                buffers[i] = buffer;
+            }
+            break;
+        }
+    }
+    if (!buffer) {
+        counters.no_buffer++;
+    }
+    xSemaphoreGive(lock);
+    return buffer;
+}
+
+bool WebSocketBroadcaster::queue(AsyncWebSocketClient* client, AsyncWebSocketMessageBuffer* buffer, WsDelivery delivery, bool binary, ClientSlot* slot) {
+    if (client->status() != WS_CONNECTED) {
+        return false;
+    }
+    if (client->queueIsFull()) {
+        counters.queue_full++;
+        if (slot) slot->dropped++;
+        return false;
+    }
+    // The library does not expose its queue length. Queued messages are
+    // written out as soon as TCP has room, so a send buffer without room
+    // for this message means the previous update is still waiting.
+    AsyncClient* tcp = client->client();
+    if (delivery == WsDelivery::LATEST && (!tcp || tcp->space() <= buffer->length())) {
+        counters.superseded++;
+        if (slot) slot->dropped++;
+        return false;
+    }
+    if (binary) {
+        client->binary(buffer);
+    } else {
+        client->text(buffer);
+    }
+    counters.sent++;
+    return true;
+}
+
+void WebSocketBroadcaster::broadcast(AsyncWebSocketMessageBuffer* buffer, WsDelivery delivery, WsAudience audience) {
+    if (!buffer) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (slots[i].id == 0) {
+            continue;
+        }
+        if ((audience == WsAudience::JSON_STATUS && slots[i].binary_status) ||
+            (audience == WsAudience::BINARY_STATUS && !slots[i].binary_status)) {
+            continue;
+        }
+        AsyncWebSocketClient* client = ws->client(slots[i].id);
+        if (client) {
+            queue(client, buffer, delivery, audience == WsAudience::BINARY_STATUS, &slots[i]);
+        }
+    }
+    buffer->unlock();
+    xSemaphoreGive(lock);
+}
+
+void WebSocketBroadcaster::send(AsyncWebSocketClient* client, AsyncWebSocketMessageBuffer* buffer) {
+    if (!buffer) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    queue(client, buffer, WsDelivery::RELIABLE, false, find(client->id()));
+    buffer->unlock();
+    xSemaphoreGive(lock);
+}
+
+void WebSocketBroadcaster::sendRetained(AsyncWebSocketClient* client, AsyncWebSocketMessageBuffer* buffer) {
+    if (!buffer) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    queue(client, buffer, WsDelivery::RELIABLE, false, find(client->id()));
+    xSemaphoreGive(lock);
+}
+
+void WebSocketBroadcaster::maintain() {
+    if (!ws) {
+        return;
+    }
+    uint32_t now = millis();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        ClientSlot& slot = slots[i];
+        if (slot.id == 0) {
+            continue;
+        }
+        AsyncWebSocketClient* client = ws->client(slot.id);
+        if (!client) {
+            // Went away without a disconnect event
+            release(&slot);
+            continue;
+        }
+        uint32_t silent = now - slot.last_seen_ms;
+        if (silent > WS_IDLE_TIMEOUT_MS) {
+            Serial.printf("WebSocket client #%u silent for %u ms, closing (%u messages dropped)\n",
+                          slot.id, silent, slot.dropped);
+            counters.evicted++;
+            client->close(1001, "Idle timeout");
+            slot.last_seen_ms = now; // Don't close again while the close completes
+        } else if (silent > WS_PING_INTERVAL_MS && now - slot.last_ping_ms > WS_PING_INTERVAL_MS) {
+            // Browsers answer pings on their own, so an open dashboard stays alive
+            client->ping();
+            slot.last_ping_ms = now;
+        }
+    }
+    reclaimBuffers();
+    xSemaphoreGive(lock);
+
+    // Free the client objects of closed connections
+    ws->cleanupClients(WS_MAX_CLIENTS);
+}
+
+WsBroadcastStats WebSocketBroadcaster::stats() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    WsBroadcastStats copy = counters;
+    xSemaphoreGive(lock);
+    return copy;
+}
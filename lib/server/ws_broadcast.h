@@ -0,0 +1,104 @@
+#ifndef WS_BROADCAST_H
+#define WS_BROADCAST_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncWebSocket.h>
+
+// Dashboards served at the same time; further connections are refused
+#define WS_MAX_CLIENTS 8
+
+// A client that sent nothing (data or pong) for this long is pinged
+#define WS_PING_INTERVAL_MS 15000
+
+// ...and closed when it stays silent for this long
+#define WS_IDLE_TIMEOUT_MS 45000
+
+// Message buffers in flight at once, shared by all clients
+#define WS_MAX_BUFFERS 16
+
+enum class WsDelivery : uint8_t {
+    LATEST,     // Periodic state: skipped for a client still sending the previous one
+    RELIABLE    // Queued unless the client's queue is full
+};
+
+enum class WsAudience : uint8_t {
+    ALL,
+    JSON_STATUS,     // Clients taking status as JSON text (the default)
+    BINARY_STATUS    // Subscribers of the binary status stream, sent as binary frames
+};
+
+struct WsBroadcastStats {
+    uint32_t sent;         // Messages queued to a client
+    uint32_t superseded;   // Periodic updates skipped for a congested client
+    uint32_t queue_full;   // Messages dropped because a client's queue was full
+    uint32_t no_buffer;    // Messages dropped for lack of a message buffer
+    uint32_t rejected;     // Connections refused above WS_MAX_CLIENTS
+    uint32_t evicted;      // Clients closed after WS_IDLE_TIMEOUT_MS of silence
+    uint8_t clients;
+};
+
+// Fan-out of WebSocket messages. Each message is serialized once into a
+// buffer owned here and handed to every client by reference; the buffer is
+// freed once all of them have sent it. Slow clients lose periodic updates
+// instead of building up a queue, and dead ones are evicted, so the number
+// of dashboards cannot exhaust the heap.
+class WebSocketBroadcaster {
+public:
+    WebSocketBroadcaster();
+    ~WebSocketBroadcaster();
+
+    bool begin(AsyncWebSocket* ws);
+
+    // Connection events. clientConnected() closes the connection and returns
+    // false when WS_MAX_CLIENTS are already connected.
+    bool clientConnected(AsyncWebSocketClient* client);
+    void clientDisconnected(uint32_t id);
+    void clientActive(uint32_t id);   // Data or pong received
+
+    bool hasClients(WsAudience audience = WsAudience::ALL);
+
+    // Switch a client between JSON and binary status messages
+    void setBinaryStatus(uint32_t id, bool binary);
+
+    // Buffer for a message of 'len' bytes, null if none is available.
+    // Must be passed to broadcast() or send() exactly once.
+    AsyncWebSocketMessageBuffer* makeBuffer(size_t len);
+
+    void broadcast(AsyncWebSocketMessageBuffer* buffer, WsDelivery delivery, WsAudience audience = WsAudience::ALL);
+    void send(AsyncWebSocketClient* client, AsyncWebSocketMessageBuffer* buffer);
+
+    // Queue a buffer from makeBuffer() that the caller keeps for repeated
+    // sends (a cached message). It stays locked until the caller unlock()s
+    // it, after which it is freed once its last send completes.
+    void sendRetained(AsyncWebSocketClient* client, AsyncWebSocketMessageBuffer* buffer);
+
+    // Ping quiet clients, evict silent ones, free sent buffers.
+    // Call about once per second.
+    void maintain();
+
+    WsBroadcastStats stats();
+
+private:
+    struct ClientSlot {
+        uint32_t id;              // 0 = free
+        uint32_t last_seen_ms;
+        uint32_t last_ping_ms;
+        uint32_t dropped;
+        bool binary_status;
+    };
+
+    AsyncWebSocket* ws;
+    SemaphoreHandle_t lock;
+    ClientSlot slots[WS_MAX_CLIENTS];
+    AsyncWebSocketMessageBuffer* buffers[WS_MAX_BUFFERS];
+    WsBroadcastStats counters;
+    uint8_t binary_clients;
+
+    ClientSlot* find(uint32_t id);
+    void reclaimBuffers();
+    bool queue(AsyncWebSocketClient* client, AsyncWebSocketMessageBuffer* buffer, WsDelivery delivery, bool binary, ClientSlot* slot);
+    void release(ClientSlot* slot);
+};
+
+#endif // WS_BROADCAST_H
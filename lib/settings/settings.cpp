@@ -1,110 +1,228 @@
+// Device only, the native tests build the rest of this library
+#ifdef ARDUINO
+
 #include "settings.h"
+#include "irig_encoder.h"
 
 const char* Settings::NAMESPACE = "irigb";
+const char* Settings::RECORD_KEY = "settings";
 
-Settings::Settings() {
+Settings::Settings() : revision_counter(0), stored_valid(false) {
     // Initialize with default values
-    network = getDefaultNetwork();
-    ntp = getDefaultNTP();
-    enabled = getDefaultEnabled();
-    network_changes_flag = getDefaultNetworkChangesFlag();
-    ntp_changes_flag = getDefaultNTPChangesFlag();
-    
-
-    // Initialize channel modes
-    channel_1_mode = getDefaultChannelMode();
-    channel_2_mode = getDefaultChannelMode();
-    channel_3_mode = getDefaultChannelMode();
-    channel_4_mode = getDefaultChannelMode();
-    channel_5_mode = getDefaultChannelMode();
-    channel_6_mode = getDefaultChannelMode();
-    channel_7_mode = getDefaultChannelMode();
-    channel_8_mode = getDefaultChannelMode();
+    std::shared_ptr<SettingsData> data = std::make_shared<SettingsData>();
+    data->network = getDefaultNetwork();
+    data->ntp = getDefaultNTP();
+    data->enabled = getDefaultEnabled();
+    data->time_source = getDefaultTimeSource();
+    data->self_monitor = getDefaultSelfMonitor();
+
+    for (ChannelConfig& channel : data->channels) {
+        channel = getDefaultChannel();
+    }
+    current = data;
 }
 
 Settings::~Settings() {
     // Cleanup if needed
 }
 
+void Settings::publish(const SettingsData& data) {
+    std::atomic_store(&current, SettingsSnapshot(std::make_shared<SettingsData>(data)));
+}
+
 bool Settings::load() {
     Serial.println("Loading settings from Preferences...");
     
     if (!preferences.begin(NAMESPACE, true)) {
-        Serial.println("Failed to open Preferences for reading");
-        return false;
+        // A device that never saved has no namespace yet
+        Serial.println("No settings stored, migrating from defaults");
+        return migrateLegacy();
     }
 
-    // Load network settings
-    network.dhcp = preferences.getBool("dhcp",false);
-    network.ip = preferences.getString("ip","172.16.1.135");
-    network.subnet = preferences.getString("subnet","255.255.255.192");
-    network.gateway = preferences.getString("gateway","172.16.1.129");
-    network.dns = preferences.getString("dns","8.8.8.8");
-
-    // Load NTP settings
-    ntp.server = preferences.getString("ntpServer","10.6.110.150");
-    ntp.server2 = preferences.getString("ntpServer2","pool.ntp.org");
-    ntp.port = preferences.getUShort("ntpPort",123);
-    ntp.port2 = preferences.getUShort("ntpPort2",123);
-    ntp.timeOffset = preferences.getInt("timeOffset",7);
-
-    // Load system settings
-    enabled = preferences.getBool("enabled",true);
-
-    // Load network changes flag
-    network_changes_flag = preferences.getBool("netFlag", network_changes_flag);
-
-    // Load NTP changes flag
-    ntp_changes_flag = preferences.getBool("ntpFlag", ntp_changes_flag);
-
-    // Load channel modes
-    channel_1_mode = preferences.getUChar("channel_1_mode", channel_1_mode);
-    channel_2_mode = preferences.getUChar("channel_2_mode", channel_2_mode);
-    channel_3_mode = preferences.getUChar("channel_3_mode", channel_3_mode);
-    channel_4_mode = preferences.getUChar("channel_4_mode", channel_4_mode);
-    channel_5_mode = preferences.getUChar("channel_5_mode", channel_5_mode);
-    channel_6_mode = preferences.getUChar("channel_6_mode", channel_6_mode);
-    channel_7_mode = preferences.getUChar("channel_7_mode", channel_7_mode);
-    channel_8_mode = preferences.getUChar("channel_8_mode", channel_8_mode);
-
+    SettingsData data = *get();
+    SettingsRecord record;
+    toRecord(data, record);
+    size_t length = preferences.getBytesLength(RECORD_KEY);
+    bool valid = length == sizeof(record) &&
+                 preferences.getBytes(RECORD_KEY, &record, sizeof(record)) == sizeof(record) &&
+                 settings_record_valid(record, length);
+    bool upgraded = false;
+    if (!valid && length == sizeof(SettingsRecordV2)) {
+        // Version 2: the channels keep their settings with no advance
+        SettingsRecordV2 old;
+        upgraded = preferences.getBytes(RECORD_KEY, &old, sizeof(old)) == sizeof(old) &&
+                   settings_record_upgrade(old, length, record);
+    } else if (!valid && length == sizeof(SettingsRecordV1)) {
+        // Version 1: keep its values, the channels start from the defaults
+        SettingsRecordV1 old;
+        upgraded = preferences.getBytes(RECORD_KEY, &old, sizeof(old)) == sizeof(old) &&
+                   settings_record_upgrade(old, length, record);
+    }
     preferences.end();
 
-    Serial.println("Settings loaded successfully");
-    Serial.printf("Network: DHCP=%s, IP=%s\n", network.dhcp ? "true" : "false", network.ip.c_str());
-    Serial.printf("NTP: Server=%s, Server2=%s, Port=%d, Offset=%d\n", ntp.server.c_str(), ntp.server2.c_str(), ntp.port, ntp.timeOffset);
-    Serial.printf("System: Enabled=%s\n", enabled ? "true" : "false");
-    Serial.printf("Channels: 1=%d, 2=%d, 3=%d, 4=%d, 5=%d, 6=%d, 7=%d, 8=%d\n",
-                  channel_1_mode, channel_2_mode, channel_3_mode, channel_4_mode,
-                  channel_5_mode, channel_6_mode, channel_7_mode, channel_8_mode);
+    if (!valid && !upgraded) {
+        if (length > 0) {
+            Serial.printf("Settings record invalid (%u bytes), falling back to the per-key settings\n", (unsigned)length);
+        }
+        return migrateLegacy();
+    }
+
+    fromRecord(record, data);
+    publish(data);
+    stored = record;
+    // An upgraded record is rewritten by the next save()
+    stored_valid = valid;
+    if (upgraded) {
+        Serial.printf("Settings record upgraded to version %d\n", SETTINGS_RECORD_VERSION);
+    }
+    logSettings(data);
+
+    revision_counter++;
+    return true;
+}
 
+bool Settings::migrateLegacy() {
+    if (!preferences.begin(NAMESPACE, false)) {
+        Serial.println("Failed to open Preferences for writing");
+        return false;
+    }
+
+    // Settings as stored before the binary record, one key per field
+    SettingsData data = *get();
+    data.network.dhcp = preferences.getBool("dhcp",false);
+    settings_copy_string(data.network.ip, sizeof(data.network.ip), preferences.getString("ip","172.16.1.135").c_str());
+    settings_copy_string(data.network.subnet, sizeof(data.network.subnet), preferences.getString("subnet","255.255.255.192").c_str());
+    settings_copy_string(data.network.gateway, sizeof(data.network.gateway), preferences.getString("gateway","172.16.1.129").c_str());
+    settings_copy_string(data.network.dns, sizeof(data.network.dns), preferences.getString("dns","8.8.8.8").c_str());
+
+    settings_copy_string(data.ntp.server, sizeof(data.ntp.server), preferences.getString("ntpServer","10.6.110.150").c_str());
+    settings_copy_string(data.ntp.server2, sizeof(data.ntp.server2), preferences.getString("ntpServer2","pool.ntp.org").c_str());
+    data.ntp.port = preferences.getUShort("ntpPort",123);
+    data.ntp.port2 = preferences.getUShort("ntpPort2",123);
+    data.ntp.timeOffset = preferences.getInt("timeOffset",7);
+
+    data.enabled = preferences.getBool("enabled",true);
+    data.time_source = preferences.getUChar("timeSource", data.time_source);
+    data.self_monitor = preferences.getBool("selfMonitor", data.self_monitor);
+    // The old channel_N_mode keys never selected anything on the outputs,
+    // every channel keeps running with the defaults
+    publish(data);
+
+    // Write the record, then drop the old keys so they are never read again
+    SettingsRecord record;
+    toRecord(data, record);
+    bool written = preferences.putBytes(RECORD_KEY, &record, sizeof(record)) == sizeof(record);
+    if (written) {
+        static const char* const LEGACY_KEYS[] = {
+            "dhcp", "ip", "subnet", "gateway", "dns", "ntpServer", "ntpServer2", "ntpPort", "ntpPort2",
+            "timeOffset", "enabled", "timeSource", "selfMonitor", "netFlag", "ntpFlag",
+            "channel_1_mode", "channel_2_mode", "channel_3_mode", "channel_4_mode",
+            "channel_5_mode", "channel_6_mode", "channel_7_mode", "channel_8_mode"};
+        for (const char* key : LEGACY_KEYS) {
+            if (preferences.isKey(key)) {
+                preferences.remove(key);
+            }
+        }
+        stored = record;
+        stored_valid = true;
+        Serial.println("Settings migrated to the binary record");
+    } else {
+        Serial.println("Failed to write the settings record");
+    }
+    preferences.end();
+    logSettings(data);
+
+    revision_counter++;
     return true;
 }
 
-bool Settings::getNetworkChangesFlag() {
-    return network_changes_flag;
+void Settings::logSettings(const SettingsData& data) {
+    Serial.println("Settings loaded successfully");
+    Serial.printf("Network: DHCP=%s, IP=%s\n", data.network.dhcp ? "true" : "false", data.network.ip);
+    Serial.printf("NTP: Server=%s, Server2=%s, Port=%d, Offset=%d\n", data.ntp.server, data.ntp.server2, data.ntp.port, data.ntp.timeOffset);
+    Serial.printf("System: Enabled=%s, TimeSource=%s, SelfMonitor=%s\n", data.enabled ? "true" : "false",
+                  data.time_source == TIME_SOURCE_IRIG ? "IRIG-B input" : "NTP", data.self_monitor ? "true" : "false");
+    logChannels(data);
 }
 
-void Settings::setNetworkChangesFlag(bool flag) {
-    network_changes_flag = flag;
-    // Save immediately when flag is set to true to ensure it's persisted
-    if (flag) {
-        save();
+void Settings::logChannels(const SettingsData& data) {
+    Serial.print("Channels:");
+    for (int i = 0; i < IRIG_CHANNELS; i++) {
+        const ChannelConfig& channel = data.channels[i];
+        Serial.printf(" %d=%s%s%s%s", i + 1, channel.enabled ? "" : "off/", irig_format_name((IrigFormat)channel.format),
+                      channel.utc ? "/UTC" : "", channel.invert ? "/inv" : "");
+        if (channel.advance_us) {
+            Serial.printf("/-%uus", (unsigned)channel.advance_us);
+        }
     }
+    Serial.println();
 }
 
-bool Settings::getNTPChangesFlag() {
-    return ntp_changes_flag;
+void Settings::toRecord(const SettingsData& data, SettingsRecord& record) {
+    memset(&record, 0, sizeof(record));
+    record.dhcp = data.network.dhcp;
+    record.enabled = data.enabled;
+    record.time_source = data.time_source;
+    record.self_monitor = data.self_monitor;
+    settings_copy_string(record.ip, sizeof(record.ip), data.network.ip);
+    settings_copy_string(record.subnet, sizeof(record.subnet), data.network.subnet);
+    settings_copy_string(record.gateway, sizeof(record.gateway), data.network.gateway);
+    settings_copy_string(record.dns, sizeof(record.dns), data.network.dns);
+    settings_copy_string(record.ntp_server, sizeof(record.ntp_server), data.ntp.server);
+    settings_copy_string(record.ntp_server2, sizeof(record.ntp_server2), data.ntp.server2);
+    record.ntp_port = data.ntp.port;
+    record.ntp_port2 = data.ntp.port2;
+    record.time_offset = data.ntp.timeOffset;
+    for (int i = 0; i < IRIG_CHANNELS; i++) {
+        const ChannelConfig& channel = data.channels[i];
+        record.channels[i].format = channel.format;
+        record.channels[i].flags = (channel.utc ? SETTINGS_CHANNEL_UTC : 0) |
+                                   (channel.enabled ? SETTINGS_CHANNEL_ENABLED : 0) |
+                                   (channel.invert ? SETTINGS_CHANNEL_INVERT : 0);
+        record.channels[i].advance_us = channel.advance_us;
+    }
+    settings_record_seal(record);
 }
 
-void Settings::setNTPChangesFlag(bool flag) {
-    ntp_changes_flag = flag;
-    // Save immediately when flag is set to true to ensure it's persisted
-    if (flag) {
-        save();
+void Settings::fromRecord(const SettingsRecord& record, SettingsData& data) {
+    data.network.dhcp = record.dhcp;
+    settings_copy_string(data.network.ip, sizeof(data.network.ip), record.ip);
+    settings_copy_string(data.network.subnet, sizeof(data.network.subnet), record.subnet);
+    settings_copy_string(data.network.gateway, sizeof(data.network.gateway), record.gateway);
+    settings_copy_string(data.network.dns, sizeof(data.network.dns), record.dns);
+    settings_copy_string(data.ntp.server, sizeof(data.ntp.server), record.ntp_server);
+    settings_copy_string(data.ntp.server2, sizeof(data.ntp.server2), record.ntp_server2);
+    data.ntp.port = record.ntp_port;
+    data.ntp.port2 = record.ntp_port2;
+    data.ntp.timeOffset = record.time_offset;
+    data.enabled = record.enabled;
+    data.time_source = record.time_source;
+    data.self_monitor = record.self_monitor;
+    for (int i = 0; i < IRIG_CHANNELS; i++) {
+        ChannelConfig& channel = data.channels[i];
+        // A format this firmware does not know falls back to the default
+        channel.format = record.channels[i].format < IRIG_FORMAT_COUNT ? record.channels[i].format
+                                                                       : (uint8_t)IRIG_FORMAT_DEFAULT;
+        channel.utc = record.channels[i].flags & SETTINGS_CHANNEL_UTC;
+        channel.enabled = record.channels[i].flags & SETTINGS_CHANNEL_ENABLED;
+        channel.invert = record.channels[i].flags & SETTINGS_CHANNEL_INVERT;
+        channel.advance_us = record.channels[i].advance_us <= IRIG_ADVANCE_MAX_US ? record.channels[i].advance_us
+                                                                                 : IRIG_ADVANCE_MAX_US;
     }
 }
 
 bool Settings::save() {
+    SettingsSnapshot data = get();
+    SettingsRecord record;
+    toRecord(*data, record);
+
+    // Nothing changed since the last load or save: no flash write, and the
+    // revision stays so cached serializations stay valid
+    if (stored_valid && memcmp(&record, &stored, sizeof(record)) == 0) {
+        Serial.println("Settings unchanged, nothing to save");
+        return true;
+    }
+
     Serial.println("Saving settings to Preferences...");
     
     if (!preferences.begin(NAMESPACE, false)) {
@@ -112,62 +230,38 @@ bool Settings::save() {
         return false;
     }
 
-    // Save network settings
-    preferences.putBool("dhcp", network.dhcp);
-    preferences.putString("ip", network.ip);
-    preferences.putString("subnet", network.subnet);
-    preferences.putString("gateway", network.gateway);
-    preferences.putString("dns", network.dns);
-
-    // Save NTP settings
-    preferences.putString("ntpServer", ntp.server);
-    preferences.putString("ntpServer2", ntp.server2);
-    preferences.putUShort("ntpPort", ntp.port);
-    preferences.putUShort("ntpPort2", ntp.port2);
-    preferences.putInt("timeOffset", ntp.timeOffset);
-
-    // Save system settings
-    preferences.putBool("enabled", enabled);
-
-    // Save network changes flag
-    preferences.putBool("netFlag", network_changes_flag);
-
-    // Save NTP changes flag
-    preferences.putBool("ntpFlag", ntp_changes_flag);
-
-    // Save channel modes
-    Serial.printf("Saving channel modes: 1=%d, 2=%d, 3=%d, 4=%d, 5=%d, 6=%d, 7=%d, 8=%d\n", 
-                  channel_1_mode, channel_2_mode, channel_3_mode, channel_4_mode,
-                  channel_5_mode, channel_6_mode, channel_7_mode, channel_8_mode);
-    preferences.putUChar("channel_1_mode", channel_1_mode);
-    preferences.putUChar("channel_2_mode", channel_2_mode);
-    preferences.putUChar("channel_3_mode", channel_3_mode);
-    preferences.putUChar("channel_4_mode", channel_4_mode);
-    preferences.putUChar("channel_5_mode", channel_5_mode);
-    preferences.putUChar("channel_6_mode", channel_6_mode);
-    preferences.putUChar("channel_7_mode", channel_7_mode);
-    preferences.putUChar("channel_8_mode", channel_8_mode);
+    logChannels(*data);
+    size_t written = preferences.putBytes(RECORD_KEY, &record, sizeof(record));
 
     preferences.end();
 
+    if (written != sizeof(record)) {
+        Serial.println("Failed to write the settings record");
+        stored_valid = false;
+        return false;
+    }
+    stored = record;
+    stored_valid = true;
+
+    revision_counter++;
     Serial.println("Settings saved successfully");
     return true;
 }
 
-Settings::NetworkConfig Settings::getDefaultNetwork() {
-    NetworkConfig config;
+SettingsData::NetworkConfig Settings::getDefaultNetwork() {
+    SettingsData::NetworkConfig config;
     config.dhcp = true;
-    config.ip = "192.168.1.100";
-    config.subnet = "255.255.255.0";
-    config.gateway = "192.168.1.1";
-    config.dns = "8.8.8.8";
+    settings_copy_string(config.ip, sizeof(config.ip), "192.168.1.100");
+    settings_copy_string(config.subnet, sizeof(config.subnet), "255.255.255.0");
+    settings_copy_string(config.gateway, sizeof(config.gateway), "192.168.1.1");
+    settings_copy_string(config.dns, sizeof(config.dns), "8.8.8.8");
     return config;
 }
 
-Settings::NTPConfig Settings::getDefaultNTP() {
-    NTPConfig config;
-    config.server = "pool.ntp.org";
-    config.server2 = "time.nist.gov";
+SettingsData::NTPConfig Settings::getDefaultNTP() {
+    SettingsData::NTPConfig config;
+    settings_copy_string(config.server, sizeof(config.server), "pool.ntp.org");
+    settings_copy_string(config.server2, sizeof(config.server2), "time.nist.gov");
     config.port = 123;
     config.port2 = 123;
     config.timeOffset = 0;
@@ -178,14 +272,22 @@ bool Settings::getDefaultEnabled() {
     return true;
 }
 
-bool Settings::getDefaultNetworkChangesFlag() {
-    return false;  // Default to false, no changes pending
+ChannelConfig Settings::getDefaultChannel() {
+    ChannelConfig channel;
+    channel.format = (uint8_t)IRIG_FORMAT_DEFAULT;
+    channel.utc = false;
+    channel.enabled = true;
+    channel.invert = false;
+    channel.advance_us = 0;
+    return channel;
 }
 
-bool Settings::getDefaultNTPChangesFlag() {
-    return false;  // Default to false, no changes pending
+uint8_t Settings::getDefaultTimeSource() {
+    return TIME_SOURCE_NTP;
 }
 
-uint8_t Settings::getDefaultChannelMode() {
-    return 0;  // Default to FORMAT_B000_B120
+bool Settings::getDefaultSelfMonitor() {
+    return false;
 }
+
+#endif // ARDUINO
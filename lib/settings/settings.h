@@ -3,31 +3,44 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <memory>
+#include "settings_record.h"
+#include "irig_format.h"
+
+// Time reference for the outputs
+#define TIME_SOURCE_NTP 0   // NTP client, outputs free-run between updates
+#define TIME_SOURCE_IRIG 1  // IRIG-B input on P8 disciplines the outputs (distribution amplifier)
+
+// Longest address and host name values, including the terminating NUL
+#define SETTINGS_ADDRESS_SIZE SETTINGS_RECORD_ADDRESS
+#define SETTINGS_STRING_SIZE  SETTINGS_RECORD_STRING
+
+// One IRIG-B output
+struct ChannelConfig {
+    uint8_t format;   // IrigFormat
+    bool utc;         // Send UTC with a zero offset instead of local time
+    bool enabled;
+    bool invert;      // Idle high, pulses low
+    uint16_t advance_us; // Send the edges this much early to make up for the cable delay
+};
 
-class Settings {
-public:
-    Settings();
-    ~Settings();
-
-    // Load settings from Preferences
-    bool load();
-
-    // Save settings to Preferences
-    bool save();
-
+// One consistent set of settings values. Published snapshots are never
+// modified: a writer copies the current one, changes the copy and publishes
+// it, so a reader holding a snapshot can use it for as long as it likes.
+struct SettingsData {
     // Network settings
     struct NetworkConfig {
         bool dhcp;
-        String ip;
-        String subnet;
-        String gateway;
-        String dns;
+        char ip[SETTINGS_ADDRESS_SIZE];
+        char subnet[SETTINGS_ADDRESS_SIZE];
+        char gateway[SETTINGS_ADDRESS_SIZE];
+        char dns[SETTINGS_ADDRESS_SIZE];
     } network;
 
     // NTP settings
     struct NTPConfig {
-        String server;
-        String server2; // Second NTP server for redundancy
+        char server[SETTINGS_STRING_SIZE];
+        char server2[SETTINGS_STRING_SIZE]; // Second NTP server for redundancy
         uint16_t port;
         uint16_t port2; // Port for second NTP server
         int32_t timeOffset; // Time offset in hours
@@ -36,44 +49,71 @@ public:
     // System settings
     bool enabled;
 
-    // Network changes flag - set to true when network settings are updated via web interface
-    bool network_changes_flag;
+    // Time reference (TIME_SOURCE_*), applied at boot
+    uint8_t time_source;
 
-    // NTP changes flag - set to true when NTP settings are updated via web interface
-    bool ntp_changes_flag;
-    
+    // Read channel 8 back on the decoder and measure output phase, applied at boot
+    bool self_monitor;
 
-    // IRIG channel modes (8 channels)
-    uint8_t channel_1_mode;
-    uint8_t channel_2_mode;
-    uint8_t channel_3_mode;
-    uint8_t channel_4_mode;
-    uint8_t channel_5_mode;
-    uint8_t channel_6_mode;
-    uint8_t channel_7_mode;
-    uint8_t channel_8_mode;
+    // IRIG-B outputs, index 0 is P1
+    ChannelConfig channels[IRIG_CHANNELS];
+};
+
+typedef std::shared_ptr<const SettingsData> SettingsSnapshot;
+
+// Settings shared between the web server (the only writer, on the async_tcp
+// task) and the NTP, ethernet monitor and main loop tasks. Readers take a
+// snapshot with get(), which holds a short internal lock (the shared_ptr
+// atomics of libstdc++ use a mutex pool) only while the reference count is
+// taken; writers publish a new one the same way and the old one is freed
+// when its last reader drops it.
+class Settings {
+public:
+    Settings();
+    ~Settings();
 
-    // Network changes flag methods
-    bool getNetworkChangesFlag();
+    // Load settings from Preferences, migrating the per-key layout of older
+    // firmware to the binary record on first boot
+    bool load();
+
+    // Save the current snapshot to Preferences; nothing is written when the
+    // record is unchanged since the last load() or save()
+    bool save();
 
-    void setNetworkChangesFlag(bool flag);
+    // Incremented by every load() and by every save() that writes, so
+    // cached serializations of the settings know when to rebuild
+    uint32_t revision() const { return revision_counter; }
 
-    // NTP changes flag methods
-    bool getNTPChangesFlag();
+    // Current values, valid for as long as the caller keeps the snapshot
+    SettingsSnapshot get() const { return std::atomic_load(&current); }
 
-    void setNTPChangesFlag(bool flag);
+    // Replace the current values (does not save them)
+    void publish(const SettingsData& data);
 
     // Get default values
-    static NetworkConfig getDefaultNetwork();
-    static NTPConfig getDefaultNTP();
+    static SettingsData::NetworkConfig getDefaultNetwork();
+    static SettingsData::NTPConfig getDefaultNTP();
     static bool getDefaultEnabled();
-    static bool getDefaultNetworkChangesFlag();
-    static bool getDefaultNTPChangesFlag();
-    static uint8_t getDefaultChannelMode();
+    static ChannelConfig getDefaultChannel();
+    static uint8_t getDefaultTimeSource();
+    static bool getDefaultSelfMonitor();
 
 private:
     Preferences preferences;
     static const char* NAMESPACE;
+    static const char* RECORD_KEY;
+    SettingsSnapshot current;
+    volatile uint32_t revision_counter;
+
+    // Last record read from or written to flash
+    SettingsRecord stored;
+    bool stored_valid;
+
+    bool migrateLegacy();
+    void logSettings(const SettingsData& data);
+    void logChannels(const SettingsData& data);
+    static void toRecord(const SettingsData& data, SettingsRecord& record);
+    static void fromRecord(const SettingsRecord& record, SettingsData& data);
 };
 
 #endif // SETTINGS_H
@@ -0,0 +1,61 @@
+#include "settings_record.h"
+#include <string.h>
+
+uint32_t settings_crc32(const void* data, size_t len) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+void settings_record_seal(SettingsRecord& record) {
+  record.magic = SETTINGS_RECORD_MAGIC;
+  record.version = SETTINGS_RECORD_VERSION;
+  record.length = sizeof(SettingsRecord);
+  record.crc = settings_crc32(&record, offsetof(SettingsRecord, crc));
+}
+
+bool settings_record_valid(const SettingsRecord& record, size_t stored_length) {
+  if (stored_length != sizeof(SettingsRecord)) return false;
+  if (record.magic != SETTINGS_RECORD_MAGIC) return false;
+  if (record.version != SETTINGS_RECORD_VERSION || record.length != sizeof(SettingsRecord)) return false;
+  return record.crc == settings_crc32(&record, offsetof(SettingsRecord, crc));
+}
+
+bool settings_record_upgrade(const SettingsRecordV1& old, size_t stored_length, SettingsRecord& record) {
+  if (stored_length != sizeof(SettingsRecordV1)) return false;
+  if (old.magic != SETTINGS_RECORD_MAGIC || old.version != 1 || old.length != sizeof(SettingsRecordV1)) return false;
+  if (old.crc != settings_crc32(&old, offsetof(SettingsRecordV1, crc))) return false;
+
+  // Everything up to the channels kept its place
+  memcpy(&record, &old, offsetof(SettingsRecordV1, channel_mode));
+  settings_record_seal(record);
+  return true;
+}
+
+bool settings_record_upgrade(const SettingsRecordV2& old, size_t stored_length, SettingsRecord& record) {
+  if (stored_length != sizeof(SettingsRecordV2)) return false;
+  if (old.magic != SETTINGS_RECORD_MAGIC || old.version != 2 || old.length != sizeof(SettingsRecordV2)) return false;
+  if (old.crc != settings_crc32(&old, offsetof(SettingsRecordV2, crc))) return false;
+
+  memcpy(&record, &old, offsetof(SettingsRecordV2, channels));
+  for (int i = 0; i < SETTINGS_RECORD_CHANNELS; i++) {
+    record.channels[i].format = old.channels[i].format;
+    record.channels[i].flags = old.channels[i].flags;
+    record.channels[i].advance_us = 0;
+  }
+  settings_record_seal(record);
+  return true;
+}
+
+void settings_copy_string(char* out, size_t capacity, const char* text) {
+  memset(out, 0, capacity);
+  if (text) {
+    strncpy(out, text, capacity - 1);
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef SETTINGS_RECORD_H
+#define SETTINGS_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// Persistent form of Settings: one fixed-layout record stored as a single
+// NVS blob instead of a key per field. 'version' identifies the layout and
+// is raised whenever fields are added, so load() can migrate older records.
+// The CRC covers every byte before it; strings are NUL padded so equal
+// settings always produce identical records.
+
+#define SETTINGS_RECORD_MAGIC   0x42474952u   // "RIGB"
+#define SETTINGS_RECORD_VERSION 3
+
+#define SETTINGS_RECORD_STRING  64   // SETTINGS_STRING_MAX + NUL
+#define SETTINGS_RECORD_ADDRESS 16   // Dotted quad + NUL
+#define SETTINGS_RECORD_CHANNELS 8
+
+// SettingsRecordChannel::flags
+#define SETTINGS_CHANNEL_UTC     0x01
+#define SETTINGS_CHANNEL_ENABLED 0x02
+#define SETTINGS_CHANNEL_INVERT  0x04
+
+struct __attribute__((packed)) SettingsRecordChannel {
+  uint8_t format;               // IrigFormat
+  uint8_t flags;                // SETTINGS_CHANNEL_*
+  uint16_t advance_us;          // Cable delay compensation
+};
+
+struct __attribute__((packed)) SettingsRecord {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;              // sizeof(SettingsRecord) of that version
+  uint8_t dhcp;
+  uint8_t enabled;
+  uint8_t time_source;
+  uint8_t self_monitor;
+  char ip[SETTINGS_RECORD_ADDRESS];
+  char subnet[SETTINGS_RECORD_ADDRESS];
+  char gateway[SETTINGS_RECORD_ADDRESS];
+  char dns[SETTINGS_RECORD_ADDRESS];
+  char ntp_server[SETTINGS_RECORD_STRING];
+  char ntp_server2[SETTINGS_RECORD_STRING];
+  uint16_t ntp_port;
+  uint16_t ntp_port2;
+  int32_t time_offset;
+  SettingsRecordChannel channels[SETTINGS_RECORD_CHANNELS];
+  uint32_t crc;
+};
+
+// Version 2 layout, read once to migrate: channels without an advance
+struct __attribute__((packed)) SettingsRecordChannelV2 {
+  uint8_t format;
+  uint8_t flags;
+};
+
+struct __attribute__((packed)) SettingsRecordV2 {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint8_t dhcp;
+  uint8_t enabled;
+  uint8_t time_source;
+  uint8_t self_monitor;
+  char ip[SETTINGS_RECORD_ADDRESS];
+  char subnet[SETTINGS_RECORD_ADDRESS];
+  char gateway[SETTINGS_RECORD_ADDRESS];
+  char dns[SETTINGS_RECORD_ADDRESS];
+  char ntp_server[SETTINGS_RECORD_STRING];
+  char ntp_server2[SETTINGS_RECORD_STRING];
+  uint16_t ntp_port;
+  uint16_t ntp_port2;
+  int32_t time_offset;
+  SettingsRecordChannelV2 channels[SETTINGS_RECORD_CHANNELS];
+  uint32_t crc;
+};
+
+// Version 1 layout, read once to migrate. Its channel modes never selected
+// anything on the outputs and are not carried over.
+struct __attribute__((packed)) SettingsRecordV1 {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint8_t dhcp;
+  uint8_t enabled;
+  uint8_t time_source;
+  uint8_t self_monitor;
+  char ip[SETTINGS_RECORD_ADDRESS];
+  char subnet[SETTINGS_RECORD_ADDRESS];
+  char gateway[SETTINGS_RECORD_ADDRESS];
+  char dns[SETTINGS_RECORD_ADDRESS];
+  char ntp_server[SETTINGS_RECORD_STRING];
+  char ntp_server2[SETTINGS_RECORD_STRING];
+  uint16_t ntp_port;
+  uint16_t ntp_port2;
+  int32_t time_offset;
+  uint8_t channel_mode[8];
+  uint32_t crc;
+};
+
+// CRC-32 (IEEE 802.3, reflected)
+uint32_t settings_crc32(const void* data, size_t len);
+
+// Fill in magic, version, length and CRC after the fields were set
+void settings_record_seal(SettingsRecord& record);
+
+// True for a current-version record of 'stored_length' bytes with a good CRC
+bool settings_record_valid(const SettingsRecord& record, size_t stored_length);
+
+// Convert a valid version 1 record of 'stored_length' bytes, leaving the
+// channels of 'record' as they are, and seal it. False when 'old' is not one.
+bool settings_record_upgrade(const SettingsRecordV1& old, size_t stored_length, SettingsRecord& record);
+
+// The same for a version 2 record; its channels are kept with no advance
+bool settings_record_upgrade(const SettingsRecordV2& old, size_t stored_length, SettingsRecord& record);
+
+// Bounded copy into a settings string, NUL padding the rest
+void settings_copy_string(char* out, size_t capacity, const char* text);
+
+#endif // SETTINGS_RECORD_H
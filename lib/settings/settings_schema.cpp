@@ -0,0 +1,230 @@
+// Device only, the native tests build the rest of this library
+#ifdef ARDUINO
+
+#include "settings_schema.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SETTINGS_FIELD(key, type, expr, min, max, changes) \
+    { key, SettingsFieldType::type, [](SettingsData& s) -> void* { return &s.expr; }, \
+      [](const SettingsData& s) -> const void* { return &s.expr; }, \
+      sizeof(((SettingsData*)nullptr)->expr), min, max, changes }
+
+// channel_<n>_format, _utc, _enabled, _invert and _advance of output n (1 based)
+#define CHANNEL_FIELDS(n) \
+    SETTINGS_FIELD("channel_" #n "_format", UINT8, channels[n - 1].format, 0, IRIG_FORMAT_COUNT - 1, SETTINGS_CHANGE_OUTPUT), \
+    SETTINGS_FIELD("channel_" #n "_utc", BOOL, channels[n - 1].utc, 0, 1, SETTINGS_CHANGE_OUTPUT), \
+    SETTINGS_FIELD("channel_" #n "_enabled", BOOL, channels[n - 1].enabled, 0, 1, SETTINGS_CHANGE_OUTPUT), \
+    SETTINGS_FIELD("channel_" #n "_invert", BOOL, channels[n - 1].invert, 0, 1, SETTINGS_CHANGE_OUTPUT), \
+    SETTINGS_FIELD("channel_" #n "_advance", UINT16, channels[n - 1].advance_us, 0, IRIG_ADVANCE_MAX_US, SETTINGS_CHANGE_OUTPUT)
+
+const SettingsField SETTINGS_FIELDS[] = {
+    SETTINGS_FIELD("dhcp", BOOL, network.dhcp, 0, 1, SETTINGS_CHANGE_NETWORK),
+    SETTINGS_FIELD("ip", IPV4, network.ip, 0, 0, SETTINGS_CHANGE_NETWORK),
+    SETTINGS_FIELD("subnet", IPV4, network.subnet, 0, 0, SETTINGS_CHANGE_NETWORK),
+    SETTINGS_FIELD("gateway", IPV4, network.gateway, 0, 0, SETTINGS_CHANGE_NETWORK),
+    SETTINGS_FIELD("dns", IPV4, network.dns, 0, 0, SETTINGS_CHANGE_NETWORK),
+    SETTINGS_FIELD("ntpServer", STRING, ntp.server, 0, SETTINGS_STRING_MAX, SETTINGS_CHANGE_NTP),
+    SETTINGS_FIELD("ntpServer2", STRING, ntp.server2, 0, SETTINGS_STRING_MAX, SETTINGS_CHANGE_NTP),
+    SETTINGS_FIELD("ntpPort", UINT16, ntp.port, 1, 65535, SETTINGS_CHANGE_NTP),
+    SETTINGS_FIELD("ntpPort2", UINT16, ntp.port2, 1, 65535, SETTINGS_CHANGE_NTP),
+    SETTINGS_FIELD("timeOffset", INT32, ntp.timeOffset, -12, 14, SETTINGS_CHANGE_NTP | SETTINGS_CHANGE_OUTPUT),
+    SETTINGS_FIELD("enabled", BOOL, enabled, 0, 1, SETTINGS_CHANGE_OUTPUT),
+    SETTINGS_FIELD("timeSource", UINT8, time_source, TIME_SOURCE_NTP, TIME_SOURCE_IRIG, 0),
+    SETTINGS_FIELD("selfMonitor", BOOL, self_monitor, 0, 1, 0),
+    CHANNEL_FIELDS(1),
+    CHANNEL_FIELDS(2),
+    CHANNEL_FIELDS(3),
+    CHANNEL_FIELDS(4),
+    CHANNEL_FIELDS(5),
+    CHANNEL_FIELDS(6),
+    CHANNEL_FIELDS(7),
+    CHANNEL_FIELDS(8),
+};
+
+const size_t SETTINGS_FIELD_COUNT = sizeof(SETTINGS_FIELDS) / sizeof(SETTINGS_FIELDS[0]);
+
+static_assert(IRIG_CHANNELS == 8, "SETTINGS_FIELDS lists the fields of 8 channels");
+static_assert(sizeof(SETTINGS_FIELDS) / sizeof(SETTINGS_FIELDS[0]) <= 64, "SettingsUpdate tracks at most 64 fields");
+
+uint64_t settings_fields_mask(uint8_t changes) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < SETTINGS_FIELD_COUNT; i++) {
+        if (SETTINGS_FIELDS[i].changes & changes) {
+            mask |= (uint64_t)1 << i;
+        }
+    }
+    return mask;
+}
+
+uint64_t settings_diff(const SettingsData& a, const SettingsData& b) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < SETTINGS_FIELD_COUNT; i++) {
+        const SettingsField& field = SETTINGS_FIELDS[i];
+        bool differs;
+        if (field.type == SettingsFieldType::STRING || field.type == SettingsFieldType::IPV4) {
+            differs = strcmp(static_cast<const char*>(field.value(a)), static_cast<const char*>(field.value(b))) != 0;
+        } else {
+            differs = memcmp(field.value(a), field.value(b), field.size) != 0;
+        }
+        if (differs) {
+            mask |= (uint64_t)1 << i;
+        }
+    }
+    return mask;
+}
+
+int settings_find_field(const JsonToken& key) {
+    for (size_t i = 0; i < SETTINGS_FIELD_COUNT; i++) {
+        if (JsonReader::equals(key, SETTINGS_FIELDS[i].key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void settings_write_json(JsonWriter& writer, const SettingsData& data) {
+    for (size_t i = 0; i < SETTINGS_FIELD_COUNT; i++) {
+        const SettingsField& field = SETTINGS_FIELDS[i];
+        const void* value = field.value(data);
+        writer.key(field.key);
+        switch (field.type) {
+            case SettingsFieldType::BOOL:
+                writer.value(*static_cast<const bool*>(value));
+                break;
+            case SettingsFieldType::UINT8:
+                writer.value((unsigned int)*static_cast<const uint8_t*>(value));
+                break;
+            case SettingsFieldType::UINT16:
+                writer.value((unsigned int)*static_cast<const uint16_t*>(value));
+                break;
+            case SettingsFieldType::INT32:
+                writer.value((long)*static_cast<const int32_t*>(value));
+                break;
+            case SettingsFieldType::STRING:
+            case SettingsFieldType::IPV4:
+                writer.value(static_cast<const char*>(value));
+                break;
+        }
+    }
+}
+
+// Empty or four dot separated decimal octets
+static bool isIPv4(const char* s) {
+    if (*s == 0) {
+        return true;
+    }
+    for (int octet = 0; octet < 4; octet++) {
+        if (octet > 0 && *s++ != '.') {
+            return false;
+        }
+        int value = 0;
+        int digits = 0;
+        while (*s >= '0' && *s <= '9') {
+            value = value * 10 + (*s++ - '0');
+            if (++digits > 3) {
+                return false;
+            }
+        }
+        if (digits == 0 || value > 255) {
+            return false;
+        }
+    }
+    return *s == 0;
+}
+
+SettingsUpdate::SettingsUpdate() : present(0) {
+    message[0] = 0;
+}
+
+bool SettingsUpdate::stage(const JsonToken& key, const JsonToken& value, bool& known) {
+    int index = settings_find_field(key);
+    known = index >= 0;
+    if (!known) {
+        return true;
+    }
+
+    const SettingsField& field = SETTINGS_FIELDS[index];
+    switch (field.type) {
+        case SettingsFieldType::BOOL:
+            if (value.type != JsonTokenType::TRUE_VALUE && value.type != JsonTokenType::FALSE_VALUE) {
+                snprintf(message, sizeof(message), "%s: expected true or false", field.key);
+                return false;
+            }
+            break;
+        case SettingsFieldType::UINT8:
+        case SettingsFieldType::UINT16:
+        case SettingsFieldType::INT32: {
+            int32_t number;
+            if (value.type != JsonTokenType::NUMBER || !JsonReader::toInt32(value, number)) {
+                snprintf(message, sizeof(message), "%s: expected an integer", field.key);
+                return false;
+            }
+            if (number < field.min || number > field.max) {
+                snprintf(message, sizeof(message), "%s: %ld is outside %ld..%ld",
+                         field.key, (long)number, (long)field.min, (long)field.max);
+                return false;
+            }
+            break;
+        }
+        case SettingsFieldType::STRING:
+        case SettingsFieldType::IPV4: {
+            if (value.type != JsonTokenType::STRING) {
+                snprintf(message, sizeof(message), "%s: expected a string", field.key);
+                return false;
+            }
+            char text[SETTINGS_STRING_MAX + 1];
+            size_t length = JsonReader::copyString(value, text, sizeof(text));
+            if (length > SETTINGS_STRING_MAX || (field.type == SettingsFieldType::STRING && (int32_t)length > field.max)) {
+                snprintf(message, sizeof(message), "%s: longer than %d characters", field.key,
+                         field.type == SettingsFieldType::STRING ? (int)field.max : SETTINGS_STRING_MAX);
+                return false;
+            }
+            if (field.type == SettingsFieldType::IPV4 && !isIPv4(text)) {
+                snprintf(message, sizeof(message), "%s: \"%s\" is not an IPv4 address", field.key, text);
+                return false;
+            }
+            break;
+        }
+    }
+
+    values[index] = value;
+    present |= (uint64_t)1 << index;
+    return true;
+}
+
+void SettingsUpdate::apply(SettingsData& data) const {
+    for (size_t i = 0; i < SETTINGS_FIELD_COUNT; i++) {
+        if (!(present & ((uint64_t)1 << i))) {
+            continue;
+        }
+        const SettingsField& field = SETTINGS_FIELDS[i];
+        const JsonToken& value = values[i];
+        void* target = field.member(data);
+        int32_t number = 0;
+        JsonReader::toInt32(value, number);
+        switch (field.type) {
+            case SettingsFieldType::BOOL:
+                *static_cast<bool*>(target) = value.type == JsonTokenType::TRUE_VALUE;
+                break;
+            case SettingsFieldType::UINT8:
+                *static_cast<uint8_t*>(target) = (uint8_t)number;
+                break;
+            case SettingsFieldType::UINT16:
+                *static_cast<uint16_t*>(target) = (uint16_t)number;
+                break;
+            case SettingsFieldType::INT32:
+                *static_cast<int32_t*>(target) = number;
+                break;
+            case SettingsFieldType::STRING:
+            case SettingsFieldType::IPV4: {
+                // Validated to fit while staging; copyString NUL terminates
+                memset(target, 0, field.size);
+                JsonReader::copyString(value, static_cast<char*>(target), field.size);
+                break;
+            }
+        }
+    }
+}
+
+#endif // ARDUINO
@@ -0,0 +1,82 @@
+#ifndef SETTINGS_SCHEMA_H
+#define SETTINGS_SCHEMA_H
+
+#include <Arduino.h>
+#include "settings.h"
+#include "json_reader.h"
+#include "json_writer.h"
+
+// Field descriptors for SettingsData: one table drives both the JSON
+// representation and the validation of incoming values.
+
+enum class SettingsFieldType : uint8_t {
+    BOOL,
+    UINT8,
+    UINT16,
+    INT32,
+    STRING,
+    IPV4      // Dotted quad string, may be empty
+};
+
+// Which subsystem has to pick up a changed field
+#define SETTINGS_CHANGE_NETWORK 0x01
+#define SETTINGS_CHANGE_NTP     0x02
+#define SETTINGS_CHANGE_OUTPUT  0x04   // IRIG-B outputs and front panel
+
+// Longest STRING value accepted
+#define SETTINGS_STRING_MAX 63
+
+struct SettingsField {
+    const char* key;                       // JSON member name
+    SettingsFieldType type;
+    void* (*member)(SettingsData& data);   // Location of the value, for the parser
+    const void* (*value)(const SettingsData& data);  // The same, for readers
+    uint8_t size;                          // sizeof the member, the buffer size for strings
+    int32_t min;                           // Numeric range, or maximum length for STRING
+    int32_t max;
+    uint8_t changes;                       // SETTINGS_CHANGE_* raised when written
+};
+
+extern const SettingsField SETTINGS_FIELDS[];
+extern const size_t SETTINGS_FIELD_COUNT;
+
+// Table index for a member name, or -1
+int settings_find_field(const JsonToken& key);
+
+// Field bit (1 << table index) of every field raising any of 'changes',
+// for subscribing to the settings change bus
+uint64_t settings_fields_mask(uint8_t changes);
+
+// Field bit of every field that differs between 'a' and 'b'
+uint64_t settings_diff(const SettingsData& a, const SettingsData& b);
+
+// Write every field as a member of the object currently open in 'writer'
+void settings_write_json(JsonWriter& writer, const SettingsData& data);
+
+// Field values taken from a JSON object, validated on arrival and written to
+// a SettingsData copy only once the whole message was accepted. The staged tokens point
+// into the message, which has to outlive the update.
+class SettingsUpdate {
+public:
+    SettingsUpdate();
+
+    // Validate and stage the value of member 'key'. Keys outside the table
+    // set known = false and are left to the caller. Returns false with
+    // error() describing the problem when the value is not acceptable.
+    bool stage(const JsonToken& key, const JsonToken& value, bool& known);
+
+    bool empty() const { return present == 0; }
+
+    // Write the staged values
+    void apply(SettingsData& data) const;
+
+    const char* error() const { return message; }
+
+private:
+    static const size_t MAX_FIELDS = 64;
+    uint64_t present;   // Bit per table index
+    JsonToken values[MAX_FIELDS];
+    char message[96];
+};
+
+#endif // SETTINGS_SCHEMA_H
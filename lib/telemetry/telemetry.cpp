@@ -0,0 +1,45 @@
+#include "telemetry.h"
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+size_t telemetry_encode_status(const TelemetryStatus& status, uint8_t* out) {
+  out[0] = TELEMETRY_STATUS_VERSION;
+  out[1] = TELEMETRY_TYPE_STATUS;
+  put16(out + 2, TELEMETRY_STATUS_SIZE);
+  put32(out + 4, status.sequence);
+  put32(out + 8, status.uptime_ms);
+  put16(out + 12, status.year);
+  put16(out + 14, status.day);
+  out[16] = status.hour;
+  out[17] = status.minute;
+  out[18] = status.second;
+  out[19] = status.flags;
+  out[20] = status.time_source;
+  out[21] = status.discipline_state;
+  out[22] = status.channels_active;
+  out[23] = 0;
+  put32(out + 24, (uint32_t)status.ntp_offset_us);
+  put32(out + 28, status.ntp_delay_us);
+  put32(out + 32, (uint32_t)status.frequency_ppb);
+  for (int i = 0; i < TELEMETRY_CHANNELS; i++) {
+    out[36 + i] = status.channel_format[i];
+  }
+  put32(out + 44, status.free_heap);
+  put32(out + 48, status.min_free_heap);
+  put32(out + 52, status.ws_dropped);
+  put32(out + 56, status.ntp_updates);
+  put32(out + 60, status.decoder_errors);
+  put32(out + 64, status.output_config_staged);
+  put32(out + 68, status.output_config_applied);
+  return TELEMETRY_STATUS_SIZE;
+}
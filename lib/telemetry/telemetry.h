@@ -0,0 +1,76 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so it can be built on the host.
+
+// Binary status stream for the web UI. A client asks for it with
+// {"action":"subscribe","format":"irigb.status.v2"} and then receives one
+// binary WebSocket message per update instead of the JSON "time"/"leds"
+// messages. Configuration stays JSON.
+//
+// Frame layout, all fields little-endian:
+//   0  u8   version (2)            24 i32  NTP offset (us)
+//   1  u8   type (1 = status)      28 u32  NTP delay (us)
+//   2  u16  frame length (72)      32 i32  discipline frequency (ppb)
+//   4  u32  sequence               36 u8x8 channel formats (IrigFormat)
+//   8  u32  uptime (ms)            44 u32  free heap
+//  12  u16  year                   48 u32  minimum free heap
+//  14  u16  day of year            52 u32  WebSocket messages dropped
+//  16  u8   hour, minute, second   56 u32  NTP updates
+//  19  u8   flags                  60 u32  decoder frame errors
+//  20  u8   time source
+//  21  u8   discipline state
+//  22  u8   active channels (bit per channel)
+//  23  u8   reserved                64 u32  output configuration staged
+//                                   68 u32  output configuration in effect
+// Later versions only append fields and raise the length; decoders read the
+// fields they know and skip the rest. A field that changes meaning raises
+// the version: v2 sends the channel formats at 36 where v1 sent the modes.
+
+#define TELEMETRY_STATUS_FORMAT "irigb.status.v2"
+#define TELEMETRY_STATUS_VERSION 2
+#define TELEMETRY_TYPE_STATUS 1
+#define TELEMETRY_STATUS_SIZE 72
+#define TELEMETRY_CHANNELS 8
+
+// Status flags
+#define TELEMETRY_FLAG_TIME_VALID  0x01
+#define TELEMETRY_FLAG_SYNC_OK     0x02
+#define TELEMETRY_FLAG_ENABLED     0x04
+#define TELEMETRY_FLAG_LINK_UP     0x08
+#define TELEMETRY_FLAG_OUTPUT_ON   0x10
+
+struct TelemetryStatus {
+  uint32_t sequence;
+  uint32_t uptime_ms;
+  uint16_t year;
+  uint16_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  uint8_t flags;              // TELEMETRY_FLAG_*
+  uint8_t time_source;        // TIME_SOURCE_*
+  uint8_t discipline_state;   // DisciplineState
+  uint8_t channels_active;
+  int32_t ntp_offset_us;
+  uint32_t ntp_delay_us;
+  int32_t frequency_ppb;
+  uint8_t channel_format[TELEMETRY_CHANNELS];
+  uint32_t free_heap;
+  uint32_t min_free_heap;
+  uint32_t ws_dropped;
+  uint32_t ntp_updates;
+  uint32_t decoder_errors;
+  // Sequence numbers of the last output configuration staged and of the one
+  // every channel runs on; they differ until the next frame boundaries
+  uint32_t output_config_staged;
+  uint32_t output_config_applied;
+};
+
+// Write the frame into 'out' (TELEMETRY_STATUS_SIZE bytes), returns its size
+size_t telemetry_encode_status(const TelemetryStatus& status, uint8_t* out);
+
+#endif // TELEMETRY_H
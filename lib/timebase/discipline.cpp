@@ -0,0 +1,64 @@
+#include "discipline.h"
+
+// Proportional gain: remove a quarter of the phase error every second
+static const int32_t PHASE_GAIN_DIV = 4;
+
+// Integral gain: 1 us/s of persistent error is 1000 ppb, fold in 1/64 of it per second
+static const int32_t FREQUENCY_GAIN_DIV = 64;
+
+ClockDiscipline::ClockDiscipline() {
+  reset();
+}
+
+void ClockDiscipline::reset() {
+  current_state = DisciplineState::FREE_RUN;
+  frequency_ppb = 0;
+  pending_correction_us = 0;
+  last_error_us = 0;
+  good_samples = 0;
+  missed_seconds = 0;
+}
+
+void ClockDiscipline::sample(int32_t phase_error_us) {
+  last_error_us = phase_error_us;
+  missed_seconds = 0;
+
+  int32_t magnitude = phase_error_us < 0 ? -phase_error_us : phase_error_us;
+  if (magnitude > STEP_THRESHOLD_US) {
+    // Initial alignment or a reference jump: remove it completely and leave
+    // the frequency estimate alone
+    pending_correction_us += phase_error_us;
+    current_state = DisciplineState::LOCKING;
+    good_samples = 0;
+    return;
+  }
+
+  pending_correction_us += phase_error_us / PHASE_GAIN_DIV;
+  frequency_ppb += phase_error_us * 1000 / FREQUENCY_GAIN_DIV;
+  if (frequency_ppb > MAX_FREQUENCY_PPB) frequency_ppb = MAX_FREQUENCY_PPB;
+  if (frequency_ppb < -MAX_FREQUENCY_PPB) frequency_ppb = -MAX_FREQUENCY_PPB;
+
+  if (magnitude <= LOCK_THRESHOLD_US) {
+    if (good_samples < LOCK_COUNT) good_samples++;
+  } else {
+    good_samples = 0;
+  }
+  current_state = good_samples >= LOCK_COUNT ? DisciplineState::LOCKED : DisciplineState::LOCKING;
+}
+
+void ClockDiscipline::missed() {
+  if (current_state == DisciplineState::FREE_RUN || current_state == DisciplineState::HOLDOVER) {
+    return;
+  }
+  missed_seconds++;
+  if (missed_seconds >= HOLDOVER_TIMEOUT_S) {
+    current_state = DisciplineState::HOLDOVER;
+    good_samples = 0;
+  }
+}
+
+int32_t ClockDiscipline::takePhaseCorrection() {
+  int32_t correction = pending_correction_us;
+  pending_correction_us = 0;
+  return correction;
+}
@@ -0,0 +1,56 @@
+#ifndef DISCIPLINE_H
+#define DISCIPLINE_H
+
+#include <stdint.h>
+
+// Platform independent (no Arduino dependency) so the loop can be exercised on the host.
+
+enum class DisciplineState : uint8_t {
+  FREE_RUN = 0,   // Never had a reference
+  LOCKING = 1,    // Reference present, phase error still large
+  LOCKED = 2,     // Phase error within LOCK_THRESHOLD_US for LOCK_COUNT seconds
+  HOLDOVER = 3    // Reference lost, running on the last frequency estimate
+};
+
+// PI clock servo. Fed once per second with the phase error between the local
+// on-time edge and the reference on-time edge, it produces a phase correction
+// to slew out and a frequency correction to apply continuously.
+class ClockDiscipline {
+public:
+  static const int32_t LOCK_THRESHOLD_US = 20;
+  static const uint8_t LOCK_COUNT = 10;
+  static const uint8_t HOLDOVER_TIMEOUT_S = 3;
+  static const int32_t MAX_FREQUENCY_PPB = 200000;   // +/-200 ppm
+  static const int32_t STEP_THRESHOLD_US = 1000;     // Larger errors are removed at once
+
+  ClockDiscipline();
+
+  void reset();
+
+  // One measurement per second: local on-time minus reference on-time.
+  // Positive means the local edge is late.
+  void sample(int32_t phase_error_us);
+
+  // One second passed without a usable reference measurement
+  void missed();
+
+  // Phase correction (in microseconds) to slew out now, positive = shorten
+  // the local second. Reading it clears it.
+  int32_t takePhaseCorrection();
+
+  // Frequency correction, positive = shorten every local second
+  int32_t frequencyPpb() const { return frequency_ppb; }
+
+  DisciplineState state() const { return current_state; }
+  int32_t lastPhaseError() const { return last_error_us; }
+
+private:
+  DisciplineState current_state;
+  int32_t frequency_ppb;
+  int32_t pending_correction_us;
+  int32_t last_error_us;
+  uint8_t good_samples;
+  uint8_t missed_seconds;
+};
+
+#endif // DISCIPLINE_H
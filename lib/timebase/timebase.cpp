@@ -0,0 +1,194 @@
+#include "timebase.h"
+
+static bool _timer = false;
+static uint32_t _tick_us = 500;
+static uint32_t _last_period_us = 0;
+
+// Written by the reference side, consumed by the ISR
+static volatile int32_t _slew_remaining_us = 0;
+static volatile int32_t _frequency_ppb = 0;
+
+// ISR-only fractional period accumulator (ppb * us)
+static int64_t _frequency_acc = 0;
+
+// Written by the ISR at every frame start
+static volatile uint32_t _frame_count = 0;
+static volatile uint32_t _frame_start_us = 0;
+
+static portMUX_TYPE _timebase_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static ClockDiscipline _discipline;
+static bool _has_time = false;
+static int64_t _label_offset = 0; // Seconds since 2000 carried by frame 0
+
+// Label offset the latest reference frames agree on, and how many in a row
+static int64_t _candidate_offset = 0;
+static uint32_t _candidate_frames = 0;
+static uint32_t _reference_rejects = 0;
+
+void timebase_begin(uint32_t tick_us) {
+  _timer = false;
+  _tick_us = tick_us;
+  _last_period_us = tick_us;
+  _discipline.reset();
+  _has_time = false;
+  _candidate_frames = 0;
+}
+
+bool timebase_start_timer(timer_isr_t isr, void* arg) {
+  timer_config_t config = {};
+  config.divider = 80;
+  config.counter_dir = TIMER_COUNT_UP;
+  config.counter_en = TIMER_PAUSE;
+  config.alarm_en = TIMER_ALARM_EN;
+  config.auto_reload = TIMER_AUTORELOAD_EN;
+  config.intr_type = TIMER_INTR_LEVEL;
+  if (timer_init(TIMEBASE_TIMER_GROUP, TIMEBASE_TIMER, &config) != ESP_OK ||
+      timer_set_counter_value(TIMEBASE_TIMER_GROUP, TIMEBASE_TIMER, 0) != ESP_OK ||
+      timer_set_alarm_value(TIMEBASE_TIMER_GROUP, TIMEBASE_TIMER, _tick_us) != ESP_OK ||
+      timer_isr_callback_add(TIMEBASE_TIMER_GROUP, TIMEBASE_TIMER, isr, arg, ESP_INTR_FLAG_IRAM) != ESP_OK) {
+    Serial.println("Timebase: output timer setup failed");
+    return false;
+  }
+  _timer = true;
+  return timer_start(TIMEBASE_TIMER_GROUP, TIMEBASE_TIMER) == ESP_OK;
+}
+
+uint32_t IRAM_ATTR timebase_timer_count() {
+  return (uint32_t)timer_group_get_counter_value_in_isr(TIMEBASE_TIMER_GROUP, TIMEBASE_TIMER);
+}
+
+void IRAM_ATTR timebase_tick() {
+  if (!_timer) return;
+
+  int32_t period = _tick_us;
+
+  // Frequency correction: spread the ppb offset over whole-microsecond period changes
+  _frequency_acc += (int64_t)_frequency_ppb * _tick_us;
+  if (_frequency_acc >= 1000000000LL) {
+    _frequency_acc -= 1000000000LL;
+    period -= 1;
+  } else if (_frequency_acc <= -1000000000LL) {
+    _frequency_acc += 1000000000LL;
+    period += 1;
+  }
+
+  // Phase correction: slew, never more than TIMEBASE_MAX_SLEW_PER_TICK_US per tick
+  portENTER_CRITICAL_ISR(&_timebase_mux);
+  int32_t slew = _slew_remaining_us;
+  if (slew != 0) {
+    int32_t step = slew;
+    if (step > TIMEBASE_MAX_SLEW_PER_TICK_US) step = TIMEBASE_MAX_SLEW_PER_TICK_US;
+    if (step < -TIMEBASE_MAX_SLEW_PER_TICK_US) step = -TIMEBASE_MAX_SLEW_PER_TICK_US;
+    _slew_remaining_us = slew - step;
+    period -= step;
+  }
+  portEXIT_CRITICAL_ISR(&_timebase_mux);
+
+  if ((uint32_t)period != _last_period_us) {
+    timer_group_set_alarm_value_in_isr(TIMEBASE_TIMER_GROUP, TIMEBASE_TIMER, period);
+    _last_period_us = period;
+  }
+}
+
+uint32_t IRAM_ATTR timebase_frame_start() {
+  // The timer auto-reloads on the alarm, so its count is the time elapsed
+  // since the ideal tick: take that off to remove ISR latency from the frame start
+  uint32_t now = micros();
+  if (_timer) {
+    now -= timebase_timer_count();
+  }
+  return timebase_frame_start_at(now);
+}
+
+uint32_t IRAM_ATTR timebase_frame_start_at(uint32_t start_us) {
+  portENTER_CRITICAL_ISR(&_timebase_mux);
+  uint32_t frame = ++_frame_count;
+  _frame_start_us = start_us;
+  portEXIT_CRITICAL_ISR(&_timebase_mux);
+  return frame;
+}
+
+void timebase_last_frame(uint32_t& frame, uint32_t& start_us) {
+  portENTER_CRITICAL(&_timebase_mux);
+  frame = _frame_count;
+  start_us = _frame_start_us;
+  portEXIT_CRITICAL(&_timebase_mux);
+}
+
+void timebase_reference(const IrigTime& time, uint32_t on_time_us) {
+  uint32_t frame, start_us;
+  timebase_last_frame(frame, start_us);
+  if (frame == 0) {
+    return; // Output timer not running yet
+  }
+
+  // Distance between our latest on-time edge and the reference one, split
+  // into whole frames and the phase error within a frame
+  int32_t diff = (int32_t)(start_us + TIMEBASE_ON_TIME_OFFSET_US - on_time_us);
+  int32_t frames_apart = (diff >= 0 ? diff + 500000 : diff - 500000) / 1000000;
+  int32_t phase_error = diff - frames_apart * 1000000;
+
+  // Label the local frames with the reference time of day. Consecutive
+  // frames of a reference counting one second per frame give the same
+  // offset; a lone frame with another one is a bad decode and only counted.
+  int64_t offset = (int64_t)irig_time_to_seconds(time) - (int64_t)(frame - frames_apart);
+  if (_candidate_frames > 0 && offset == _candidate_offset) {
+    _candidate_frames++;
+  } else {
+    _candidate_offset = offset;
+    _candidate_frames = 1;
+  }
+  if (!_has_time || offset != _label_offset) {
+    if (_candidate_frames < TIMEBASE_RELABEL_FRAMES) {
+      if (_has_time) {
+        _reference_rejects++;
+      }
+    } else {
+      if (_has_time) {
+        Serial.printf("[TIMEBASE] Reference time changed by %d s\n", (int)(offset - _label_offset));
+      }
+      _label_offset = offset;
+      _has_time = true;
+    }
+  }
+
+  portENTER_CRITICAL(&_timebase_mux);
+  bool slewing = _slew_remaining_us != 0;
+  portEXIT_CRITICAL(&_timebase_mux);
+  if (slewing) {
+    return; // Previous correction not fully applied, this measurement is stale
+  }
+
+  _discipline.sample(phase_error);
+  int32_t correction = _discipline.takePhaseCorrection();
+  portENTER_CRITICAL(&_timebase_mux);
+  _slew_remaining_us += correction;
+  _frequency_ppb = _discipline.frequencyPpb();
+  portEXIT_CRITICAL(&_timebase_mux);
+}
+
+void timebase_no_reference() {
+  // Holdover keeps the last frequency estimate in _frequency_ppb
+  _discipline.missed();
+}
+
+uint32_t timebase_reference_rejects() {
+  return _reference_rejects;
+}
+
+bool timebase_has_time() {
+  return _has_time;
+}
+
+bool timebase_frame_time(uint32_t frame, IrigTime& time) {
+  if (!_has_time) {
+    return false;
+  }
+  irig_time_from_seconds((uint32_t)(_label_offset + frame), time);
+  return true;
+}
+
+const ClockDiscipline& timebase_discipline() {
+  return _discipline;
+}
@@ -0,0 +1,75 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <Arduino.h>
+#include <driver/timer.h>
+#include "discipline.h"
+#include "irigb.h"
+
+// The output frame starts on the P0 marker of the previous second, so the
+// on-time (Pr leading) edge is one element after the frame start.
+#define TIMEBASE_ON_TIME_OFFSET_US 10000
+
+// Largest change applied to a single timer period while slewing out a phase error
+#define TIMEBASE_MAX_SLEW_PER_TICK_US 25
+
+// Reference frames in a row that must carry the same time of day, one
+// second per frame, before the output frames are labelled (again) with it
+#define TIMEBASE_RELABEL_FRAMES 3
+
+// Output tick timer, 1 MHz and reloading on its alarm
+#define TIMEBASE_TIMER_GROUP TIMER_GROUP_0
+#define TIMEBASE_TIMER TIMER_0
+
+// Output clock disciplining.
+// The output timer ISR reports every tick and every frame start; a reference
+// (the decoded IRIG-B input) reports its on-time edges. The timebase steers the
+// timer period so the local on-time edge follows the reference and keeps the
+// last frequency estimate when the reference goes away (holdover).
+
+// Set up for a tick of 'tick_us'; backends without the output timer only
+// report frame starts
+void timebase_begin(uint32_t tick_us);
+
+// Start the output timer with 'isr(arg)' on every tick. The interrupt is
+// allocated in IRAM, so it keeps running while the flash cache is off and
+// must only call IRAM code.
+bool timebase_start_timer(timer_isr_t isr, void* arg);
+
+// Output timer count since the last tick: the interrupt entry latency when
+// read first thing in the ISR
+uint32_t IRAM_ATTR timebase_timer_count();
+
+// Called from the timer ISR on every tick, reprograms the next period
+void IRAM_ATTR timebase_tick();
+
+// Called from the timer ISR when a new output frame starts, returns its number
+uint32_t IRAM_ATTR timebase_frame_start();
+
+// The same for backends that know when the frame started, in micros()
+uint32_t IRAM_ATTR timebase_frame_start_at(uint32_t start_us);
+
+// Consistent copy of the frame counter and the ideal (latency free) micros()
+// at which that frame started
+void timebase_last_frame(uint32_t& frame, uint32_t& start_us);
+
+// Feed a decoded reference frame: its time and the micros() of its on-time edge
+void timebase_reference(const IrigTime& time, uint32_t on_time_us);
+
+// Call once per second when the reference produced nothing usable
+void timebase_no_reference();
+
+// Reference frames whose time of day disagreed with the labels in use and
+// did not (yet) replace them
+uint32_t timebase_reference_rejects();
+
+// True once output frames can be labelled with a time of day
+bool timebase_has_time();
+
+// Time of day carried by output frame number 'frame'
+bool timebase_frame_time(uint32_t frame, IrigTime& time);
+
+// Servo state for status reporting
+const ClockDiscipline& timebase_discipline();
+
+#endif // TIMEBASE_H
@@ -3,30 +3,62 @@
 #include "driver/spi_master.h"
 #include <esp_err.h>
 #include "pins.h"
+#include "task_config.h"
 #include "display.h"
 #include "ethernet.h"
 #include "ntp.h"
 #include "server.h"
 #include "settings.h"
 #include "irigb.h"
+#include "output.h"
+#include "timer_output.h"
+// Output backend: edges scheduled on a timer compare unless built with
+// -DIRIG_OUTPUT_DMA (LCD_CAM parallel DMA) or -DIRIG_OUTPUT_TICK (0.5 ms
+// timer interrupt). The IRIG reference mode always runs on the tick, the
+// only one the timebase can steer.
+#if defined(IRIG_OUTPUT_DMA)
+#include "dma_output.h"
+#elif !defined(IRIG_OUTPUT_TICK)
+#include "edge_output.h"
+#define IRIG_OUTPUT_EDGES
+#endif
 #include "decoder.h"
+#include "timebase.h"
+#include "loopback.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "settings_schema.h"
+#include "change_bus.h"
+#include "second_bus.h"
 
-extern void init_decoder();
-extern IRIGBDecoder* get_decoder();
-// Timer for 0.5ms ISR
-hw_timer_t *timer = NULL;
+// The loop and AsyncTCP are placed by their own build flags
+#if ARDUINO_RUNNING_CORE != TASK_CORE_NETWORK
+#error "ARDUINO_RUNNING_CORE has to be TASK_CORE_NETWORK (task_config.h)"
+#endif
+#if !defined(CONFIG_ASYNC_TCP_RUNNING_CORE) || CONFIG_ASYNC_TCP_RUNNING_CORE != TASK_CORE_NETWORK
+#error "CONFIG_ASYNC_TCP_RUNNING_CORE has to be TASK_CORE_NETWORK (task_config.h)"
+#endif
 
 bool sec_blink = false;
-uint32_t last_blink = 0;
 uint32_t last_ntp_update = 0;
 bool ntp_got_data = false;
 Display display(DISP_DATA, DISP_CLK, DISP_STB);
 IRIGWebServer webServer;
 Settings settings;
-bool wclk_state = false;
 bool irig_available = false;
 bool irig_enabled = false;
 bool ntp_valid = false;
+bool irig_reference_mode = false; // IRIG-B input on P8 is the time reference
+bool loopback_mode = false;       // Channel 8 read back on the decoder for self-monitoring
+LoopbackMonitor loopback;
+portMUX_TYPE loopback_mux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t last_loopback_report = 0;
+uint32_t last_client_maintenance = 0;
+int display_subscriber = -1; // Settings change bus id of the main loop
+int second_subscriber = -1;  // Second bus id of the main loop
+uint32_t last_second = 0;    // millis() of the last second boundary the loop handled
+uint32_t output_config_staged = 0;  // Last configuration handed to the output engine
+uint32_t output_config_reported = 0;
 extern bool eth_reinit_flag;
 extern bool ntp_ok;
 
@@ -38,55 +70,129 @@ IRIGB irigb5(P5);
 IRIGB irigb6(P6);
 IRIGB irigb7(P7);
 IRIGB irigb8(P8);
+// In DRAM: the output timer reads them while the flash cache may be off
+DRAM_ATTR IRIGB *const outputs[IRIG_CHANNELS] = {&irigb1, &irigb2, &irigb3, &irigb4, &irigb5, &irigb6, &irigb7, &irigb8};
+OutputEngine irig_outputs(outputs);
+TimerOutput timer_output(irig_outputs, WCLK);
+#ifdef IRIG_AM_PIN
+AmOutput am_output(IRIG_AM_PIN);
+#endif
+#ifdef IRIG_OUTPUT_DMA
+DRAM_ATTR const uint8_t output_pins[IRIG_CHANNELS] = {P1, P2, P3, P4, P5, P6, P7, P8};
+DmaOutput dma_output(irig_outputs, output_pins, IRIG_DMA_WR_PIN, IRIG_DMA_DC_PIN);
+#endif
+#ifdef IRIG_OUTPUT_EDGES
+DRAM_ATTR const uint8_t output_pins[IRIG_CHANNELS] = {P1, P2, P3, P4, P5, P6, P7, P8};
+EdgeOutput edge_output(irig_outputs, output_pins);
+#endif
+#define WCLK_LEDC_CHANNEL 0
 
-uint8_t bit_counter = 0;
-void IRAM_ATTR onTimer()
-{
-  if (!irig_available)
-    return;
-  if (wclk_state)
-  {
-    irigb1.update();
-    irigb2.update();
-    irigb3.update();
-    irigb4.update();
-    irigb5.update();
-    irigb6.update();
-    irigb7.update();
-    irigb8.update();
-    bit_counter++;
-    if (bit_counter >= 100)
-    {
-      bit_counter = 0;
-    }
-  }
-  digitalWrite(WCLK, !wclk_state);
-  wclk_state = !wclk_state;
+// Time from the timer alarm or edge compare to the start of the output interrupt
+LatencyHistogram isr_latency;
+
+// Set by the rendering backends: outputs only start or stop on a frame
+// boundary so they never emit a partial frame
+bool output_active = false;
+
+// The frame on the pins carries the channels, whichever backend runs them
+bool outputs_running()
+{
+  return output_active || timer_output.running();
+}
+
+#if defined(IRIG_OUTPUT_DMA) || defined(IRIG_OUTPUT_EDGES)
+// Rendering backends: the next frame is on its way to the pins
+void IRAM_ATTR onOutputFrame(uint32_t start_us, bool running)
+{
+  timebase_frame_start_at(start_us);
+  output_active = running;
+  BaseType_t woken = pdFALSE;
+  second_events.publishFromISR(&woken);
+  if (woken == pdTRUE)
+    portYIELD_FROM_ISR();
+}
+#endif
+
+void start_output_timer()
+{
+  timer_output.begin(&irig_available, &second_events, &isr_latency);
+}
+
+// Without the tick nothing toggles WCLK, it runs from the LED PWM at 1 kHz
+void start_wclk_pwm()
+{
+  ledcSetup(WCLK_LEDC_CHANNEL, 1000, 1);
+  ledcAttachPin(WCLK, WCLK_LEDC_CHANNEL);
+  ledcWrite(WCLK_LEDC_CHANNEL, 1);
+}
+
+#ifdef IRIG_OUTPUT_DMA
+bool start_dma_output()
+{
+  start_wclk_pwm();
+  // Frame starts only, there is no timer to steer
+  timebase_begin(500);
+  return dma_output.begin(onOutputFrame, &irig_available);
+}
+#endif
+
+#ifdef IRIG_OUTPUT_EDGES
+bool start_edge_output()
+{
+  start_wclk_pwm();
+  // Frame starts only, the edge timer is not steered
+  timebase_begin(500);
+  return edge_output.begin(onOutputFrame, &irig_available, &isr_latency);
 }
+#endif
 
+// Interrupts are allocated on the core that installs them, so the output
+// backend is started from a task on the output core. 'param' is the task
+// to notify once it is done.
+void start_outputs_task(void *param)
+{
+#ifdef IRIG_AM_PIN
+  if (am_output.begin())
+    irig_outputs.setAmOutput(&am_output, IRIG_AM_CHANNEL - 1);
+#endif
 
+  // The reference mode steers the output clock, which only the tick can follow
+#if defined(IRIG_OUTPUT_DMA)
+  if (irig_reference_mode || !start_dma_output())
+    start_output_timer();
+#elif defined(IRIG_OUTPUT_EDGES)
+  if (irig_reference_mode || !start_edge_output())
+    start_output_timer();
+#else
+  start_output_timer();
+#endif
+  xTaskNotifyGive((TaskHandle_t)param);
+  vTaskDelete(NULL);
+}
 
 void init_pins()
 {
   pinMode(WCLK, OUTPUT);
-  pinMode(P1, OUTPUT);
-  pinMode(P2, OUTPUT);
-  pinMode(P3, OUTPUT);
-  pinMode(P4, OUTPUT);
-  pinMode(P5, OUTPUT);
-  pinMode(P6, OUTPUT);
-  pinMode(P7, OUTPUT);
-  pinMode(P8, OUTPUT);
-  // pinMode(P8, INPUT_PULLUP);
+  // The channel pins are set up by the output engine
 }
 
 
 
+// Local time carried by output frame number 'frame' and the offset it was
+// worked out with. The output engine counts on by itself, this corrects it.
+void encode_all(const IrigTime &irigTime, int offset_hours, uint32_t frame)
+{
+  irig_outputs.encode(irigTime, offset_hours, frame);
+}
+
 void ntp_task(void *param)
 {
   unsigned long last_evaluate =millis();
   unsigned long last_debug =millis();
   uint8_t restart_counter=0;
+  const ChangeMask ntp_fields = settings_fields_mask(SETTINGS_CHANGE_NTP);
+  int subscriber = settings_changes.subscribe("ntp_task", settings_fields_mask(SETTINGS_CHANGE_NTP | SETTINGS_CHANGE_OUTPUT));
+  int second_subscriber = second_events.subscribe("ntp_task");
   for (;;)
   {
 
@@ -114,9 +220,17 @@ void ntp_task(void *param)
       ntp_valid=true;
       ntp_got_data=true;
     }
-    if (ntp_valid)
+    // The time at the on-time edge of the next frame. The offset is read
+    // once, so a change mid-frame never mixes two offsets in one frame.
+    // Signed like current_time(): a late wake must not read as an hour
+    // ahead, and before the first frame start there is nothing to encode.
+    uint32_t frame, start_us;
+    timebase_last_frame(frame, start_us);
+    int32_t until_us = (int32_t)(start_us + 1000000 + TIMEBASE_ON_TIME_OFFSET_US - micros());
+    if (ntp_valid && frame != 0 && until_us >= -1000000)
     {
-      NTPTime currentTime = ntp_get_time();
+      int offset_hours = (int)settings.get()->ntp.timeOffset;
+      NTPTime currentTime = ntp_get_time_at(millis() + until_us / 1000, offset_hours);
       IrigTime irigTime;
       irigTime.second = currentTime.second;
       irigTime.minute = currentTime.minute;
@@ -124,47 +238,273 @@ void ntp_task(void *param)
       irigTime.day = currentTime.day;
       irigTime.year = currentTime.year;
       // irigb1.encodeTimeIntoBits(irigTime, 7);
-      irigb1.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
-      irigb2.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
-      irigb3.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
-      irigb4.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
-      irigb5.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
-      irigb6.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
-      irigb7.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
-      irigb8.encodeTimeIntoBits(irigTime, (int)(settings.ntp.timeOffset));
+      encode_all(irigTime, offset_hours, frame + 1);
+      irig_available = true;
+    }
+    // Runs again at the next frame start to encode the frame after it, or
+    // at once to query new servers and encode a new time offset
+    second_events.wait(second_subscriber, 1100);
+    if (settings_changes.wait(subscriber, 0) & ntp_fields)
+    {
+      ntp_request_update();
+    }
+  }
+}
+
+
+
+// Distribution amplifier mode: the decoded IRIG-B input on P8 disciplines the
+// output timebase and supplies the time of day; outputs hold over without it.
+void irig_reference_task(void *param)
+{
+  uint32_t last_encoded_frame = 0;
+  unsigned long last_reference = millis();
+  for (;;)
+  {
+    IRIGBDecoder *decoder = get_decoder();
+    IrigTime reference;
+    uint32_t on_time_us;
+    if (decoder)
+      decoder->updateClassifier();
+    if (decoder && decoder->get_frame(reference, on_time_us))
+    {
+      timebase_reference(reference, on_time_us);
+      last_reference = millis();
+    }
+    else if (millis() - last_reference > 1000)
+    {
+      timebase_no_reference();
+      last_reference += 1000;
+    }
+
+    // Encode the next frame once per output frame, from the local frame
+    // counter so the outputs keep counting in holdover
+    uint32_t frame, start_us;
+    timebase_last_frame(frame, start_us);
+    if (frame != last_encoded_frame && timebase_has_time())
+    {
+      IrigTime next;
+      timebase_frame_time(frame + 1, next);
+      encode_all(next, (int)settings.get()->ntp.timeOffset, frame + 1);
+      last_encoded_frame = frame;
+      ntp_valid = true;
       irig_available = true;
     }
-    delay(300);
+    delay(50);
+  }
+}
+
+// Decoder pulse hook in loopback mode: place each read-back pulse on the ideal
+// element grid of the frame the timebase is currently in
+void IRAM_ATTR loopback_pulse(unsigned long rise_us, unsigned long width_us, PulseSymbol symbol)
+{
+  uint32_t frame, start_us;
+  timebase_last_frame(frame, start_us);
+  portENTER_CRITICAL_ISR(&loopback_mux);
+  loopback.addPulse((int32_t)(rise_us - start_us), width_us, (uint8_t)symbol);
+  portEXIT_CRITICAL_ISR(&loopback_mux);
+}
+
+void report_loopback()
+{
+  portENTER_CRITICAL(&loopback_mux);
+  LoopbackStats stats = loopback.stats();
+  loopback.resetWindow();
+  portEXIT_CRITICAL(&loopback_mux);
+
+  Serial.printf("[LOOPBACK] on-time mean=%d jitter=%u min=%d max=%d worst=%d us, edge jitter=%u us, width err 0/1/M=%d/%d/%d us, bad=%u\n",
+                stats.on_time.mean_us, stats.on_time.jitter_us, stats.on_time.min_us, stats.on_time.max_us,
+                stats.worst_on_time_us, stats.edges.jitter_us,
+                stats.width[0].mean_us, stats.width[1].mean_us, stats.width[2].mean_us, stats.bad_pulses);
+  webServer.sendLoopbackStats(stats);
+}
+
+// Time of day for the display and web UI: the second of the last frame start
+NTPTime current_time()
+{
+  uint32_t frame, start_us;
+  timebase_last_frame(frame, start_us);
+  if (!irig_reference_mode)
+  {
+    // The loop wakes at the frame start, before the on-time edge of its
+    // second; label it like ntp_task does. Without frames, the time now.
+    int32_t until_us = (int32_t)(start_us + TIMEBASE_ON_TIME_OFFSET_US - micros());
+    if (frame == 0 || until_us < -1000000)
+      return ntp_get_time();
+    return ntp_get_time_at(millis() + until_us / 1000, (int)settings.get()->ntp.timeOffset);
+  }
+
+  NTPTime time = {0};
+  IrigTime now;
+  if (timebase_frame_time(frame, now))
+  {
+    time.day = now.day;
+    time.hour = now.hour;
+    time.minute = now.minute;
+    time.second = now.second;
+    time.year = now.year;
+  }
+  return time;
+}
+
+// Snapshot for the binary status stream
+void collect_status(TelemetryStatus &status, const NTPTime &time, bool sync_ok, const SettingsData &config)
+{
+  status.uptime_ms = millis();
+  status.year = time.year;
+  status.day = time.day;
+  status.hour = time.hour;
+  status.minute = time.minute;
+  status.second = time.second;
+  status.flags = (ntp_valid ? TELEMETRY_FLAG_TIME_VALID : 0) |
+                 (sync_ok ? TELEMETRY_FLAG_SYNC_OK : 0) |
+                 (config.enabled ? TELEMETRY_FLAG_ENABLED : 0) |
+                 (eth_link_up() ? TELEMETRY_FLAG_LINK_UP : 0) |
+                 (outputs_running() ? TELEMETRY_FLAG_OUTPUT_ON : 0);
+  status.time_source = config.time_source;
+  status.discipline_state = (uint8_t)timebase_discipline().state();
+  status.channels_active = outputs_running() ? irig_outputs.activeMask() : 0;
+  for (int i = 0; i < TELEMETRY_CHANNELS; i++)
+    status.channel_format[i] = config.channels[i].format;
+  status.ntp_offset_us = ntp_last_offset_us();
+  status.ntp_delay_us = ntp_last_delay_us();
+  status.frequency_ppb = timebase_discipline().frequencyPpb();
+  status.free_heap = ESP.getFreeHeap();
+  status.min_free_heap = ESP.getMinFreeHeap();
+  status.ntp_updates = ntp_counter();
+  IRIGBDecoder *decoder = get_decoder();
+  // Undecodable frames and decoded ones whose time was not believed
+  status.decoder_errors = (decoder ? decoder->getStats().frame_errors : 0) + timebase_reference_rejects();
+  status.output_config_staged = output_config_staged;
+  status.output_config_applied = irig_outputs.configApplied();
+}
+
+// Only the channels in the output list, the others are not counting
+void collect_frames(MetricsWriter &out, const char *name)
+{
+  uint8_t active = irig_outputs.activeMask();
+  for (uint32_t i = 0; i < IRIG_CHANNELS; i++)
+    if (active & (1 << i))
+      out.sample(name, "channel", i + 1, outputs[i]->framesEmitted());
+}
+
+void collect_underruns(MetricsWriter &out, const char *name)
+{
+  uint8_t active = irig_outputs.activeMask();
+  for (uint32_t i = 0; i < IRIG_CHANNELS; i++)
+    if (active & (1 << i))
+      out.sample(name, "channel", i + 1, outputs[i]->underrunCount());
+}
+
+void collect_encode_errors(MetricsWriter &out, const char *name)
+{
+  uint8_t active = irig_outputs.activeMask();
+  for (uint32_t i = 0; i < IRIG_CHANNELS; i++)
+    if (active & (1 << i))
+      out.sample(name, "channel", i + 1, outputs[i]->encodeErrors());
+}
+
+void collect_holdover_frames(MetricsWriter &out, const char *name)
+{
+  out.sample(name, irig_outputs.holdoverFrames());
+}
+
+void collect_time_steps(MetricsWriter &out, const char *name)
+{
+  out.sample(name, irig_outputs.timeSteps());
+}
+
+void collect_isr_latency(MetricsWriter &out, const char *name)
+{
+  uint32_t counts[LATENCY_BUCKETS + 1];
+  uint32_t max;
+  uint64_t sum;
+  isr_latency.snapshot(counts, sum, max);
+  out.histogram(name, LATENCY_BOUNDS_US, counts, LATENCY_BUCKETS, sum);
+}
+
+void collect_heap_free(MetricsWriter &out, const char *name)
+{
+  out.sample(name, ESP.getFreeHeap());
+}
+
+void collect_heap_min_free(MetricsWriter &out, const char *name)
+{
+  out.sample(name, ESP.getMinFreeHeap());
+}
+
+void collect_stack_free(MetricsWriter &out, const char *name)
+{
+  static const char *const tasks[] = {"loopTask", "ntp_task", "irig_ref_task", "eth_monitor", "async_tcp", "dma_output", "edge_output"};
+  for (const char *task : tasks)
+  {
+    TaskHandle_t handle = xTaskGetHandle(task);
+    // Only the tasks of the current mode exist
+    if (handle)
+      out.sample(name, "task", task, uxTaskGetStackHighWaterMark(handle));
   }
 }
 
+void collect_link_up(MetricsWriter &out, const char *name)
+{
+  out.sample(name, eth_link_up() ? 1 : 0);
+}
+
+void collect_frequency(MetricsWriter &out, const char *name)
+{
+  out.sample(name, timebase_discipline().frequencyPpb());
+}
+
+void collect_phase_error(MetricsWriter &out, const char *name)
+{
+  out.sample(name, timebase_discipline().lastPhaseError());
+}
+
+void collect_discipline_state(MetricsWriter &out, const char *name)
+{
+  out.sample(name, (int64_t)timebase_discipline().state());
+}
 
+const MetricFamily SYSTEM_METRICS[] = {
+    {"irigb_channel_frames_total", "IRIG-B frames output", MetricType::COUNTER, collect_frames},
+    {"irigb_channel_underruns_total", "Frames that repeated the previous time because none was encoded", MetricType::COUNTER, collect_underruns},
+    {"irigb_channel_encode_errors_total", "Frames sent as markers only because their time could not be encoded", MetricType::COUNTER, collect_encode_errors},
+    {"irigb_output_holdover_frames_total", "Frames the output engine counted on by itself because no time was encoded", MetricType::COUNTER, collect_holdover_frames},
+    {"irigb_output_time_steps_total", "Encoded times that differed from the output engine's own count", MetricType::COUNTER, collect_time_steps},
+    {"irigb_isr_latency_microseconds", "Output timer interrupt entry latency", MetricType::HISTOGRAM, collect_isr_latency},
+    {"irigb_heap_free_bytes", "Free heap", MetricType::GAUGE, collect_heap_free},
+    {"irigb_heap_min_free_bytes", "Lowest free heap since boot", MetricType::GAUGE, collect_heap_min_free},
+    {"irigb_task_stack_free_bytes", "Smallest remaining stack of each task since it started", MetricType::GAUGE, collect_stack_free},
+    {"irigb_link_up", "Ethernet link state", MetricType::GAUGE, collect_link_up},
+    {"irigb_discipline_frequency_ppb", "Output clock frequency correction", MetricType::GAUGE, collect_frequency},
+    {"irigb_discipline_phase_error_microseconds", "Last phase error against the reference", MetricType::GAUGE, collect_phase_error},
+    {"irigb_discipline_state", "0 free run, 1 locking, 2 locked, 3 holdover", MetricType::GAUGE, collect_discipline_state},
+};
 
 void setup()
 {
   Serial.begin(115200);
-  
-  init_pins();
-  delay(1000);
-  irigb1.begin();
-  irigb2.begin();
-  irigb3.begin();
-  irigb4.begin();
-  irigb5.begin();
-  irigb6.begin();
-  irigb7.begin();
-  irigb8.begin();
-
-  // Initialize 0.5ms timer ISR
-  timer = timerBegin(0, 80, true);             // Timer 0, prescaler 80 (1MHz), count up
-  timerAttachInterrupt(timer, &onTimer, true); // Attach ISR
-  timerAlarmWrite(timer, 500, true);           // 500 ticks = 0.5ms (at 1MHz)
-  timerAlarmEnable(timer);                     // Enable the timer
+
   // Load settings
   if (!settings.load())
   {
     Serial.println("Failed to load settings, using defaults");
   }
+  SettingsSnapshot config = settings.get();
+  irig_reference_mode = config->time_source == TIME_SOURCE_IRIG;
+  // P8 is either the reference input or the read-back channel, not both
+  loopback_mode = config->self_monitor && !irig_reference_mode;
+
+  init_pins();
+  delay(1000);
+  // P8 is the reference input in distribution amplifier mode
+  irig_outputs.begin(irig_reference_mode ? 1 << 7 : 0);
+  output_config_staged = irig_outputs.configure(config->channels);
+  if (xTaskCreatePinnedToCore(start_outputs_task, "output_start", 4096, xTaskGetCurrentTaskHandle(),
+                              TASK_OUTPUT_START_PRIORITY, nullptr, TASK_CORE_OUTPUT) == pdPASS)
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  else
+    Serial.println("Failed to start the outputs");
   init_display();
   display.print_display(0, 0, 0, 0);
   display.display();
@@ -190,6 +530,12 @@ void setup()
     Serial.println("Failed to start ethernet monitoring");
   }
 
+  display_subscriber = settings_changes.subscribe("loop", settings_fields_mask(SETTINGS_CHANGE_OUTPUT));
+  second_subscriber = second_events.subscribe("loop");
+
+  for (const MetricFamily &family : SYSTEM_METRICS)
+    metrics_register(&family);
+
   // Initialize web server with settings
   if (webServer.begin(&settings))
   {
@@ -200,17 +546,38 @@ void setup()
     Serial.println("Failed to initialize web server");
   }
 
-  init_ntp();
-  // init_decoder();
-
-  xTaskCreate(
-      ntp_task,
-      "ntp_task", // Task name
-      4096*2,       // Stack size
-      nullptr,    // Parameter
-      1,          // Priority
-      nullptr     // Task handle
-  );
+  if (irig_reference_mode)
+  {
+    init_decoder();
+    xTaskCreatePinnedToCore(
+        irig_reference_task,
+        "irig_ref_task",              // Task name
+        4096,                         // Stack size
+        nullptr,                      // Parameter
+        TASK_IRIG_REFERENCE_PRIORITY, // Priority
+        nullptr,                      // Task handle
+        TASK_CORE_OUTPUT              // Core
+    );
+  }
+  else
+  {
+    if (loopback_mode)
+    {
+      init_decoder(true);
+      get_decoder()->setPulseHook(loopback_pulse);
+    }
+    init_ntp();
+    ntp_register_metrics();
+    xTaskCreatePinnedToCore(
+        ntp_task,
+        "ntp_task",        // Task name
+        4096*2,            // Stack size
+        nullptr,           // Parameter
+        TASK_NTP_PRIORITY, // Priority
+        nullptr,           // Task handle
+        TASK_CORE_NETWORK  // Core
+    );
+  }
   
 }
 
@@ -219,9 +586,36 @@ void setup()
 
 void loop()
 {
-  NTPTime time = ntp_get_time();
-  webServer.sendTimeUpdate(time.hour, time.minute, time.second, time.day);
-  irig_enabled = settings.enabled;
+  // Wakes at every second boundary, at once when the enable switch or a
+  // channel changes, and halfway through the second to blink the LEDs. The
+  // timeout keeps the display going if no frames start.
+  uint32_t since = millis() - last_second;
+  uint32_t timeout = sec_blink ? (since < 500 ? 500 - since : 0) : 1100;
+  uint32_t boundaries = second_events.wait(second_subscriber, timeout);
+  bool second = boundaries > 0 || millis() - last_second >= 1100;
+  if (second)
+  {
+    last_second = millis();
+    sec_blink = true;
+  }
+  else if (millis() - last_second >= 500)
+    sec_blink = false;
+  // The outputs pick a changed channel up at the next frame
+  if (settings_changes.wait(display_subscriber, 0))
+    output_config_staged = irig_outputs.configure(settings.get()->channels);
+
+  SettingsSnapshot config = settings.get();
+  NTPTime time = current_time();
+  bool sync_ok = irig_reference_mode ? timebase_discipline().state() == DisciplineState::LOCKED : ntp_ok;
+  if (second)
+  {
+    webServer.sendTimeUpdate(time.hour, time.minute, time.second, time.day);
+    TelemetryStatus status;
+    collect_status(status, time, sync_ok, *config);
+    webServer.sendStatus(status);
+    webServer.update_led(config->enabled, sync_ok);
+  }
+  irig_enabled = config->enabled;
   if (ntp_valid)
   {
     display.print_display(time.day, time.hour, time.minute, time.second);
@@ -237,19 +631,27 @@ void loop()
     display.set_hour_led(false);
   }
 
-  display.set_enabled_led(settings.enabled);
+  display.set_enabled_led(config->enabled);
   display.set_network_led(eth_link_up());
-  if (sec_blink)
+  display.set_ntp_led(sync_ok && sec_blink);
+  if (loopback_mode)
+    get_decoder()->updateClassifier();
+  if (loopback_mode && millis() - last_loopback_report > 5000)
+  {
+    last_loopback_report = millis();
+    report_loopback();
+  }
+  if (millis() - last_client_maintenance > 1000)
   {
-    webServer.update_led(settings.enabled, ntp_ok);
+    last_client_maintenance = millis();
+    webServer.maintainClients();
   }
-  display.set_ntp_led(ntp_ok && sec_blink);
   display.display();
-  delay(300);
-  if (millis() - last_blink > 500)
+  uint32_t applied = irig_outputs.configApplied();
+  if (applied != output_config_reported)
   {
-    last_blink = millis();
-    
-    sec_blink = !sec_blink;
+    output_config_reported = applied;
+    Serial.printf("Output configuration %u in effect from frame %u\n", (unsigned)applied,
+                  (unsigned)irig_outputs.configAppliedFrame());
   }
 }
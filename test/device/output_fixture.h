@@ -0,0 +1,65 @@
+#ifndef OUTPUT_FIXTURE_H
+#define OUTPUT_FIXTURE_H
+
+#include <Arduino.h>
+#include "pins.h"
+#include "task_config.h"
+#include "irigb.h"
+#include "output.h"
+#include "timer_output.h"
+#include "settings.h"
+#include "timebase.h"
+#include "second_bus.h"
+
+// The eight channels on the firmware's output timer path (TimerOutput), for
+// the device tests: #include "../output_fixture.h" and call
+// start_fixture_outputs() from setup().
+
+static IRIGB irigb1(P1);
+static IRIGB irigb2(P2);
+static IRIGB irigb3(P3);
+static IRIGB irigb4(P4);
+static IRIGB irigb5(P5);
+static IRIGB irigb6(P6);
+static IRIGB irigb7(P7);
+static IRIGB irigb8(P8);
+DRAM_ATTR static IRIGB *const outputs[IRIG_CHANNELS] = {&irigb1, &irigb2, &irigb3, &irigb4,
+                                                         &irigb5, &irigb6, &irigb7, &irigb8};
+static OutputEngine engine(outputs);
+static TimerOutput timer_output(engine, WCLK);
+static Settings settings;
+static volatile bool outputs_available = true;
+static bool timer_started = false;
+static LatencyHistogram *fixture_latency = nullptr;
+
+// The interrupt is allocated on the core that installs it
+static void start_fixture_timer_task(void *param)
+{
+  timer_started = timer_output.begin(&outputs_available, &second_events, fixture_latency);
+  xTaskNotifyGive((TaskHandle_t)param);
+  vTaskDelete(NULL);
+}
+
+// Load the settings and run every channel with the default format from
+// 12:00:00 on; the engine keeps the time from that one encode() on, a frame
+// start and an encode every second. The timer counts of the tick interrupt
+// go to 'latency' when given.
+static void start_fixture_outputs(LatencyHistogram *latency)
+{
+  settings.load();
+  ChannelConfig config[IRIG_CHANNELS];
+  for (int i = 0; i < IRIG_CHANNELS; i++)
+    config[i] = Settings::getDefaultChannel();
+  engine.begin(0);
+  engine.configure(config);
+  fixture_latency = latency;
+  xTaskCreatePinnedToCore(start_fixture_timer_task, "start_outputs", 4096, xTaskGetCurrentTaskHandle(),
+                          TASK_OUTPUT_START_PRIORITY, nullptr, TASK_CORE_OUTPUT);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  IrigTime time = {0, 0, 12, 1, 2025};
+  uint32_t frame, start_us;
+  timebase_last_frame(frame, start_us);
+  engine.encode(time, 0, frame + 1);
+}
+
+#endif // OUTPUT_FIXTURE_H
@@ -0,0 +1,105 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "../output_fixture.h"
+
+// On the board: pio test -e esp32-s3-devkitc-1 -f device/test_flash_stress
+//
+// Runs the eight channels from the firmware's output timer handler
+// (output_fixture.h) and saves the settings back to back for
+// FLASH_STRESS_SECONDS, then checks that the frames kept their one second
+// spacing while the flash cache was off for the writes. A tick interrupt that stalls on flash shows up as a
+// late frame start, an encoder task that falls a frame behind as an
+// underrun. The frame starts are checked rather than the loopback
+// decoder, whose pin interrupt is not in IRAM and stalls itself.
+
+#define FLASH_STRESS_SECONDS 120
+#define FLASH_STRESS_SAVE_MS 100
+#define FLASH_STRESS_MAX_SLIP_US 50
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_frames_keep_time_through_flash_writes()
+{
+  TEST_ASSERT_TRUE_MESSAGE(timer_started, "Output timer failed to start");
+  SettingsData original = *settings.get();
+  SettingsData changed = original;
+  // Only read when the network is set up at boot
+  strcpy(changed.network.dns, strcmp(original.network.dns, "0.0.0.0") ? "0.0.0.0" : "0.0.0.1");
+
+  uint32_t underruns_before = 0;
+  for (int i = 0; i < IRIG_CHANNELS; i++)
+    underruns_before += outputs[i]->underrunCount();
+  uint32_t last_frame, last_start_us;
+  timebase_last_frame(last_frame, last_start_us);
+  uint32_t saves = 0, failed_saves = 0, frames = 0;
+  int32_t worst_slip_us = 0;
+  int32_t worst_age_us = 0;
+  uint32_t begin_ms = millis();
+  while (millis() - begin_ms < FLASH_STRESS_SECONDS * 1000UL)
+  {
+    settings.publish(saves & 1 ? original : changed);
+    if (settings.save())
+      saves++;
+    else
+      failed_saves++;
+
+    uint32_t frame, start_us;
+    timebase_last_frame(frame, start_us);
+    // Since the last frame start: more than a frame means one is missing
+    int32_t age_us = (int32_t)(micros() - start_us);
+    if (age_us > worst_age_us)
+      worst_age_us = age_us;
+    if (frame != last_frame)
+    {
+      int32_t slip_us = (int32_t)(start_us - last_start_us - (frame - last_frame) * 1000000UL);
+      if (abs(slip_us) > abs(worst_slip_us))
+        worst_slip_us = slip_us;
+      frames += frame - last_frame;
+      last_frame = frame;
+      last_start_us = start_us;
+    }
+    delay(FLASH_STRESS_SAVE_MS);
+  }
+  settings.publish(original);
+  settings.save();
+
+  uint32_t underruns = 0;
+  for (int i = 0; i < IRIG_CHANNELS; i++)
+    underruns += outputs[i]->underrunCount();
+  underruns -= underruns_before;
+
+  char report[160];
+  snprintf(report, sizeof(report),
+           "%u saves (%u failed), %u frames (%u holdover, %u underruns), worst slip %d us, longest gap %d us",
+           (unsigned)saves, (unsigned)failed_saves, (unsigned)frames, (unsigned)engine.holdoverFrames(),
+           (unsigned)underruns, (int)worst_slip_us, (int)worst_age_us);
+  TEST_MESSAGE(report);
+  TEST_ASSERT_GREATER_THAN(FLASH_STRESS_SECONDS / 2, frames);
+  TEST_ASSERT_EQUAL(0, failed_saves);
+  TEST_ASSERT_EQUAL(0, underruns);
+  TEST_ASSERT_INT_WITHIN(FLASH_STRESS_MAX_SLIP_US, 0, worst_slip_us);
+  TEST_ASSERT_LESS_THAN(1000000 + FLASH_STRESS_MAX_SLIP_US, worst_age_us);
+}
+
+void setup()
+{
+  // Time for the test runner to open the serial port
+  delay(2000);
+  start_fixture_outputs(nullptr);
+  // Let the outputs settle
+  delay(5000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_frames_keep_time_through_flash_writes);
+  UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,131 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include "ethernet.h"
+#include "metrics.h"
+#include "../output_fixture.h"
+
+// On the board, with the Ethernet port connected:
+// pio test -e esp32-s3-devkitc-1 -f device/test_jitter
+//
+// Runs the eight channels from the firmware's output timer handler on the
+// output core (output_fixture.h) and records the interrupt entry latency
+// for JITTER_PHASE_S seconds without, then with, a UDP flood to the
+// discard port of the gateway sent from the network core. The network load must not reach the output interrupt.
+// Build with -DTASK_CORE_OUTPUT=0 to see the one core layout fail it.
+
+#define JITTER_PHASE_S 30
+#define JITTER_PACKET 1400
+#define JITTER_BURST 16
+// Latency bucket (LATENCY_BOUNDS_US) no interrupt may go beyond in either phase
+#define JITTER_MAX_BUCKET 4   // 50 us
+#define JITTER_MIN_PACKETS 1000
+
+static LatencyHistogram isr_latency;
+
+struct JitterPhase
+{
+  uint32_t counts[LATENCY_BUCKETS + 1];
+  uint32_t interrupts;
+  uint32_t mean_us;
+  uint32_t packets;
+};
+
+// Run one phase and take the latencies recorded meanwhile
+static void run_phase(bool flood, JitterPhase &phase)
+{
+  static uint8_t packet[JITTER_PACKET];
+  memset(packet, 0x55, sizeof(packet));
+  WiFiUDP udp;
+  IPAddress target = eth_gateway_ip();
+
+  uint32_t before[LATENCY_BUCKETS + 1], max;
+  uint64_t sum_before, sum_after;
+  isr_latency.snapshot(before, sum_before, max);
+  phase.packets = 0;
+  uint32_t begin_ms = millis();
+  while (millis() - begin_ms < JITTER_PHASE_S * 1000UL)
+  {
+    if (!flood)
+    {
+      delay(100);
+      continue;
+    }
+    for (int i = 0; i < JITTER_BURST; i++)
+    {
+      udp.beginPacket(target, 9);
+      udp.write(packet, sizeof(packet));
+      if (udp.endPacket())
+        phase.packets++;
+    }
+    // Lets the idle task of the network core feed the watchdog
+    delay(1);
+  }
+  isr_latency.snapshot(phase.counts, sum_after, max);
+
+  phase.interrupts = 0;
+  for (int i = 0; i <= LATENCY_BUCKETS; i++)
+  {
+    phase.counts[i] -= before[i];
+    phase.interrupts += phase.counts[i];
+  }
+  phase.mean_us = phase.interrupts ? (uint32_t)((sum_after - sum_before) / phase.interrupts) : 0;
+
+  char report[160];
+  int n = snprintf(report, sizeof(report), "%s: %u interrupts, mean %u us, %u packets;", flood ? "flood" : "quiet",
+                   (unsigned)phase.interrupts, (unsigned)phase.mean_us, (unsigned)phase.packets);
+  for (int i = 0; i <= LATENCY_BUCKETS && n < (int)sizeof(report); i++)
+    n += snprintf(report + n, sizeof(report) - n, i < LATENCY_BUCKETS ? " <=%u: %u" : " >%u: %u",
+                  (unsigned)LATENCY_BOUNDS_US[i < LATENCY_BUCKETS ? i : i - 1], (unsigned)phase.counts[i]);
+  TEST_MESSAGE(report);
+}
+
+static void check_bound(const JitterPhase &phase)
+{
+  TEST_ASSERT_GREATER_THAN(JITTER_PHASE_S * 1000, phase.interrupts);
+  for (int i = JITTER_MAX_BUCKET + 1; i <= LATENCY_BUCKETS; i++)
+    TEST_ASSERT_EQUAL_UINT32(0, phase.counts[i]);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_output_latency_under_network_load()
+{
+  TEST_ASSERT_TRUE_MESSAGE(timer_started, "Output timer failed to start");
+  if (!eth_link_up() || (uint32_t)eth_gateway_ip() == 0)
+    TEST_IGNORE_MESSAGE("No Ethernet link or gateway to flood");
+
+  JitterPhase quiet, flood;
+  run_phase(false, quiet);
+  run_phase(true, flood);
+  TEST_ASSERT_GREATER_THAN(JITTER_MIN_PACKETS, flood.packets);
+  check_bound(quiet);
+  check_bound(flood);
+}
+
+void setup()
+{
+  // Time for the test runner to open the serial port
+  delay(2000);
+  start_fixture_outputs(&isr_latency);
+
+  // The network as the firmware sets it up, from the stored settings
+  if (eth_init())
+    eth_configure_network(&settings);
+  // Link, DHCP and the outputs settled
+  delay(10000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_output_latency_under_network_load);
+  UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,117 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core and FreeRTOS that the
+// output engine and IRIGB use, so the native tests build them unchanged
+// (-I test/native/host in env:native). ARDUINO stays undefined, the
+// device-only sources are left out as before.
+//
+// - Pins are levels in host_pins().
+// - A task is created but never runs. Its notifications are counted in
+//   host_notifications() and the test does the task's work.
+// - A critical section locks nothing. Leaving one calls the hook armed
+//   with host_on_unlock() once, so a test can run the timer or another
+//   task exactly where the lock is released.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#define LOW 0
+#define HIGH 1
+#define OUTPUT 0x03
+
+inline uint8_t* host_pins() {
+  static uint8_t levels[64];
+  return levels;
+}
+
+inline void pinMode(uint8_t, uint8_t) {
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+  host_pins()[pin] = level ? HIGH : LOW;
+}
+
+struct HostSerial {
+  void print(const char*) {}
+  void println(const char* = "") {}
+  void printf(const char*, ...) {}
+};
+static HostSerial Serial __attribute__((unused));
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define portMAX_DELAY 0xffffffffUL
+
+inline uint32_t& host_notifications() {
+  static uint32_t count;
+  return count;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, BaseType_t,
+                                          TaskHandle_t* handle, BaseType_t) {
+  if (handle) *handle = &host_notifications();
+  return pdPASS;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) {
+  host_notifications()++;
+  return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t* woken) {
+  host_notifications()++;
+  if (woken) *woken = pdTRUE;
+}
+
+// Takes every notification, without blocking
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) {
+  uint32_t count = host_notifications();
+  host_notifications() = 0;
+  return count;
+}
+
+typedef void (*HostHook)();
+
+inline HostHook& host_unlock_hook() {
+  static HostHook hook;
+  return hook;
+}
+
+// Run 'hook' when the next critical section is left
+inline void host_on_unlock(HostHook hook) {
+  host_unlock_hook() = hook;
+}
+
+inline void host_unlocked() {
+  HostHook hook = host_unlock_hook();
+  if (hook) {
+    host_unlock_hook() = nullptr;
+    hook();
+  }
+}
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) host_unlocked()
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) host_unlocked()
+#define portENTER_CRITICAL_SAFE(mux) ((void)(mux))
+#define portEXIT_CRITICAL_SAFE(mux) host_unlocked()
+
+#endif // HOST_ARDUINO_H
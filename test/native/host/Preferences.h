@@ -0,0 +1,8 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+// Host stand-in: Settings holds one, settings.cpp that uses it is device-only
+class Preferences {
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,34 @@
+#ifndef HOST_GPIO_STRUCT_H
+#define HOST_GPIO_STRUCT_H
+
+// Host stand-in for the GPIO set/clear registers fast_gpio_write() uses:
+// each write sets the masked pins in host_pins()
+
+#include <Arduino.h>
+
+struct HostGpioRegister {
+  uint8_t first_pin;
+  uint8_t level;
+
+  HostGpioRegister& operator=(uint32_t mask) {
+    for (uint8_t bit = 0; bit < 32; bit++) {
+      if (mask & (1UL << bit)) host_pins()[first_pin + bit] = level;
+    }
+    return *this;
+  }
+};
+
+struct HostGpioRegisterHigh {
+  HostGpioRegister val;
+};
+
+struct HostGpio {
+  HostGpioRegister out_w1ts;
+  HostGpioRegister out_w1tc;
+  HostGpioRegisterHigh out1_w1ts;
+  HostGpioRegisterHigh out1_w1tc;
+};
+
+static HostGpio GPIO __attribute__((unused)) = {{0, HIGH}, {0, LOW}, {{32, HIGH}}, {{32, LOW}}};
+
+#endif // HOST_GPIO_STRUCT_H
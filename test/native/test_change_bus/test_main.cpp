@@ -0,0 +1,111 @@
+#include <unity.h>
+#include <chrono>
+#include <thread>
+#include "change_bus.h"
+
+// The host build of the bus: a mutex and condition variable in place of the
+// task notifications, with the same delivery rules. Every test has its own
+// bus; the publishing side runs on a second thread where a wait must wake.
+
+#define FIELD(n) ((ChangeMask)1 << (n))
+
+typedef std::chrono::steady_clock Clock;
+
+static uint32_t elapsed_ms(Clock::time_point since) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - since).count();
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_interest_filter() {
+  ChangeBus bus;
+  int network = bus.subscribe("network", FIELD(0) | FIELD(1));
+  int outputs = bus.subscribe("outputs", FIELD(2) | FIELD(40));
+  bus.publish(FIELD(1) | FIELD(2) | FIELD(7));
+  // Each sees only its own fields, nobody the one nobody asked for
+  TEST_ASSERT_TRUE(bus.wait(network, 0) == FIELD(1));
+  TEST_ASSERT_TRUE(bus.wait(outputs, 0) == FIELD(2));
+  bus.publish(FIELD(40));
+  TEST_ASSERT_TRUE(bus.wait(network, 0) == 0);
+  TEST_ASSERT_TRUE(bus.wait(outputs, 0) == FIELD(40));
+}
+
+void test_pending_changes_merge() {
+  ChangeBus bus;
+  int id = bus.subscribe("busy", ~(ChangeMask)0);
+  // Published while the subscriber was not waiting
+  bus.publish(FIELD(3));
+  bus.publish(FIELD(63));
+  bus.publish(FIELD(3) | FIELD(5));
+  TEST_ASSERT_TRUE(bus.wait(id, 0) == (FIELD(3) | FIELD(5) | FIELD(63)));
+  // Taken once
+  TEST_ASSERT_TRUE(bus.wait(id, 0) == 0);
+}
+
+void test_wait_times_out() {
+  ChangeBus bus;
+  int id = bus.subscribe("idle", FIELD(0));
+  bus.publish(FIELD(1));
+  Clock::time_point start = Clock::now();
+  TEST_ASSERT_TRUE(bus.wait(id, 50) == 0);
+  TEST_ASSERT_GREATER_OR_EQUAL(50, elapsed_ms(start));
+}
+
+void test_publish_wakes_waiter() {
+  ChangeBus bus;
+  int id = bus.subscribe("waiter", FIELD(4));
+  std::thread publisher([&bus] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    bus.publish(FIELD(9));
+    bus.publish(FIELD(4));
+  });
+  Clock::time_point start = Clock::now();
+  ChangeMask changes = bus.wait(id, 5000);
+  uint32_t waited = elapsed_ms(start);
+  publisher.join();
+  TEST_ASSERT_TRUE(changes == FIELD(4));
+  TEST_ASSERT_LESS_THAN(5000, waited);
+}
+
+void test_every_subscriber_woken() {
+  ChangeBus bus;
+  int first = bus.subscribe("first", FIELD(8));
+  int second = bus.subscribe("second", FIELD(8) | FIELD(9));
+  ChangeMask seen[2] = {0, 0};
+  std::thread a([&] { seen[0] = bus.wait(first, 5000); });
+  std::thread b([&] { seen[1] = bus.wait(second, 5000); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  bus.publish(FIELD(8) | FIELD(9));
+  a.join();
+  b.join();
+  TEST_ASSERT_TRUE(seen[0] == FIELD(8));
+  TEST_ASSERT_TRUE(seen[1] == (FIELD(8) | FIELD(9)));
+}
+
+void test_subscriber_limit() {
+  ChangeBus bus;
+  for (int i = 0; i < CHANGE_BUS_MAX_SUBSCRIBERS; i++) {
+    TEST_ASSERT_EQUAL(i, bus.subscribe("task", FIELD(i)));
+  }
+  TEST_ASSERT_EQUAL(-1, bus.subscribe("one too many", FIELD(0)));
+  // Unknown ids never see anything
+  bus.publish(~(ChangeMask)0);
+  TEST_ASSERT_TRUE(bus.wait(-1, 0) == 0);
+  TEST_ASSERT_TRUE(bus.wait(CHANGE_BUS_MAX_SUBSCRIBERS, 0) == 0);
+  TEST_ASSERT_TRUE(bus.wait(CHANGE_BUS_MAX_SUBSCRIBERS - 1, 0) == FIELD(CHANGE_BUS_MAX_SUBSCRIBERS - 1));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_interest_filter);
+  RUN_TEST(test_pending_changes_merge);
+  RUN_TEST(test_wait_times_out);
+  RUN_TEST(test_publish_wakes_waiter);
+  RUN_TEST(test_every_subscriber_woken);
+  RUN_TEST(test_subscriber_limit);
+  return UNITY_END();
+}
@@ -0,0 +1,124 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "irig_am.h"
+
+// Renders an AM frame in awkward block sizes and reads it back the way a
+// receiver would: the peak of every carrier cycle gives its amplitude, the
+// count of mark cycles in each element gives the pulse width.
+
+#define AMPLITUDE 10000
+#define MAX_FRAME_SAMPLES (IRIG_AM_MAX_SAMPLES_PER_CYCLE * IRIG_AM_CYCLES_PER_ELEMENT * IRIG_FRAME_BITS + 1000)
+
+static int16_t samples[MAX_FRAME_SAMPLES];
+static bool bits[IRIG_FRAME_BITS];
+
+static void encode() {
+  IrigTime time = {56, 34, 12, 123, 2025};
+  TEST_ASSERT_TRUE(irig_encode_frame<IrigC37118>(time, -5, TimeQuality::WITHIN_1_US,
+                                                 ContinuousTimeQuality::ERROR_LT_1_US, bits));
+}
+
+// Render the whole frame 'block' samples at a time
+static size_t render(IrigAmSynth& synth, int32_t adjust, size_t block) {
+  synth.beginFrame(bits, adjust);
+  size_t total = 0;
+  size_t n;
+  while ((n = synth.render(samples + total, block)) > 0) {
+    total += n;
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_FRAME_SAMPLES, total);
+  }
+  TEST_ASSERT_EQUAL_UINT32(total, synth.position());
+  return total;
+}
+
+static int cycle_peak(const int16_t* cycle, uint16_t length) {
+  int peak = 0;
+  for (uint16_t i = 0; i < length; i++) {
+    if (abs(cycle[i]) > peak) peak = abs(cycle[i]);
+  }
+  return peak;
+}
+
+static void check_rate(uint32_t sample_rate, size_t block) {
+  IrigAmSynth synth(sample_rate, AMPLITUDE);
+  TEST_ASSERT_EQUAL_UINT32(sample_rate, synth.sampleRate());
+  uint16_t cycle = synth.samplesPerCycle();
+  TEST_ASSERT_EQUAL_UINT32(synth.nominalFrameSamples(), render(synth, 0, block));
+
+  bool decoded[IRIG_FRAME_BITS];
+  int mark_peak = 0;
+  int space_peak = AMPLITUDE;
+  for (int element = 0; element < IRIG_FRAME_BITS; element++) {
+    const int16_t* first = samples + (size_t)element * IRIG_AM_CYCLES_PER_ELEMENT * cycle;
+    // Every element starts on a zero crossing, going positive
+    TEST_ASSERT_EQUAL(0, first[0]);
+    TEST_ASSERT_GREATER_THAN(0, first[1]);
+
+    int marks = 0;
+    for (int c = 0; c < IRIG_AM_CYCLES_PER_ELEMENT; c++) {
+      int peak = cycle_peak(first + c * cycle, cycle);
+      if (peak > AMPLITUDE * 13 / 20) {
+        marks++;
+        if (peak > mark_peak) mark_peak = peak;
+      } else {
+        if (peak < space_peak) space_peak = peak;
+      }
+      // Mark cycles lead, no mark after a space within an element
+      TEST_ASSERT_TRUE(peak <= AMPLITUDE * 13 / 20 || c == marks - 1);
+    }
+
+    // 2 ms zero, 5 ms one, 8 ms marker (set in the encoded frame too)
+    bool marker = element % 10 == 0 || element == 1;
+    TEST_ASSERT_EQUAL(marker, marks == 8);
+    TEST_ASSERT_TRUE(marks == 2 || marks == 5 || marks == 8);
+    decoded[element] = marks != 2;
+  }
+  TEST_ASSERT_EQUAL_MEMORY(bits, decoded, sizeof(bits));
+
+  // Mark to space 10:3, to the rounding of one sample
+  TEST_ASSERT_INT_WITHIN(1, AMPLITUDE, mark_peak);
+  TEST_ASSERT_INT_WITHIN(1, mark_peak * 3 / 10, space_peak);
+}
+
+void setUp() {
+  encode();
+}
+
+void tearDown() {
+}
+
+void test_am_8khz() {
+  check_rate(8000, 7);
+}
+
+void test_am_48khz() {
+  check_rate(48000, 1000);
+}
+
+void test_am_96khz() {
+  check_rate(96000, 4093);
+}
+
+void test_adjust_appends_silence() {
+  IrigAmSynth synth(48000, AMPLITUDE);
+  size_t total = render(synth, 100, 512);
+  TEST_ASSERT_EQUAL_UINT32(synth.nominalFrameSamples() + 100, total);
+  for (size_t i = synth.nominalFrameSamples(); i < total; i++) {
+    TEST_ASSERT_EQUAL(0, samples[i]);
+  }
+}
+
+void test_adjust_drops_samples() {
+  IrigAmSynth synth(48000, AMPLITUDE);
+  TEST_ASSERT_EQUAL_UINT32(synth.nominalFrameSamples() - 30, render(synth, -30, 512));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_am_8khz);
+  RUN_TEST(test_am_48khz);
+  RUN_TEST(test_am_96khz);
+  RUN_TEST(test_adjust_appends_silence);
+  RUN_TEST(test_adjust_drops_samples);
+  return UNITY_END();
+}
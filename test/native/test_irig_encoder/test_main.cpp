@@ -0,0 +1,135 @@
+#include <unity.h>
+#include <string.h>
+#include "irig_encoder.h"
+
+// Golden frames of every format for 2025, day 123, 12:34:56, UTC-5, time
+// quality < 1 us and continuous time quality < 1 us. Worked out by hand
+// from IRIG 200 and IEEE C37.118, one group of ten per position identifier.
+
+static const IrigTime TIME = {56, 34, 12, 123, 2025};
+#define OFFSET_HOURS -5
+#define TQ TimeQuality::WITHIN_1_US
+#define CTQ ContinuousTimeQuality::ERROR_LT_1_US
+
+// 0-49 are the same in every format: seconds 6/5, minutes 4/3, hours 2/1,
+// day 3/2/1
+#define TOY "1101100101" "1001001100" "1010001000" "1110000100" "1100000000"
+#define NO_YEAR "1000000000"
+#define YEAR "1101000100"                      // 5, 2
+#define NO_CF "1000000000" "1000000000"
+#define IEEE_1344_CF "1000011010" "1000100000"  // West, 5 h, quality 4, parity
+#define C37_118_CF "1000011010" "1000100010"    // The same plus continuous quality 2
+#define NO_SBS "1000000000" "1000000000"
+#define SBS "1000011110" "1000110100"          // 45296
+
+static const char* const GOLDEN[IRIG_FORMAT_COUNT] = {
+  TOY NO_YEAR NO_CF SBS,           // B000
+  TOY NO_YEAR NO_CF NO_SBS,        // B001
+  TOY NO_YEAR NO_CF NO_SBS,        // B002
+  TOY NO_YEAR NO_CF SBS,           // B003
+  TOY YEAR NO_CF SBS,              // B004
+  TOY YEAR NO_CF NO_SBS,           // B005
+  TOY YEAR NO_CF NO_SBS,           // B006
+  TOY YEAR NO_CF SBS,              // B007
+  TOY YEAR IEEE_1344_CF SBS,       // IEEE 1344
+  TOY YEAR C37_118_CF SBS,         // C37.118
+};
+
+static void frame_text(const bool* bits, char* text) {
+  for (int i = 0; i < IRIG_FRAME_BITS; i++) {
+    text[i] = bits[i] ? '1' : '0';
+  }
+  text[IRIG_FRAME_BITS] = '\0';
+}
+
+static void check_format(IrigFormat format) {
+  bool bits[IRIG_FRAME_BITS];
+  char text[IRIG_FRAME_BITS + 1];
+  TEST_ASSERT_TRUE(irig_frame_encoder(format)(TIME, OFFSET_HOURS, TQ, CTQ, bits));
+  frame_text(bits, text);
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(GOLDEN[static_cast<uint8_t>(format)], text, irig_format_name(format));
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_b000() { check_format(IrigFormat::B000); }
+void test_b001() { check_format(IrigFormat::B001); }
+void test_b002() { check_format(IrigFormat::B002); }
+void test_b003() { check_format(IrigFormat::B003); }
+void test_b004() { check_format(IrigFormat::B004); }
+void test_b005() { check_format(IrigFormat::B005); }
+void test_b006() { check_format(IrigFormat::B006); }
+void test_b007() { check_format(IrigFormat::B007); }
+void test_ieee_1344() { check_format(IrigFormat::IEEE_1344); }
+void test_c37_118() { check_format(IrigFormat::C37_118); }
+
+void test_unknown_format_gets_default() {
+  TEST_ASSERT_TRUE(irig_frame_encoder(static_cast<IrigFormat>(IRIG_FORMAT_COUNT)) ==
+                   irig_frame_encoder(IRIG_FORMAT_DEFAULT));
+}
+
+void test_time_out_of_range_sends_markers_only() {
+  IrigTime time = {0, 0, 24, 1, 2025};
+  bool bits[IRIG_FRAME_BITS];
+  char text[IRIG_FRAME_BITS + 1];
+  TEST_ASSERT_FALSE(irig_encode_frame<IrigC37118>(time, 0, TQ, CTQ, bits));
+  frame_text(bits, text);
+  TEST_ASSERT_EQUAL_STRING("1100000000" "1000000000" "1000000000" "1000000000" "1000000000"
+                           "1000000000" "1000000000" "1000000000" "1000000000" "1000000000", text);
+}
+
+void test_east_offset_and_parity() {
+  // UTC+14 clears the sign and keeps three 1s in 65-69, an even count of
+  // ones before the parity; UTC+3 has one fewer and sets it
+  bool bits[IRIG_FRAME_BITS];
+  TEST_ASSERT_TRUE(irig_encode_frame<IrigIeee1344>(TIME, 14, TQ, CTQ, bits));
+  TEST_ASSERT_FALSE(bits[65]);
+  TEST_ASSERT_FALSE(bits[66]);
+  TEST_ASSERT_TRUE(bits[67]);
+  TEST_ASSERT_TRUE(bits[68]);
+  TEST_ASSERT_TRUE(bits[69]);
+  TEST_ASSERT_FALSE(bits[76]);
+  TEST_ASSERT_TRUE(irig_encode_frame<IrigIeee1344>(TIME, 3, TQ, CTQ, bits));
+  TEST_ASSERT_TRUE(bits[76]);
+}
+
+void test_next_second_carries_into_leap_year_end() {
+  IrigTime time = {59, 59, 23, 365, 2024};
+  irig_time_next_second(time);
+  TEST_ASSERT_EQUAL(366, time.day);
+  TEST_ASSERT_EQUAL(0, time.hour);
+  time.hour = 23;
+  time.minute = 59;
+  time.second = 59;
+  irig_time_next_second(time);
+  TEST_ASSERT_EQUAL(1, time.day);
+  TEST_ASSERT_EQUAL(2025, time.year);
+
+  IrigTime two_digit = {59, 59, 23, 365, 99};
+  irig_time_next_second(two_digit);
+  TEST_ASSERT_EQUAL(1, two_digit.day);
+  TEST_ASSERT_EQUAL(0, two_digit.year);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_b000);
+  RUN_TEST(test_b001);
+  RUN_TEST(test_b002);
+  RUN_TEST(test_b003);
+  RUN_TEST(test_b004);
+  RUN_TEST(test_b005);
+  RUN_TEST(test_b006);
+  RUN_TEST(test_b007);
+  RUN_TEST(test_ieee_1344);
+  RUN_TEST(test_c37_118);
+  RUN_TEST(test_unknown_format_gets_default);
+  RUN_TEST(test_time_out_of_range_sends_markers_only);
+  RUN_TEST(test_east_offset_and_parity);
+  RUN_TEST(test_next_second_carries_into_leap_year_end);
+  return UNITY_END();
+}
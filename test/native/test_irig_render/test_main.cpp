@@ -0,0 +1,187 @@
+#include <unity.h>
+#include <string.h>
+#include "irig_render.h"
+
+// Three channels with different frames, advances and polarities, and idle
+// channels at either level. The expected buffers are built pulse by pulse,
+// not sample by sample like the renderer.
+
+#define REPEAT 2                       // 0.5 ms samples
+#define SAMPLE_US (1000 / REPEAT)
+#define SAMPLES (IRIG_FRAME_TICKS * REPEAT)
+
+static bool frame_a[IRIG_FRAME_BITS];
+static bool frame_b[IRIG_FRAME_BITS];
+static const bool* frames[IRIG_CHANNELS];
+static uint16_t advance_us[IRIG_CHANNELS];
+static uint8_t invert;
+
+static uint8_t rendered[SAMPLES];
+static uint8_t expected[SAMPLES];
+
+void setUp() {
+  IrigTime time = {56, 34, 12, 123, 2025};
+  irig_encode_frame<IrigC37118>(time, -5, TimeQuality::WITHIN_1_US, ContinuousTimeQuality::ERROR_LT_1_US, frame_a);
+  time.second = 57;
+  irig_encode_frame<IrigB002>(time, 0, TimeQuality::LOCKED_TO_UTC, ContinuousTimeQuality::NOT_USED, frame_b);
+
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    frames[i] = nullptr;
+    advance_us[i] = 0;
+  }
+  // Channel 0 on time, 1 inverted and 0.5 ms early, 2 the most advanced
+  // with another frame; 5 idles high, the rest low
+  frames[0] = frame_a;
+  frames[1] = frame_a;
+  advance_us[1] = 500;
+  frames[2] = frame_b;
+  advance_us[2] = IRIG_ADVANCE_MAX_US;
+  invert = (1 << 1) | (1 << 5);
+}
+
+void tearDown() {
+}
+
+// Pulses of channel 'channel' from its frame start on, 'shift' samples into
+// the buffer
+static void expect_channel(int channel, const bool* bits, uint32_t shift) {
+  uint8_t bit = 1 << channel;
+  for (int element = 0; element < IRIG_FRAME_BITS; element++) {
+    bool marker = element % 10 == 0 || element == 1;
+    uint32_t width = (marker ? 8 : bits[element] ? 5 : 2) * REPEAT;
+    uint32_t first = shift + element * IRIG_TICKS_PER_ELEMENT * REPEAT;
+    for (uint32_t n = first; n < first + width && n < SAMPLES; n++) {
+      expected[n] ^= bit;
+    }
+  }
+}
+
+static void build_expected() {
+  memset(expected, invert, sizeof(expected));
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    if (frames[i]) {
+      expect_channel(i, frames[i], (IRIG_RENDER_LEAD_US - advance_us[i]) / SAMPLE_US);
+    }
+  }
+}
+
+void test_frame_start() {
+  irig_render_frame(frames, invert, advance_us, REPEAT, rendered);
+  // Worked out by hand: channel 2 starts at sample 0, 1 at 1 and 0 at 2,
+  // each with an 8 ms marker, then 2 starts its Pr marker at sample 20
+  static const uint8_t START[] = {0x26, 0x24, 0x25};
+  static const uint8_t MARKER_END[] = {0x25, 0x21, 0x23, 0x22, 0x22, 0x26};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(START, rendered, sizeof(START));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(MARKER_END, rendered + 15, sizeof(MARKER_END));
+}
+
+void test_frame_byte_for_byte() {
+  irig_render_frame(frames, invert, advance_us, REPEAT, rendered);
+  build_expected();
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, rendered, SAMPLES);
+}
+
+void test_advance_is_clamped() {
+  advance_us[0] = IRIG_ADVANCE_MAX_US + 500;
+  irig_render_frame(frames, invert, advance_us, REPEAT, rendered);
+  advance_us[0] = IRIG_ADVANCE_MAX_US;
+  build_expected();
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, rendered, SAMPLES);
+}
+
+void test_idle_channels_only() {
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    frames[i] = nullptr;
+  }
+  irig_render_frame(frames, invert, advance_us, REPEAT, rendered);
+  build_expected();
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, rendered, SAMPLES);
+  TEST_ASSERT_EQUAL(invert, rendered[SAMPLES - 1]);
+}
+
+static IrigEdge edges[IRIG_FRAME_EDGES_MAX];
+
+// Every edge of channel 'channel' lands (element * 10 + 0/width ms) less its
+// advance after the lead, and no other channel moves it
+static void check_edge_offsets(size_t count, int channel) {
+  uint8_t bit = 1 << channel;
+  uint32_t lead = IRIG_RENDER_LEAD_US - advance_us[channel];
+  uint8_t level = invert & bit;
+  int changes = 0;
+  for (size_t k = 0; k < count; k++) {
+    if ((edges[k].levels & bit) == level) {
+      continue;
+    }
+    level = edges[k].levels & bit;
+    int element = changes / 2;
+    bool marker = element % 10 == 0 || element == 1;
+    uint32_t ms = element * IRIG_TICKS_PER_ELEMENT + (changes % 2 ? (marker ? 8 : frames[channel][element] ? 5 : 2) : 0);
+    TEST_ASSERT_EQUAL_UINT32(ms * 1000 + lead, edges[k].offset_us);
+    changes++;
+  }
+  TEST_ASSERT_EQUAL(2 * IRIG_FRAME_BITS, changes);
+}
+
+void test_edges_per_channel_advance() {
+  // Every channel on, advances that are not multiples of anything, two
+  // of them equal so they share their edges
+  static const uint16_t ADVANCES[IRIG_CHANNELS] = {0, 1, 250, 999, IRIG_ADVANCE_MAX_US, 250, 731, 40};
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    frames[i] = i % 3 ? frame_a : frame_b;
+    advance_us[i] = ADVANCES[i];
+  }
+  invert = 0x96;
+  size_t count = irig_render_edges(frames, invert, advance_us, edges);
+  TEST_ASSERT_LESS_OR_EQUAL(IRIG_FRAME_EDGES_MAX, count);
+
+  // One entry per distinct offset, in order, starting at the frame start
+  TEST_ASSERT_EQUAL_UINT32(0, edges[0].offset_us);
+  for (size_t k = 1; k < count; k++) {
+    TEST_ASSERT_GREATER_THAN(edges[k - 1].offset_us, edges[k].offset_us);
+  }
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    check_edge_offsets(count, i);
+  }
+}
+
+void test_edges_single_channel() {
+  // Alone, a channel's rising edges are exactly its advance before the element starts
+  static const uint16_t ADVANCES[] = {0, 1, 500, IRIG_ADVANCE_MAX_US - 1, IRIG_ADVANCE_MAX_US};
+  for (uint16_t advance : ADVANCES) {
+    for (int i = 0; i < IRIG_CHANNELS; i++) {
+      frames[i] = nullptr;
+    }
+    frames[3] = frame_a;
+    advance_us[3] = advance;
+    invert = 0;
+    size_t count = irig_render_edges(frames, invert, advance_us, edges);
+    // The most advanced channel rises on the first entry itself
+    TEST_ASSERT_EQUAL_UINT32(advance == IRIG_ADVANCE_MAX_US ? 2 * IRIG_FRAME_BITS : 2 * IRIG_FRAME_BITS + 1, count);
+    check_edge_offsets(count, 3);
+  }
+}
+
+void test_edges_match_samples() {
+  // With advances on the sample grid the edges describe the sampled frame
+  size_t count = irig_render_edges(frames, invert, advance_us, edges);
+  irig_render_frame(frames, invert, advance_us, REPEAT, rendered);
+  size_t k = 0;
+  for (uint32_t n = 0; n < SAMPLES; n++) {
+    while (k + 1 < count && edges[k + 1].offset_us <= n * SAMPLE_US) {
+      k++;
+    }
+    TEST_ASSERT_EQUAL(rendered[n], edges[k].levels);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_start);
+  RUN_TEST(test_frame_byte_for_byte);
+  RUN_TEST(test_advance_is_clamped);
+  RUN_TEST(test_idle_channels_only);
+  RUN_TEST(test_edges_per_channel_advance);
+  RUN_TEST(test_edges_single_channel);
+  RUN_TEST(test_edges_match_samples);
+  return UNITY_END();
+}
@@ -0,0 +1,436 @@
+#include <unity.h>
+#include <string.h>
+#include "pins.h"
+#include "output.h"
+
+// The output engine on the host, with test/native/host standing in for
+// the Arduino core and FreeRTOS. The tests run the encoder task by hand
+// where the firmware would schedule it. The host lock hook puts a frame
+// start, an encode() or a configure() right where encodeFrame() lets go of
+// its snapshot. Every frame is checked against irig_frame_encoder() with
+// the time it should carry and a single channel configuration.
+
+#define OFFSET_HOURS 5
+#define HANDOFF_FRAMES 400
+
+static const uint8_t PINS[IRIG_CHANNELS] = {P1, P2, P3, P4, P5, P6, P7, P8};
+// Carried by frame 1, a few seconds before a year end
+static const IrigTime FIRST = {50, 59, 23, 365, 2026};
+
+static IRIGB* channels[IRIG_CHANNELS];
+static OutputEngine* engine;
+static ChannelConfig config[IRIG_CHANNELS];
+
+static uint32_t random_state;
+
+static uint32_t next_random() {
+  random_state = random_state * 1103515245 + 12345;
+  return random_state >> 16;
+}
+
+// Local time of frame 'frame'
+static IrigTime time_of(uint32_t frame) {
+  IrigTime time;
+  irig_time_from_seconds(irig_time_to_seconds(FIRST) + frame - 1, time);
+  return time;
+}
+
+// Every channel on, with its own format, alternately UTC and local time
+static void default_config(ChannelConfig* out) {
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    out[i].format = i % IRIG_FORMAT_COUNT;
+    out[i].utc = i & 1;
+    out[i].enabled = true;
+    out[i].invert = i == 5;
+    out[i].advance_us = 0;
+  }
+}
+
+static void random_config(ChannelConfig* out) {
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    out[i].format = next_random() % IRIG_FORMAT_COUNT;
+    out[i].utc = next_random() % 2;
+    out[i].enabled = next_random() % 4 != 0;
+    out[i].invert = next_random() % 2;
+    out[i].advance_us = 0;
+  }
+}
+
+// Channel 'i' sends frame number 'frame' the way 'channel' has it
+static bool sends(int i, const ChannelConfig& channel, uint32_t frame) {
+  IrigTime time = time_of(frame);
+  if (channel.utc) {
+    irig_time_from_seconds(irig_time_to_seconds(time) - OFFSET_HOURS * 3600L, time);
+  }
+  bool expected[IRIG_FRAME_BITS];
+  irig_frame_encoder((IrigFormat)channel.format)(time, channel.utc ? 0 : OFFSET_HOURS, TimeQuality::WITHIN_1_US,
+                                                 ContinuousTimeQuality::NOT_USED, expected);
+  return memcmp(channels[i]->frame(), expected, sizeof(expected)) == 0 && channels[i]->inverted == channel.invert;
+}
+
+static void expect_frame(const ChannelConfig* channel, uint32_t frame) {
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    TEST_ASSERT_TRUE_MESSAGE(sends(i, channel[i], frame), irig_format_name((IrigFormat)channel[i].format));
+  }
+}
+
+static uint32_t underruns() {
+  uint32_t total = 0;
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    total += channels[i]->underrunCount();
+  }
+  return total;
+}
+
+// The encoder task, for as long as it has been woken
+static void run_encoder() {
+  while (ulTaskNotifyTake(pdTRUE, portMAX_DELAY)) {
+    engine->encodeFrame();
+  }
+}
+
+static void frame_start(uint32_t frame) {
+  BaseType_t woken = pdFALSE;
+  engine->frameStart(frame, true, &woken);
+}
+
+static void ticks() {
+  for (int k = 0; k < IRIG_FRAME_TICKS; k++) {
+    engine->tick();
+  }
+}
+
+// Frame 0 idle on the staged configuration, the time given for frame 1 on,
+// then the timer path up to the start of frame 'last'
+static void start(uint32_t last) {
+  frame_start(0);
+  engine->encode(time_of(1), OFFSET_HOURS, 1);
+  run_encoder();
+  ticks();
+  for (uint32_t frame = 1; frame < last; frame++) {
+    frame_start(frame);
+    run_encoder();
+    ticks();
+  }
+  frame_start(last);
+}
+
+void setUp() {
+  memset(host_pins(), 0, 64);
+  host_notifications() = 0;
+  host_on_unlock(nullptr);
+  random_state = 7;
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    channels[i] = new IRIGB(PINS[i]);
+  }
+  engine = new OutputEngine(channels);
+  TEST_ASSERT_TRUE(engine->begin(0));
+  default_config(config);
+  engine->configure(config);
+}
+
+void tearDown() {
+  delete engine;
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    delete channels[i];
+  }
+}
+
+void test_timer_path_matches_render() {
+  // The same changes on a second engine that renders its frames, on pins
+  // of its own; the sample of a tick is the level after it
+  IRIGB* rendered_channels[IRIG_CHANNELS];
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    rendered_channels[i] = new IRIGB(i);
+  }
+  OutputEngine rendered(rendered_channels);
+  rendered.begin(0);
+
+  uint8_t samples[IRIG_FRAME_TICKS];
+  for (uint32_t frame = 0; frame < 6; frame++) {
+    for (int i = 0; i < IRIG_CHANNELS; i++) {
+      config[i].format = (i + frame) % IRIG_FORMAT_COUNT;
+      config[i].enabled = (i + frame) % 3 != 0;
+      config[i].invert = (i * frame) % 4 == 1;
+    }
+    // Frame 2 keeps the configuration, 3 is not output and 4 runs on the
+    // engines' own count
+    if (frame != 2) {
+      engine->configure(config);
+      rendered.configure(config);
+    }
+    bool running = frame != 3;
+    rendered.render(samples, 1, running, frame);
+    BaseType_t woken = pdFALSE;
+    engine->frameStart(frame, running, &woken);
+    if (frame != 4) {
+      engine->encode(time_of(frame + 1), OFFSET_HOURS, frame + 1);
+      rendered.encode(time_of(frame + 1), OFFSET_HOURS, frame + 1);
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    engine->encodeFrame();
+    rendered.encodeFrame();
+
+    for (int k = 0; k + 1 < IRIG_FRAME_TICKS; k++) {
+      if (running) {
+        engine->tick();
+      }
+      uint8_t levels = 0;
+      for (int i = 0; i < IRIG_CHANNELS; i++) {
+        levels |= host_pins()[PINS[i]] << i;
+      }
+      TEST_ASSERT_EQUAL_HEX8(samples[k + 1], levels);
+    }
+    if (running) {
+      engine->tick();
+    }
+  }
+  // The end of the last frame
+  rendered.render(samples, 1, false, 6);
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    TEST_ASSERT_EQUAL_UINT32(rendered_channels[i]->framesEmitted(), channels[i]->framesEmitted());
+    TEST_ASSERT_EQUAL_UINT32(rendered_channels[i]->underrunCount(), channels[i]->underrunCount());
+    delete rendered_channels[i];
+  }
+}
+
+// By sequence number: one from setUp(), one here and up to two a frame
+static ChannelConfig history[2 * HANDOFF_FRAMES + 3][IRIG_CHANNELS];
+
+// Random configurations staged before and after random encode() calls,
+// frames the time task skips and an encoder task that runs at any tick.
+// Every frame of every running channel has to be the one of a single
+// configuration, never older than the last one it sent.
+static void check_handoff(bool rendered) {
+  uint32_t staged = engine->configure(config);
+  memcpy(history[staged], config, sizeof(config));
+  uint32_t sent[IRIG_CHANNELS];
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    sent[i] = staged;
+  }
+  uint32_t checked = 0;
+  uint8_t samples[IRIG_FRAME_TICKS];
+
+  for (uint32_t frame = 0; frame < HANDOFF_FRAMES + 2; frame++) {
+    bool changes = frame < HANDOFF_FRAMES;
+    if (rendered) {
+      engine->render(samples, 1, true, frame);
+      run_encoder();
+    } else {
+      frame_start(frame);
+    }
+
+    for (int i = 0; i < IRIG_CHANNELS && frame >= 2; i++) {
+      if (!(engine->activeMask() & (1 << i))) {
+        continue;
+      }
+      uint32_t sequence = sent[i];
+      while (sequence <= staged && !(history[sequence][i].enabled && sends(i, history[sequence][i], frame))) {
+        sequence++;
+      }
+      TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(staged, sequence, "Mixed or reverted frame");
+      sent[i] = sequence;
+      checked++;
+    }
+
+    uint32_t task_tick = next_random() % (IRIG_FRAME_TICKS - 1);
+    for (int step = 0; step < 3 && changes; step++) {
+      if (step == 1) {
+        if (frame == 0 || next_random() % 3) {
+          engine->encode(time_of(frame + 1), OFFSET_HOURS, frame + 1);
+        }
+      } else if (next_random() % 8 == 0) {
+        random_config(config);
+        staged = engine->configure(config);
+        memcpy(history[staged], config, sizeof(config));
+      }
+    }
+    if (rendered) {
+      run_encoder();
+      continue;
+    }
+    for (uint32_t k = 0; k < IRIG_FRAME_TICKS; k++) {
+      engine->tick();
+      if (k == task_tick) {
+        run_encoder();
+      }
+    }
+  }
+  TEST_ASSERT_GREATER_THAN_UINT32(HANDOFF_FRAMES, checked);
+  // Two frames without the time task take the last configuration over
+  TEST_ASSERT_EQUAL_UINT32(staged, engine->configApplied());
+}
+
+void test_config_handoff_timer_path() {
+  check_handoff(false);
+}
+
+void test_config_handoff_rendered() {
+  check_handoff(true);
+}
+
+void test_holdover_counts_the_clock_on() {
+  // One encode() for frame 1, then the time task stalls across the year end
+  start(1);
+  for (uint32_t frame = 1; frame < 30; frame++) {
+    expect_frame(config, frame);
+    run_encoder();
+    ticks();
+    frame_start(frame + 1);
+  }
+  TEST_ASSERT_EQUAL_UINT32(29, engine->holdoverFrames());
+  TEST_ASSERT_EQUAL_UINT32(0, engine->timeSteps());
+  TEST_ASSERT_EQUAL_UINT32(0, underruns());
+}
+
+void test_encode_steps_the_next_frame() {
+  start(10);
+  engine->encode(time_of(11 + 3), OFFSET_HOURS, 11);
+  run_encoder();
+  expect_frame(config, 10);
+  ticks();
+  frame_start(11);
+  expect_frame(config, 11 + 3);
+  TEST_ASSERT_EQUAL_UINT32(1, engine->timeSteps());
+  TEST_ASSERT_EQUAL_UINT32(0, underruns());
+}
+
+void test_late_encode_goes_to_the_next_frame() {
+  // A rendering backend started frame 10 before encode() gave it its time
+  uint8_t samples[IRIG_FRAME_TICKS];
+  engine->render(samples, 1, true, 0);
+  engine->encode(time_of(1), OFFSET_HOURS, 1);
+  run_encoder();
+  for (uint32_t frame = 1; frame <= 10; frame++) {
+    engine->render(samples, 1, true, frame);
+    run_encoder();
+  }
+  engine->encode(time_of(10 + 3), OFFSET_HOURS, 10);
+  run_encoder();
+  expect_frame(config, 10);
+  engine->render(samples, 1, true, 11);
+  run_encoder();
+  expect_frame(config, 11 + 3);
+  TEST_ASSERT_EQUAL_UINT32(1, engine->timeSteps());
+}
+
+void test_encode_between_frame_end_and_frame_start() {
+  // The channels have swapped in frame 4 at the end of 3, the frame start
+  // of 4 is still to come: a step supplied now is for frame 5
+  start(3);
+  run_encoder();
+  ticks();
+  engine->encode(time_of(4 + 5), OFFSET_HOURS, 4);
+  run_encoder();
+  frame_start(4);
+  expect_frame(config, 4);
+  run_encoder();
+  ticks();
+  frame_start(5);
+  expect_frame(config, 5 + 5);
+  TEST_ASSERT_EQUAL_UINT32(1, engine->timeSteps());
+  TEST_ASSERT_EQUAL_UINT32(0, underruns());
+}
+
+static void end_frame_3() {
+  ticks();
+  frame_start(4);
+}
+
+void test_frame_start_during_encode() {
+  // The task took its snapshot for frame 4 and stalled until frame 4 had
+  // started: frame 4 is an underrun and the stale snapshot is dropped
+  start(3);
+  host_on_unlock(end_frame_3);
+  engine->encodeFrame();
+  TEST_ASSERT_EQUAL_UINT32(IRIG_CHANNELS, underruns());
+  run_encoder();
+  ticks();
+  frame_start(5);
+  expect_frame(config, 5);
+}
+
+static void end_frame_3_only() {
+  ticks();
+}
+
+void test_encode_finishing_after_its_frame_ended() {
+  // The task finished frame 4 after frame 3 had ended, before the frame
+  // start of 4. Swapped in now it would sit ready until the end of frame 4
+  // and frame 5 would go out with the time of 4, not counted as an underrun.
+  start(3);
+  host_on_unlock(end_frame_3_only);
+  engine->encodeFrame();
+  TEST_ASSERT_EQUAL_UINT32(IRIG_CHANNELS, underruns());
+  frame_start(4);
+  // The task stalls through frame 4
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  ticks();
+  TEST_ASSERT_EQUAL_UINT32(2 * IRIG_CHANNELS, underruns());
+}
+
+static void step_time() {
+  engine->encode(time_of(4 + 7), OFFSET_HOURS, 4);
+}
+
+void test_encode_during_encode() {
+  // encode() steps the clock after the task took its snapshot: the task
+  // encodes again and only the new time is swapped in
+  start(3);
+  host_on_unlock(step_time);
+  engine->encodeFrame();
+  run_encoder();
+  ticks();
+  frame_start(4);
+  expect_frame(config, 4 + 7);
+  TEST_ASSERT_EQUAL_UINT32(1, engine->timeSteps());
+  TEST_ASSERT_EQUAL_UINT32(0, underruns());
+}
+
+static ChannelConfig changed[IRIG_CHANNELS];
+static uint32_t changed_sequence;
+
+static void reconfigure() {
+  changed_sequence = engine->configure(changed);
+}
+
+void test_configure_during_encode() {
+  // Staged after the task took its snapshot: frame 4 goes out whole on the
+  // old configuration, frame 5 whole on the new one
+  for (int i = 0; i < IRIG_CHANNELS; i++) {
+    changed[i] = config[i];
+    changed[i].format = (config[i].format + 3) % IRIG_FORMAT_COUNT;
+    changed[i].utc = !config[i].utc;
+    changed[i].invert = !config[i].invert;
+  }
+  start(3);
+  uint32_t applied = engine->configApplied();
+  host_on_unlock(reconfigure);
+  engine->encodeFrame();
+  ticks();
+  frame_start(4);
+  expect_frame(config, 4);
+  TEST_ASSERT_EQUAL_UINT32(applied, engine->configApplied());
+  run_encoder();
+  ticks();
+  frame_start(5);
+  expect_frame(changed, 5);
+  TEST_ASSERT_EQUAL_UINT32(changed_sequence, engine->configApplied());
+  TEST_ASSERT_EQUAL_UINT32(5, engine->configAppliedFrame());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_timer_path_matches_render);
+  RUN_TEST(test_config_handoff_timer_path);
+  RUN_TEST(test_config_handoff_rendered);
+  RUN_TEST(test_holdover_counts_the_clock_on);
+  RUN_TEST(test_encode_steps_the_next_frame);
+  RUN_TEST(test_late_encode_goes_to_the_next_frame);
+  RUN_TEST(test_encode_between_frame_end_and_frame_start);
+  RUN_TEST(test_frame_start_during_encode);
+  RUN_TEST(test_encode_finishing_after_its_frame_ended);
+  RUN_TEST(test_encode_during_encode);
+  RUN_TEST(test_configure_during_encode);
+  return UNITY_END();
+}
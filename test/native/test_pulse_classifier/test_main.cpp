@@ -0,0 +1,145 @@
+#include <unity.h>
+#include "pulse_classifier.h"
+
+// Synthetic IRIG-B pulse streams: markers at Pr and every P, data elements
+// alternate between runs of zeros and ones, widths scaled and jittered
+// like a real input would be.
+
+static uint32_t seed;
+
+static uint32_t next_random() {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7FFF;
+}
+
+static PulseSymbol expected_symbol(int element) {
+  if (element == 0 || element % 10 == 9) {
+    return PulseSymbol::MARKER;
+  }
+  return (element / 3) % 2 ? PulseSymbol::ONE : PulseSymbol::ZERO;
+}
+
+// Width of 'symbol' with 2/5/8 ms scaled by scale_pct, shifted by skew_us
+// and +/- jitter_us of noise
+static uint32_t width_of(PulseSymbol symbol, uint32_t scale_pct, int32_t skew_us, uint32_t jitter_us) {
+  uint32_t nominal = symbol == PulseSymbol::ZERO ? 2000 : symbol == PulseSymbol::ONE ? 5000 : 8000;
+  int32_t noise = jitter_us ? (int32_t)(next_random() % (2 * jitter_us + 1)) - (int32_t)jitter_us : 0;
+  return (uint32_t)((int32_t)(nominal * scale_pct / 100) + skew_us + noise);
+}
+
+// Feed 'frames' frames, running the task side after every frame like the
+// reference task does. Returns the misclassified pulses of the last frame.
+static int feed(PulseClassifier& classifier, int frames, uint32_t scale_pct, int32_t skew_us, uint32_t jitter_us,
+                bool update = true) {
+  int wrong = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    wrong = 0;
+    for (int element = 0; element < 100; element++) {
+      PulseSymbol symbol = expected_symbol(element);
+      if (classifier.classify(width_of(symbol, scale_pct, skew_us, jitter_us)) != symbol) {
+        wrong++;
+      }
+    }
+    if (update) {
+      classifier.update();
+    }
+  }
+  return wrong;
+}
+
+void setUp() {
+  seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_nominal_thresholds_before_lock() {
+  PulseClassifier classifier;
+  TEST_ASSERT_FALSE(classifier.locked());
+  TEST_ASSERT_EQUAL_UINT32(3500, classifier.threshold(0));
+  TEST_ASSERT_EQUAL_UINT32(6500, classifier.threshold(1));
+  TEST_ASSERT_TRUE(classifier.classify(2000) == PulseSymbol::ZERO);
+  TEST_ASSERT_TRUE(classifier.classify(5000) == PulseSymbol::ONE);
+  TEST_ASSERT_TRUE(classifier.classify(8000) == PulseSymbol::MARKER);
+}
+
+void test_clean_input_locks_on_nominal_centers() {
+  PulseClassifier classifier;
+  TEST_ASSERT_EQUAL(0, feed(classifier, 5, 100, 0, 100));
+  TEST_ASSERT_TRUE(classifier.locked());
+  TEST_ASSERT_UINT32_WITHIN(150, 2000, classifier.center(0));
+  TEST_ASSERT_UINT32_WITHIN(150, 5000, classifier.center(1));
+  TEST_ASSERT_UINT32_WITHIN(150, 8000, classifier.center(2));
+  TEST_ASSERT_GREATER_OR_EQUAL(PulseClassifier::LOCK_CONFIDENCE, classifier.confidence());
+}
+
+void test_stretched_input_locks_and_decodes() {
+  // Slow edges stretch every pulse by a quarter: the markers are past the
+  // nominal upper limit until the thresholds adapt
+  PulseClassifier classifier;
+  TEST_ASSERT_GREATER_THAN(0, feed(classifier, 1, 125, 0, 100));
+  TEST_ASSERT_EQUAL(0, feed(classifier, 5, 125, 0, 100));
+  TEST_ASSERT_TRUE(classifier.locked());
+  TEST_ASSERT_UINT32_WITHIN(200, 2500, classifier.center(0));
+  TEST_ASSERT_UINT32_WITHIN(200, 10000, classifier.center(2));
+}
+
+void test_skewed_input_locks_and_decodes() {
+  // Level shifting that adds a constant 1.2 ms to every pulse
+  PulseClassifier classifier;
+  feed(classifier, 5, 100, 1200, 150);
+  TEST_ASSERT_TRUE(classifier.locked());
+  TEST_ASSERT_EQUAL(0, feed(classifier, 1, 100, 1200, 150));
+  TEST_ASSERT_UINT32_WITHIN(200, 4700, classifier.threshold(0));
+  TEST_ASSERT_UINT32_WITHIN(200, 7700, classifier.threshold(1));
+}
+
+void test_classify_leaves_the_estimate_to_update() {
+  // The interrupt side never runs the k-means, however many pulses come in
+  PulseClassifier classifier;
+  feed(classifier, 10, 125, 0, 100, false);
+  TEST_ASSERT_FALSE(classifier.locked());
+  TEST_ASSERT_EQUAL_UINT32(3500, classifier.threshold(0));
+  TEST_ASSERT_TRUE(classifier.update());
+  TEST_ASSERT_TRUE(classifier.locked());
+  // Nothing new since
+  TEST_ASSERT_FALSE(classifier.update());
+}
+
+void test_glitches_and_stuck_line_are_rejected() {
+  PulseClassifier classifier;
+  TEST_ASSERT_TRUE(classifier.classify(200) == PulseSymbol::INVALID);
+  TEST_ASSERT_TRUE(classifier.classify(20000) == PulseSymbol::INVALID);
+  TEST_ASSERT_EQUAL_UINT32(2, classifier.rejected());
+}
+
+void test_noise_does_not_lock() {
+  PulseClassifier classifier;
+  for (int i = 0; i < 2000; i++) {
+    classifier.classify(500 + next_random() % 11000);
+    classifier.update();
+  }
+  TEST_ASSERT_FALSE(classifier.locked());
+}
+
+void test_locked_classifier_follows_a_new_input() {
+  PulseClassifier classifier;
+  feed(classifier, 5, 100, 0, 100);
+  TEST_ASSERT_TRUE(classifier.locked());
+  TEST_ASSERT_EQUAL(0, feed(classifier, 10, 125, 0, 100));
+  TEST_ASSERT_UINT32_WITHIN(300, 10000, classifier.center(2));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_nominal_thresholds_before_lock);
+  RUN_TEST(test_clean_input_locks_on_nominal_centers);
+  RUN_TEST(test_stretched_input_locks_and_decodes);
+  RUN_TEST(test_skewed_input_locks_and_decodes);
+  RUN_TEST(test_classify_leaves_the_estimate_to_update);
+  RUN_TEST(test_glitches_and_stuck_line_are_rejected);
+  RUN_TEST(test_noise_does_not_lock);
+  RUN_TEST(test_locked_classifier_follows_a_new_input);
+  return UNITY_END();
+}
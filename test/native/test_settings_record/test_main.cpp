@@ -0,0 +1,170 @@
+#include <unity.h>
+#include <string.h>
+#include "settings_record.h"
+
+// Records of every stored version, sealed the way the firmware that wrote
+// them did, read back as the current version. Anything with a bad CRC or
+// the wrong length is refused and leaves the defaults in place.
+
+static SettingsRecordV1 v1;
+static SettingsRecordV2 v2;
+static SettingsRecord record;
+
+// The fields every version shares, at the same offsets
+template <typename Record>
+static void fill_common(Record& r) {
+  memset(&r, 0, sizeof(r));
+  r.magic = SETTINGS_RECORD_MAGIC;
+  r.length = sizeof(Record);
+  r.dhcp = 0;
+  r.enabled = 1;
+  r.time_source = 1;
+  r.self_monitor = 1;
+  settings_copy_string(r.ip, sizeof(r.ip), "192.168.1.50");
+  settings_copy_string(r.subnet, sizeof(r.subnet), "255.255.255.0");
+  settings_copy_string(r.gateway, sizeof(r.gateway), "192.168.1.1");
+  settings_copy_string(r.dns, sizeof(r.dns), "192.168.1.2");
+  settings_copy_string(r.ntp_server, sizeof(r.ntp_server), "ntp.example.org");
+  settings_copy_string(r.ntp_server2, sizeof(r.ntp_server2), "pool.ntp.org");
+  r.ntp_port = 123;
+  r.ntp_port2 = 1123;
+  r.time_offset = -18000;
+}
+
+template <typename Record>
+static void check_common(const Record& r) {
+  TEST_ASSERT_EQUAL(0, record.dhcp);
+  TEST_ASSERT_EQUAL(1, record.enabled);
+  TEST_ASSERT_EQUAL(1, record.time_source);
+  TEST_ASSERT_EQUAL(1, record.self_monitor);
+  TEST_ASSERT_EQUAL_STRING(r.ip, record.ip);
+  TEST_ASSERT_EQUAL_STRING(r.subnet, record.subnet);
+  TEST_ASSERT_EQUAL_STRING(r.gateway, record.gateway);
+  TEST_ASSERT_EQUAL_STRING(r.dns, record.dns);
+  TEST_ASSERT_EQUAL_STRING(r.ntp_server, record.ntp_server);
+  TEST_ASSERT_EQUAL_STRING(r.ntp_server2, record.ntp_server2);
+  TEST_ASSERT_EQUAL(123, record.ntp_port);
+  TEST_ASSERT_EQUAL(1123, record.ntp_port2);
+  TEST_ASSERT_EQUAL(-18000, record.time_offset);
+}
+
+void setUp() {
+  fill_common(v1);
+  v1.version = 1;
+  for (int i = 0; i < 8; i++) {
+    v1.channel_mode[i] = i;
+  }
+  v1.crc = settings_crc32(&v1, offsetof(SettingsRecordV1, crc));
+
+  fill_common(v2);
+  v2.version = 2;
+  for (int i = 0; i < SETTINGS_RECORD_CHANNELS; i++) {
+    v2.channels[i].format = i;
+    v2.channels[i].flags = i % 2 ? SETTINGS_CHANNEL_ENABLED : SETTINGS_CHANNEL_UTC | SETTINGS_CHANNEL_INVERT;
+  }
+  v2.crc = settings_crc32(&v2, offsetof(SettingsRecordV2, crc));
+
+  // The defaults the loader starts from
+  memset(&record, 0, sizeof(record));
+  for (int i = 0; i < SETTINGS_RECORD_CHANNELS; i++) {
+    record.channels[i].format = 9;
+    record.channels[i].flags = SETTINGS_CHANNEL_ENABLED;
+    record.channels[i].advance_us = 250;
+  }
+}
+
+void tearDown() {
+}
+
+void test_crc32_check_value() {
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, settings_crc32("123456789", 9));
+}
+
+void test_current_round_trip() {
+  fill_common(record);
+  record.channels[3].advance_us = 999;
+  settings_record_seal(record);
+  TEST_ASSERT_EQUAL(SETTINGS_RECORD_VERSION, record.version);
+  TEST_ASSERT_EQUAL(sizeof(SettingsRecord), record.length);
+  TEST_ASSERT_TRUE(settings_record_valid(record, sizeof(record)));
+
+  SettingsRecord copy;
+  memcpy(&copy, &record, sizeof(copy));
+  TEST_ASSERT_TRUE(settings_record_valid(copy, sizeof(copy)));
+  TEST_ASSERT_EQUAL(999, copy.channels[3].advance_us);
+}
+
+void test_v1_upgrade() {
+  TEST_ASSERT_TRUE(settings_record_upgrade(v1, sizeof(v1), record));
+  TEST_ASSERT_TRUE(settings_record_valid(record, sizeof(record)));
+  TEST_ASSERT_EQUAL(SETTINGS_RECORD_VERSION, record.version);
+  check_common(v1);
+  // The modes are dropped, the channels keep what they had
+  for (int i = 0; i < SETTINGS_RECORD_CHANNELS; i++) {
+    TEST_ASSERT_EQUAL(9, record.channels[i].format);
+    TEST_ASSERT_EQUAL(SETTINGS_CHANNEL_ENABLED, record.channels[i].flags);
+    TEST_ASSERT_EQUAL(250, record.channels[i].advance_us);
+  }
+}
+
+void test_v2_upgrade() {
+  TEST_ASSERT_TRUE(settings_record_upgrade(v2, sizeof(v2), record));
+  TEST_ASSERT_TRUE(settings_record_valid(record, sizeof(record)));
+  TEST_ASSERT_EQUAL(SETTINGS_RECORD_VERSION, record.version);
+  check_common(v2);
+  for (int i = 0; i < SETTINGS_RECORD_CHANNELS; i++) {
+    TEST_ASSERT_EQUAL(v2.channels[i].format, record.channels[i].format);
+    TEST_ASSERT_EQUAL(v2.channels[i].flags, record.channels[i].flags);
+    TEST_ASSERT_EQUAL(0, record.channels[i].advance_us);
+  }
+}
+
+void test_crc_mismatch() {
+  v1.ntp_port ^= 1;
+  TEST_ASSERT_FALSE(settings_record_upgrade(v1, sizeof(v1), record));
+  v2.channels[7].flags ^= SETTINGS_CHANNEL_INVERT;
+  TEST_ASSERT_FALSE(settings_record_upgrade(v2, sizeof(v2), record));
+  // Left as it was
+  TEST_ASSERT_EQUAL(250, record.channels[0].advance_us);
+  TEST_ASSERT_EQUAL(0, record.ntp_port);
+
+  fill_common(record);
+  settings_record_seal(record);
+  record.crc ^= 0x80000000u;
+  TEST_ASSERT_FALSE(settings_record_valid(record, sizeof(record)));
+}
+
+void test_wrong_length() {
+  TEST_ASSERT_FALSE(settings_record_upgrade(v1, sizeof(v1) - 1, record));
+  TEST_ASSERT_FALSE(settings_record_upgrade(v2, sizeof(v2) + 1, record));
+  // A v2 record read into the v1 layout and the other way round
+  TEST_ASSERT_FALSE(settings_record_upgrade(v1, sizeof(v2), record));
+  TEST_ASSERT_FALSE(settings_record_upgrade(v2, sizeof(v1), record));
+
+  fill_common(record);
+  settings_record_seal(record);
+  TEST_ASSERT_FALSE(settings_record_valid(record, sizeof(SettingsRecordV2)));
+  // A length field that disagrees with the sealed size
+  record.length = sizeof(SettingsRecordV2);
+  record.crc = settings_crc32(&record, offsetof(SettingsRecord, crc));
+  TEST_ASSERT_FALSE(settings_record_valid(record, sizeof(record)));
+}
+
+void test_older_version_is_not_current() {
+  // A v1 record sealed with the v2 version number
+  v1.version = 2;
+  v1.crc = settings_crc32(&v1, offsetof(SettingsRecordV1, crc));
+  TEST_ASSERT_FALSE(settings_record_upgrade(v1, sizeof(v1), record));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_crc32_check_value);
+  RUN_TEST(test_current_round_trip);
+  RUN_TEST(test_v1_upgrade);
+  RUN_TEST(test_v2_upgrade);
+  RUN_TEST(test_crc_mismatch);
+  RUN_TEST(test_wrong_length);
+  RUN_TEST(test_older_version_is_not_current);
+  return UNITY_END();
+}
@@ -0,0 +1,157 @@
+# PlatformIO post-link step: fail the build when our IRAM code calls into
+# flash.
+#
+# The output timer and the edge timer interrupts are allocated with
+# ESP_INTR_FLAG_IRAM, so they keep running while the flash cache is off for
+# an NVS or SPIFFS write. Everything they call has to be in IRAM too. A
+# missing IRAM_ATTR, an inline function the compiler did not inline or a
+# library call works fine until the first flash write, then the interrupt
+# stalls or faults and the outputs freeze mid-pulse.
+#
+# Our IRAM functions are the .iram1.* symbols of the objects built from src/
+# and lib/. Their calls are read from the firmware disassembly: a direct
+# call, or a callx through a literal loaded with l32r (the usual form,
+# flash is out of call range from IRAM). Calls through pointers held
+# anywhere else are not followed.
+
+Import("env")
+
+import os
+import re
+import subprocess
+
+# Caller and callee pairs let through. None: the frame encoding runs in a
+# task, the interrupts only wake it.
+ALLOWED = set()
+
+FUNCTION = re.compile(r"^([0-9a-f]{8}) <(.+)>:$")
+L32R = re.compile(r"\tl32r\s+(a\d+), ([0-9a-f]{8})")
+CALL = re.compile(r"\tcall(?:0|4|8|12)\s+([0-9a-f]{8})")
+CALLX = re.compile(r"\tcallx(?:0|4|8|12)\s+(a\d+)")
+CONTENTS = re.compile(r"^ ([0-9a-f]{8}) ((?:[0-9a-f]{2,8} ?){1,4})")
+
+
+def tool(name):
+    # xtensa-esp32s3-elf-gcc -> xtensa-esp32s3-elf-objdump
+    return re.sub(r"g(cc|\+\+)$", name, env.subst("$CC"))
+
+
+def run(*args):
+    return subprocess.run(args, env=env["ENV"], check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+
+
+def own_objects(build_dir, project_dir):
+    libs = set(os.listdir(os.path.join(project_dir, "lib")))
+    for root, _, files in os.walk(build_dir):
+        parts = os.path.relpath(root, build_dir).split(os.sep)
+        ours = parts[0] == "src" or (parts[0].startswith("lib") and len(parts) > 1 and parts[1] in libs)
+        if ours:
+            for name in files:
+                if name.endswith(".o"):
+                    yield os.path.join(root, name)
+
+
+def iram_symbols(objdump, objects):
+    symbols = set()
+    for path in objects:
+        for line in run(objdump, "-t", path).splitlines():
+            fields = line.split()
+            if len(fields) >= 5 and fields[-3].startswith(".iram1") and "F" in fields[1:-3]:
+                symbols.add(fields[-1])
+    return symbols
+
+
+def section_ranges(objdump, elf):
+    ranges = {}
+    for line in run(objdump, "-h", elf).splitlines():
+        fields = line.split()
+        if len(fields) >= 4 and fields[0].isdigit():
+            ranges[fields[1]] = (int(fields[3], 16), int(fields[3], 16) + int(fields[2], 16))
+    return ranges
+
+
+def words(objdump, elf, sections):
+    # Little-endian words of the sections holding IRAM code and its literals
+    memory = {}
+    args = [objdump, "-s"]
+    for name in sections:
+        args += ["-j", name]
+    for line in run(*args, elf).splitlines():
+        match = CONTENTS.match(line)
+        if not match:
+            continue
+        data = bytes.fromhex(match.group(2).replace(" ", ""))
+        base = int(match.group(1), 16)
+        for offset in range(0, len(data) - 3, 4):
+            memory[base + offset] = int.from_bytes(data[offset:offset + 4], "little")
+    return memory
+
+
+def demangle(cxxfilt, names):
+    if not names:
+        return {}
+    output = subprocess.run([cxxfilt], env=env["ENV"], input="\n".join(names), check=True,
+                            stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return {name: plain.split("(")[0] for name, plain in zip(names, output.splitlines())}
+
+
+def check_iram(source, target, env):
+    elf = str(target[0])
+    objdump = tool("objdump")
+    ours = iram_symbols(objdump, own_objects(env.subst("$BUILD_DIR"), env.subst("$PROJECT_DIR")))
+    ranges = section_ranges(objdump, elf)
+    flash = [span for name, span in ranges.items() if name.startswith(".flash")]
+    ram = [name for name in ranges if name.startswith((".iram0", ".dram0"))]
+    memory = words(objdump, elf, ram)
+    names = {}
+    for line in run(objdump, "-t", elf).splitlines():
+        fields = line.split()
+        if len(fields) >= 5 and "F" in fields[1:-3]:
+            names[int(fields[0], 16)] = fields[-1]
+
+    def in_flash(address):
+        return any(start <= address < end for start, end in flash)
+
+    problems = []
+    caller = None
+    loaded = {}
+    for line in run(objdump, "-d", "-j", ".iram0.text", elf).splitlines():
+        match = FUNCTION.match(line)
+        if match:
+            caller = match.group(2) if match.group(2) in ours else None
+            loaded = {}
+            continue
+        if not caller:
+            continue
+        match = L32R.search(line)
+        if match:
+            address = int(match.group(2), 16)
+            if address not in memory:
+                problems.append((caller, "literal at 0x%08x in flash" % address))
+            else:
+                loaded[match.group(1)] = memory[address]
+            continue
+        match = CALL.search(line)
+        callee = int(match.group(1), 16) if match else None
+        match = CALLX.search(line)
+        if match:
+            callee = loaded.get(match.group(1))
+        if callee is not None and in_flash(callee):
+            problems.append((caller, names.get(callee, "0x%08x" % callee)))
+
+    plain = demangle(tool("c++filt"), sorted({name for problem in problems for name in problem}))
+    failed = False
+    for caller, callee in problems:
+        pair = (plain.get(caller, caller), plain.get(callee, callee))
+        if pair in ALLOWED:
+            continue
+        print("IRAM check: %s calls %s in flash" % pair)
+        failed = True
+    if failed:
+        return 1
+    print("IRAM check: %d IRAM functions, no calls into flash" % len(ours))
+    return 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_iram)
@@ -0,0 +1,136 @@
+# PlatformIO pre-build step: gzip the web assets in data/ and describe them
+# for the web server.
+#
+#   data/<file>                        sources, edited by hand
+#   .pio/web/fs/<file>.gz              filesystem image contents (data_dir)
+#   .pio/build/<env>/web/web_assets.h  manifest: URL, file, type, ETag, caching
+#
+# With -DIRIGB_EMBED_ASSETS in build_flags the manifest also carries the
+# compressed bytes as const arrays, which the linker places in flash, and the
+# firmware serves them without a filesystem.
+#
+# Output is deterministic (no gzip timestamp) and only rewritten when it
+# changes, so an unchanged UI does not trigger a rebuild or a new ETag.
+
+Import("env")
+
+import gzip
+import hashlib
+import os
+
+PROJECT_DIR = env.subst("$PROJECT_DIR")
+SOURCE_DIR = os.path.join(PROJECT_DIR, "data")
+OUTPUT_DIR = os.path.join(PROJECT_DIR, ".pio", "web")
+FS_DIR = os.path.join(OUTPUT_DIR, "fs")
+# Per environment, the manifest differs between filesystem and embedded builds
+INCLUDE_DIR = os.path.join(env.subst("$BUILD_DIR"), "web")
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+}
+
+# Pages are revalidated on every load (a 304 when unchanged) so a firmware
+# update shows up at once; other assets are cached for a day.
+CACHE_PAGE = "no-cache"
+CACHE_ASSET = "max-age=86400"
+
+
+def embed_requested():
+    flags = env.get("BUILD_FLAGS", [])
+    if isinstance(flags, str):
+        flags = [flags]
+    return any("-DIRIGB_EMBED_ASSETS" in flag for flag in flags)
+
+
+def byte_array(name, data):
+    lines = ["static const uint8_t %s[] = {" % name]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines.append("};")
+    return lines
+
+
+def write_if_changed(path, data):
+    if os.path.exists(path):
+        with open(path, "rb") as f:
+            if f.read() == data:
+                return
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def collect_assets():
+    assets = []
+    for root, _, files in os.walk(SOURCE_DIR):
+        for name in sorted(files):
+            source = os.path.join(root, name)
+            relative = os.path.relpath(source, SOURCE_DIR).replace(os.sep, "/")
+            with open(source, "rb") as f:
+                content = f.read()
+            compressed = gzip.compress(content, compresslevel=9, mtime=0)
+            extension = os.path.splitext(name)[1].lower()
+            assets.append({
+                "path": "/" + relative,
+                "file": "/" + relative + ".gz",
+                "type": CONTENT_TYPES.get(extension, "application/octet-stream"),
+                "etag": '\\"%s\\"' % hashlib.sha256(content).hexdigest()[:16],
+                "cache": CACHE_PAGE if extension == ".html" else CACHE_ASSET,
+                "compressed": compressed,
+                "size": len(content),
+            })
+    return assets
+
+
+def manifest(assets, embed):
+    lines = [
+        "// Generated by tools/compress_assets.py from data/, do not edit",
+        "#ifndef WEB_ASSETS_H",
+        "#define WEB_ASSETS_H",
+        "",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        "",
+        "struct WebAsset {",
+        "    const char* path;            // URL",
+        "    const char* file;            // Gzipped file in the filesystem",
+        "    const char* content_type;",
+        "    const char* etag;            // Strong validator of the uncompressed content",
+        "    const char* cache_control;",
+        "    size_t size;                 // Compressed size",
+        "    const uint8_t* data;         // Compressed bytes in flash, null unless embedded",
+        "};",
+        "",
+    ]
+    if embed:
+        for i, a in enumerate(assets):
+            lines += byte_array("WEB_ASSET_DATA_%d" % i, a["compressed"]) + [""]
+    lines.append("static const WebAsset WEB_ASSETS[] = {")
+    for i, a in enumerate(assets):
+        lines.append('    {"%s", "%s", "%s", "%s", "%s", %d, %s},' % (
+            a["path"], a["file"], a["type"], a["etag"], a["cache"], len(a["compressed"]),
+            "WEB_ASSET_DATA_%d" % i if embed else "nullptr"))
+    lines += [
+        "};",
+        "",
+        "static const size_t WEB_ASSET_COUNT = %d;" % len(assets),
+        "",
+        "#endif // WEB_ASSETS_H",
+        "",
+    ]
+    return "\n".join(lines).encode()
+
+
+assets = collect_assets()
+for a in assets:
+    write_if_changed(os.path.join(FS_DIR, a["file"].lstrip("/")), a["compressed"])
+    print("Web asset %s: %d -> %d bytes" % (a["path"], a["size"], len(a["compressed"])))
+write_if_changed(os.path.join(INCLUDE_DIR, "web_assets.h"), manifest(assets, embed_requested()))
+
+env.Append(CPPPATH=[INCLUDE_DIR])